@@ -0,0 +1,103 @@
+#include "CollisionMerger.h"
+#include <algorithm>
+#include <cmath>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+
+CollisionMerger::CollisionMerger(float merge_distance_square, const PeriodicBox* periodic_box) : merge_distance_square_(merge_distance_square),
+	periodic_box_(periodic_box), spatial_hash_(periodic_box) {
+}
+
+// Nearest other particle within the merge distance, among the neighbouring cells. Ties go to the lower index
+void CollisionMerger::find_nearest_particles(const Particle* particles, size_t particle_count) {
+	nearest_particles_.resize(particle_count);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			const Particle& particle = particles[index];
+			uint32_t nearest = static_cast<uint32_t>(index);
+			float nearest_distance_square = merge_distance_square_;
+			spatial_hash_.for_each_neighbour(particle, [&](uint32_t other) {
+				if (other == index)
+					return;
+				float dx, dy;
+				spatial_hash_.get_displacement(particle, particles[other], dx, dy);
+				float distance_square = dx * dx + dy * dy;
+				if (distance_square < nearest_distance_square ||
+					(distance_square == nearest_distance_square && nearest != index && other < nearest)) {
+					nearest = other;
+					nearest_distance_square = distance_square;
+				}
+			});
+			nearest_particles_[index] = nearest;
+		}
+	}); // Implicit barrier, the neighbourhoods differ in size so the range is balanced dynamically
+}
+
+// One particle with the mass and the momentum of both, at their center of mass
+Particle CollisionMerger::merge_pair(const Particle& particle, const Particle& interacting_particle) const {
+	float mass = particle.mass_ + interacting_particle.mass_;
+	float weight = mass > 0.0f ? interacting_particle.mass_ / mass : 0.5f; // Share of the interacting particle
+	float dx, dy;
+	spatial_hash_.get_displacement(particle, interacting_particle, dx, dy);
+
+	Particle merged_particle(particle.x_ + weight * dx, particle.y_ + weight * dy, mass);
+	if (periodic_box_ != nullptr) { // The center of mass may be across a wall
+		if (merged_particle.x_ < 0.0f)
+			merged_particle.x_ += periodic_box_->get_size_x();
+		else if (merged_particle.x_ >= periodic_box_->get_size_x())
+			merged_particle.x_ -= periodic_box_->get_size_x();
+		if (merged_particle.y_ < 0.0f)
+			merged_particle.y_ += periodic_box_->get_size_y();
+		else if (merged_particle.y_ >= periodic_box_->get_size_y())
+			merged_particle.y_ -= periodic_box_->get_size_y();
+	}
+	merged_particle.velocity_x_ = particle.velocity_x_ + weight * (interacting_particle.velocity_x_ - particle.velocity_x_);
+	merged_particle.velocity_y_ = particle.velocity_y_ + weight * (interacting_particle.velocity_y_ - particle.velocity_y_);
+	merged_particle.acceleration_x_ = particle.acceleration_x_ + weight * (interacting_particle.acceleration_x_ - particle.acceleration_x_);
+	merged_particle.acceleration_y_ = particle.acceleration_y_ + weight * (interacting_particle.acceleration_y_ - particle.acceleration_y_);
+	return merged_particle;
+}
+
+size_t CollisionMerger::merge(ParticleVector& particles) {
+	size_t particle_count = particles.size();
+	if (particle_count < 2)
+		return 0;
+	const Particle* particle_data = particles.data();
+	spatial_hash_.build(particle_data, particle_count, std::sqrt(std::max(merge_distance_square_, 0.0f)));
+	find_nearest_particles(particle_data, particle_count);
+
+	// A particle goes away when it merges into a lower index
+	kept_offsets_.resize(particle_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			uint32_t nearest = nearest_particles_[index];
+			kept_offsets_[index] = nearest < index && nearest_particles_[nearest] == index ? 0 : 1;
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+	size_t kept_count = parallel_exclusive_scan(kept_offsets_.data(), particle_count, block_sums_);
+	if (kept_count == particle_count)
+		return 0;
+
+	// Compact in the original order, the lower index of every pair carries the merged particle. The buffer is only
+	// allocated when it is too small, its pages are then first touched in parallel by the allocator. Otherwise it is the
+	// previous particle buffer, written by the compaction only and shrunk without touching it
+	if (merged_particles_.size() < particle_count)
+		ParticleVector(particle_count).swap(merged_particles_);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			uint32_t nearest = nearest_particles_[index];
+			bool merging = nearest != index && nearest_particles_[nearest] == index;
+			if (merging && nearest < index)
+				continue;
+			merged_particles_[kept_offsets_[index]] = merging ? merge_pair(particle_data[index], particle_data[nearest]) : particle_data[index];
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+	merged_particles_.resize(kept_count);
+
+	particles.swap(merged_particles_); // The old particles keep their buffer for the next compaction
+	return particle_count - kept_count;
+}
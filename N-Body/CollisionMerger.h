@@ -0,0 +1,47 @@
+#pragma once
+#include "Particle.h"
+#include "FirstTouchAllocator.h"
+#include "PeriodicBox.h"
+#include "SpatialHash.h"
+#include "Settings.h"
+#include <cstdint>
+#include <vector>
+
+// Merges the particles that come closer than the merge distance, the stiffest pairs of the force. Every step the
+// particles are binned into a SpatialHash of cells at least as wide as the merge distance, so the close pairs are found
+// among the 3 x 3 neighbouring cells. Mutual nearest neighbours merge into the lower index, conserving mass and
+// momentum, and the particles are compacted in parallel in their original order. Longer chains of close particles merge
+// over the next steps. The result does not depend on the threads
+class CollisionMerger {
+	float merge_distance_square_;
+	const PeriodicBox* periodic_box_;
+	SpatialHash spatial_hash_;
+
+	std::vector<uint32_t> nearest_particles_; // Nearest particle within the merge distance, or the particle itself
+	std::vector<uint32_t> kept_offsets_; // Position of every kept particle after the compaction
+	std::vector<uint32_t> block_sums_; // Partial sums of the parallel scan
+	ParticleVector merged_particles_; // Compacted particles, swapped with the particles of the simulation
+
+	void find_nearest_particles(const Particle* particles, size_t particle_count);
+	Particle merge_pair(const Particle& particle, const Particle& interacting_particle) const;
+public:
+	// Without a periodic box the universe is open, the hash covers any position
+	explicit CollisionMerger(float merge_distance_square, const PeriodicBox* periodic_box = nullptr);
+	CollisionMerger(const CollisionMerger&) = delete;
+	CollisionMerger& operator=(const CollisionMerger&) = delete;
+
+	size_t merge(ParticleVector& particles); // Returns the number of merged pairs
+
+	// Compact a column that follows the particles the way the last merge compacted them, a merged particle keeps the value
+	// of its lower index. Only after a merge that returned merged pairs, on a column of the particle count before the
+	// merge. The column is left at that size, its first values belong to the merged particles
+	template <typename Value>
+	void compact(std::vector<Value>& values) const {
+		for (size_t index = 0; index < values.size(); ++index) { // In order, the values only move down
+			uint32_t nearest = nearest_particles_[index];
+			if (nearest < index && nearest_particles_[nearest] == index)
+				continue;
+			values[kept_offsets_[index]] = values[index];
+		}
+	}
+};
@@ -0,0 +1,404 @@
+#include "CompressedSnapshot.h"
+#include "lodepng.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
+
+static const char COMPRESSED_SNAPSHOT_MAGIC[8] = { 'N', 'B', 'O', 'D', 'Y', 'C', 'S', 'N' };
+static const uint32_t MORTON_BITS = 16; // Per axis, the key of a particle fits in 32 bits
+
+// Range of the finite values of a column
+struct ColumnRange {
+	float min;
+	float max;
+	bool finite; // No infinity or NaN in the column
+};
+
+static ColumnRange get_column_range(const std::vector<float>& values) {
+	return tbb::parallel_reduce(tbb::blocked_range<size_t>(0, values.size()),
+		ColumnRange{ std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), true },
+		[&](const tbb::blocked_range<size_t>& r, ColumnRange local_range) {
+		for (size_t index = r.begin(); index != r.end(); ++index) {
+			if (!std::isfinite(values[index])) {
+				local_range.finite = false;
+				continue;
+			}
+			local_range.min = std::min(local_range.min, values[index]);
+			local_range.max = std::max(local_range.max, values[index]);
+		}
+		return local_range;
+	},
+		[](const ColumnRange& first, const ColumnRange& second) {
+		return ColumnRange{ std::min(first.min, second.min), std::max(first.max, second.max), first.finite && second.finite };
+	});
+}
+
+// Map a value to the nearest of the 2^bits evenly spaced levels of the column. The columns with values that are not
+// finite are never written, a NaN still maps to the first level rather than to an undefined conversion
+static uint32_t quantize(float value, const CompressedColumn& column, uint32_t bits) {
+	double levels = static_cast<double>((static_cast<uint64_t>(1) << bits) - 1);
+	if (column.maximum <= column.minimum)
+		return 0;
+
+	double level = (static_cast<double>(value) - column.minimum) / (static_cast<double>(column.maximum) - column.minimum) * levels + 0.5;
+	if (std::isnan(level) || level <= 0.0)
+		return 0;
+	return static_cast<uint32_t>(std::min(level, levels));
+}
+
+static float dequantize(uint32_t level, const CompressedColumn& column) {
+	double levels = static_cast<double>((static_cast<uint64_t>(1) << column.quantization_bits) - 1);
+	return static_cast<float>(column.minimum + level / levels * (static_cast<double>(column.maximum) - column.minimum));
+}
+
+// Spread the bits of a 16 bit number to the even bits of a 32 bit number
+static uint32_t spread_bits(uint32_t value) {
+	value &= 0xffff;
+	value = (value | (value << 8)) & 0x00ff00ff;
+	value = (value | (value << 4)) & 0x0f0f0f0f;
+	value = (value | (value << 2)) & 0x33333333;
+	value = (value | (value << 1)) & 0x55555555;
+	return value;
+}
+
+// Small differences of either sign become small unsigned numbers
+static uint32_t zigzag_encode(int32_t value) {
+	return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int32_t zigzag_decode(uint32_t value) {
+	return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// Deflated data of one chunk
+struct CompressedBlock {
+	unsigned char* data = nullptr;
+	size_t size = 0;
+	unsigned error = 0;
+};
+
+CompressedSnapshotWriter::CompressedSnapshotWriter(uint64_t seed, float time_step, size_t universe_size_x, size_t universe_size_y) {
+	memset(&header_, 0, sizeof(header_));
+	memcpy(header_.magic, COMPRESSED_SNAPSHOT_MAGIC, sizeof(COMPRESSED_SNAPSHOT_MAGIC));
+	header_.version = COMPRESSED_SNAPSHOT_VERSION;
+	header_.byte_order = SNAPSHOT_BYTE_ORDER;
+	header_.seed = seed;
+	header_.time_step = time_step;
+	header_.universe_size_x = static_cast<uint32_t>(universe_size_x);
+	header_.universe_size_y = static_cast<uint32_t>(universe_size_y);
+	header_.column_count = SNAPSHOT_COLUMN_COUNT;
+	header_.chunk_size = static_cast<uint32_t>(COMPRESSED_SNAPSHOT_CHUNK_SIZE);
+}
+
+// Quantization of every column. Position ranges cover the universe, and the particles that left it
+bool CompressedSnapshotWriter::set_column_ranges() {
+	bool finite = true;
+	for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+		CompressedColumn& current_column = header_.columns[column];
+		ColumnRange range = get_column_range(columns_[column]);
+		if (header_.particle_count == 0)
+			range = ColumnRange{ 0.0f, 0.0f, true };
+
+		switch (column) {
+		case SNAPSHOT_X:
+		case SNAPSHOT_Y:
+			current_column.quantization_bits = POSITION_QUANTIZATION_BITS;
+			range.min = std::min(range.min, 0.0f);
+			range.max = std::max(range.max, static_cast<float>(column == SNAPSHOT_X ? header_.universe_size_x : header_.universe_size_y));
+			break;
+		case SNAPSHOT_VELOCITY_X:
+		case SNAPSHOT_VELOCITY_Y:
+			current_column.quantization_bits = VELOCITY_QUANTIZATION_BITS;
+			break;
+		default:
+			current_column.quantization_bits = 0; // Masses are kept exact
+		}
+		current_column.quantization_bits = std::min(current_column.quantization_bits, 32u);
+		current_column.minimum = range.min;
+		current_column.maximum = range.max;
+		finite = finite && (range.finite || current_column.quantization_bits == 0); // Exact floats keep any bits
+	}
+	return finite;
+}
+
+// Reorder every column along the Morton curve of the positions, the original indices are kept with them
+void CompressedSnapshotWriter::sort_morton() {
+	size_t particle_count = static_cast<size_t>(header_.particle_count);
+	morton_order_.resize(particle_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			uint32_t x = quantize(columns_[SNAPSHOT_X][index], header_.columns[SNAPSHOT_X], MORTON_BITS);
+			uint32_t y = quantize(columns_[SNAPSHOT_Y][index], header_.columns[SNAPSHOT_Y], MORTON_BITS);
+			uint64_t key = spread_bits(x) | (spread_bits(y) << 1);
+			morton_order_[index] = (key << 32) | index;
+		}
+	}); // Implicit barrier
+
+	tbb::parallel_sort(morton_order_.begin(), morton_order_.end());
+
+	original_indices_.resize(particle_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index)
+			original_indices_[index] = static_cast<uint32_t>(morton_order_[index] & 0xffffffff);
+	}); // Implicit barrier
+
+	reordered_column_.resize(particle_count);
+	for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+		const std::vector<float>& values = columns_[column];
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t index = r.begin(); index != r.end(); ++index)
+				reordered_column_[index] = values[original_indices_[index]];
+		}); // Implicit barrier
+		columns_[column].swap(reordered_column_);
+	}
+}
+
+// Compress the gathered columns and write the file
+bool CompressedSnapshotWriter::write(const std::string& filename) {
+	size_t particle_count = static_cast<size_t>(header_.particle_count);
+	size_t chunk_size = header_.chunk_size;
+	size_t chunk_count = (particle_count + chunk_size - 1) / chunk_size;
+	header_.chunk_count = static_cast<uint32_t>(chunk_count);
+
+	if (!set_column_ranges())
+		return false;
+	header_.order = MORTON_ORDER_SNAPSHOTS && particle_count <= std::numeric_limits<uint32_t>::max() ? SNAPSHOT_ORDER_MORTON :
+		SNAPSHOT_ORDER_ORIGINAL;
+	if (header_.order == SNAPSHOT_ORDER_MORTON)
+		sort_morton();
+	size_t stream_count = SNAPSHOT_COLUMN_COUNT + (header_.order == SNAPSHOT_ORDER_MORTON ? 1 : 0);
+
+	// Every chunk is delta coded and deflated on its own
+	std::vector<CompressedBlock> blocks(stream_count * chunk_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, blocks.size(), 1),
+		[&](const tbb::blocked_range<size_t>& r) {
+		std::vector<unsigned char> planes;
+		for (size_t block = r.begin(); block != r.end(); ++block) {
+			size_t column = block / chunk_count;
+			size_t start = block % chunk_count * chunk_size;
+			size_t count = std::min(chunk_size, particle_count - start);
+			bool index_stream = column == SNAPSHOT_COLUMN_COUNT;
+			const float* values = index_stream ? nullptr : columns_[column].data() + start;
+			const CompressedColumn& current_column = header_.columns[index_stream ? 0 : column];
+
+			// Byte planes of the differences, the high bytes of small differences turn into long zero runs
+			planes.resize(count * sizeof(uint32_t));
+			uint32_t previous = 0;
+			for (size_t index = 0; index < count; ++index) {
+				uint32_t word, difference;
+				if (index_stream) {
+					word = original_indices_[start + index];
+					difference = zigzag_encode(static_cast<int32_t>(word - previous));
+				} else if (current_column.quantization_bits == 0) {
+					memcpy(&word, &values[index], sizeof(word));
+					difference = word ^ previous;
+				} else {
+					word = quantize(values[index], current_column, current_column.quantization_bits);
+					difference = zigzag_encode(static_cast<int32_t>(word - previous));
+				}
+				previous = word;
+
+				for (size_t plane = 0; plane < sizeof(uint32_t); ++plane)
+					planes[plane * count + index] = static_cast<unsigned char>(difference >> (8 * plane));
+			}
+
+			blocks[block].error = lodepng_zlib_compress(&blocks[block].data, &blocks[block].size, planes.data(), planes.size(),
+				&lodepng_default_compress_settings);
+		}
+	}); // Implicit barrier
+
+	// Lay out the chunks after the header and the chunk table
+	std::vector<CompressedChunk> chunk_table(blocks.size());
+	uint64_t offset = sizeof(CompressedSnapshotHeader) + chunk_table.size() * sizeof(CompressedChunk);
+	bool compressed = true;
+	for (size_t block = 0; block < blocks.size(); ++block) {
+		compressed = compressed && blocks[block].error == 0;
+		chunk_table[block].offset = offset;
+		chunk_table[block].size = blocks[block].size;
+		offset += blocks[block].size;
+	}
+
+	FILE* file = compressed ? fopen(filename.c_str(), "wb") : nullptr;
+	bool written = file != nullptr && fwrite(&header_, sizeof(header_), 1, file) == 1 &&
+		fwrite(chunk_table.data(), sizeof(CompressedChunk), chunk_table.size(), file) == chunk_table.size();
+	for (size_t block = 0; written && block < blocks.size(); ++block)
+		written = fwrite(blocks[block].data, 1, blocks[block].size, file) == blocks[block].size;
+	if (file != nullptr)
+		written = fclose(file) == 0 && written;
+
+	for (CompressedBlock& block : blocks)
+		free(block.data);
+
+	return written;
+}
+
+// Read the whole file, it is small enough once compressed
+CompressedSnapshotFile::CompressedSnapshotFile(const std::string& filename) : valid_(false) {
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file == nullptr)
+		return;
+
+	char buffer[65536];
+	size_t read_size;
+	while ((read_size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data_.insert(data_.end(), buffer, buffer + read_size);
+	bool read_error = ferror(file) != 0;
+	fclose(file);
+	if (read_error || data_.size() < sizeof(CompressedSnapshotHeader))
+		return;
+
+	const CompressedSnapshotHeader& header = get_header();
+	if (memcmp(header.magic, COMPRESSED_SNAPSHOT_MAGIC, sizeof(COMPRESSED_SNAPSHOT_MAGIC)) != 0 ||
+		header.version != COMPRESSED_SNAPSHOT_VERSION || header.byte_order != SNAPSHOT_BYTE_ORDER ||
+		header.column_count != SNAPSHOT_COLUMN_COUNT || header.chunk_size == 0 ||
+		header.chunk_count != (header.particle_count + header.chunk_size - 1) / header.chunk_size ||
+		(header.order != SNAPSHOT_ORDER_ORIGINAL && header.order != SNAPSHOT_ORDER_MORTON))
+		return;
+
+	size_t stream_count = SNAPSHOT_COLUMN_COUNT + (header.order == SNAPSHOT_ORDER_MORTON ? 1 : 0);
+	size_t chunk_table_size = static_cast<size_t>(header.chunk_count) * stream_count;
+	if (data_.size() < sizeof(CompressedSnapshotHeader) + chunk_table_size * sizeof(CompressedChunk))
+		return;
+
+	const CompressedChunk* chunk_table = reinterpret_cast<const CompressedChunk*>(data_.data() + sizeof(CompressedSnapshotHeader));
+	for (size_t chunk = 0; chunk < chunk_table_size; ++chunk) {
+		if (chunk_table[chunk].offset > data_.size() || chunk_table[chunk].size > data_.size() - chunk_table[chunk].offset)
+			return;
+	}
+	for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+		if (header.columns[column].quantization_bits > 32)
+			return;
+	}
+	valid_ = true;
+}
+
+bool CompressedSnapshotFile::is_valid() const {
+	return valid_;
+}
+
+const CompressedSnapshotHeader& CompressedSnapshotFile::get_header() const {
+	return *reinterpret_cast<const CompressedSnapshotHeader*>(data_.data());
+}
+
+// Decompress the words of one stream of chunks, the columns and then the original indices. Quantized values and indices
+// are delta coded, exact floats are XOR-ed with their predecessor. False if a chunk is damaged
+bool CompressedSnapshotFile::read_words(size_t stream, bool xor_coded, std::vector<uint32_t>& words) const {
+	const CompressedSnapshotHeader& header = get_header();
+	const CompressedChunk* chunk_table = reinterpret_cast<const CompressedChunk*>(data_.data() + sizeof(CompressedSnapshotHeader)) +
+		stream * header.chunk_count;
+	size_t particle_count = static_cast<size_t>(header.particle_count);
+	words.resize(particle_count);
+
+	std::atomic<bool> damaged(false);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, header.chunk_count, 1),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t chunk = r.begin(); chunk != r.end(); ++chunk) {
+			size_t start = chunk * header.chunk_size;
+			size_t count = std::min(static_cast<size_t>(header.chunk_size), particle_count - start);
+
+			unsigned char* planes = nullptr;
+			size_t planes_size = 0;
+			unsigned error = lodepng_zlib_decompress(&planes, &planes_size,
+				reinterpret_cast<const unsigned char*>(data_.data() + chunk_table[chunk].offset), static_cast<size_t>(chunk_table[chunk].size),
+				&lodepng_default_decompress_settings);
+			if (error != 0 || planes_size != count * sizeof(uint32_t)) {
+				damaged = true;
+				free(planes);
+				continue;
+			}
+
+			uint32_t previous = 0;
+			for (size_t index = 0; index < count; ++index) {
+				uint32_t difference = 0;
+				for (size_t plane = 0; plane < sizeof(uint32_t); ++plane)
+					difference |= static_cast<uint32_t>(planes[plane * count + index]) << (8 * plane);
+
+				if (xor_coded)
+					previous ^= difference;
+				else
+					previous += static_cast<uint32_t>(zigzag_decode(difference));
+				words[start + index] = previous;
+			}
+			free(planes);
+		}
+	}); // Implicit barrier
+
+	return !damaged;
+}
+
+// Decompress one column, false if a chunk is damaged
+bool CompressedSnapshotFile::read_column(SnapshotColumn column, std::vector<float>& values) const {
+	if (!valid_)
+		return false;
+
+	const CompressedColumn& current_column = get_header().columns[column];
+	std::vector<uint32_t> words;
+	if (!read_words(column, current_column.quantization_bits == 0, words))
+		return false;
+
+	values.resize(words.size());
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, words.size()),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			if (current_column.quantization_bits == 0)
+				memcpy(&values[index], &words[index], sizeof(float));
+			else
+				values[index] = dequantize(words[index], current_column);
+		}
+	}); // Implicit barrier
+	return true;
+}
+
+// Index in the simulation of every particle of the snapshot, the identity for snapshots in the original order
+bool CompressedSnapshotFile::read_original_indices(std::vector<uint32_t>& indices) const {
+	if (!valid_)
+		return false;
+
+	if (get_header().order == SNAPSHOT_ORDER_MORTON)
+		return read_words(SNAPSHOT_COLUMN_COUNT, false, indices);
+
+	indices.resize(static_cast<size_t>(get_header().particle_count));
+	for (size_t index = 0; index < indices.size(); ++index)
+		indices[index] = static_cast<uint32_t>(index);
+	return true;
+}
+
+// Decompress every column into a particle collection, in the original order of the simulation
+bool CompressedSnapshotFile::to_particles(std::vector<Particle>& particles) const {
+	std::vector<float> columns[SNAPSHOT_COLUMN_COUNT];
+	for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+		if (!read_column(static_cast<SnapshotColumn>(column), columns[column]))
+			return false;
+	}
+	std::vector<uint32_t> original_indices;
+	if (!read_original_indices(original_indices))
+		return false;
+
+	// Every index must appear once, a damaged permutation would leave particles unset
+	size_t particle_count = static_cast<size_t>(get_header().particle_count);
+	std::vector<bool> placed(particle_count, false);
+	for (uint32_t original_index : original_indices) {
+		if (original_index >= particle_count || placed[original_index])
+			return false;
+		placed[original_index] = true;
+	}
+
+	particles.resize(particle_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			particles[original_indices[index]] = Particle(columns[SNAPSHOT_X][index], columns[SNAPSHOT_Y][index],
+				columns[SNAPSHOT_VELOCITY_X][index], columns[SNAPSHOT_VELOCITY_Y][index], columns[SNAPSHOT_MASS][index], 0.0f, 0.0f);
+		}
+	}); // Implicit barrier
+	return true;
+}
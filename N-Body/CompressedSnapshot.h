@@ -0,0 +1,104 @@
+#pragma once
+#include "Particle.h"
+#include "Snapshot.h"
+#include "Settings.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <tbb/parallel_for.h>
+
+static const uint32_t COMPRESSED_SNAPSHOT_VERSION = 2;
+
+enum SnapshotOrder { SNAPSHOT_ORDER_ORIGINAL, SNAPSHOT_ORDER_MORTON };
+
+// Storage of one column. Quantized values are integers spread evenly over [minimum, maximum]
+struct CompressedColumn {
+	uint32_t quantization_bits; // 0 for full floats
+	float minimum;
+	float maximum;
+	uint32_t reserved;
+};
+
+// Header at the start of a compressed snapshot, followed by the chunk table and the compressed chunks. Morton ordered
+// snapshots have one more stream of chunks after the columns, the original index of every particle
+struct CompressedSnapshotHeader {
+	char magic[8]; // "NBODYCSN"
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t particle_count;
+	uint64_t seed; // Seed of the initial conditions
+	double time; // Simulation time of the snapshot
+	float time_step;
+	uint32_t universe_size_x;
+	uint32_t universe_size_y;
+	uint32_t column_count;
+	uint32_t chunk_size; // Particles per chunk, the last chunk may be shorter
+	uint32_t chunk_count; // Chunks per column
+	uint32_t order; // SnapshotOrder of the particles, SNAPSHOT_ORDER_MORTON adds the stream of the original indices
+	uint32_t reserved;
+	CompressedColumn columns[SNAPSHOT_COLUMN_COUNT];
+};
+
+// Location of one zlib compressed chunk, the table holds the chunks of the first column, then the second... and the ones
+// of the original indices last
+struct CompressedChunk {
+	uint64_t offset; // From the start of the file
+	uint64_t size;
+};
+
+// Writes snapshots column by column. Columns are optionally quantized, delta coded within each chunk, split into
+// byte planes and deflated, the chunks are compressed in parallel. Quantized columns must be finite
+class CompressedSnapshotWriter {
+	CompressedSnapshotHeader header_;
+	std::vector<float> columns_[SNAPSHOT_COLUMN_COUNT];
+	std::vector<float> reordered_column_;
+	std::vector<uint64_t> morton_order_; // Morton key in the high bits, particle index in the low bits
+	std::vector<uint32_t> original_indices_; // Index of every particle of a Morton ordered snapshot in the simulation
+
+	bool set_column_ranges(); // False when a quantized column holds a value that is not finite
+	void sort_morton();
+	bool write(const std::string& filename);
+public:
+	CompressedSnapshotWriter(uint64_t seed, float time_step, size_t universe_size_x, size_t universe_size_y);
+
+	// Copy the particle state and save it, any indexable particle container can be saved. Nothing is written when a
+	// position or a velocity is not finite
+	template <typename Container>
+	bool save(const std::string& filename, const Container& particles, size_t particle_count, double time) {
+		header_.particle_count = particle_count;
+		header_.time = time;
+		for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column)
+			columns_[column].resize(particle_count);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+				const Particle& current_particle = particles[index];
+				columns_[SNAPSHOT_X][index] = current_particle.x_;
+				columns_[SNAPSHOT_Y][index] = current_particle.y_;
+				columns_[SNAPSHOT_VELOCITY_X][index] = current_particle.velocity_x_;
+				columns_[SNAPSHOT_VELOCITY_Y][index] = current_particle.velocity_y_;
+				columns_[SNAPSHOT_MASS][index] = current_particle.mass_;
+			}
+		}); // Implicit barrier
+
+		return write(filename);
+	}
+};
+
+// Reads a compressed snapshot, the chunks are decompressed in parallel
+class CompressedSnapshotFile {
+	std::vector<char> data_;
+	bool valid_;
+
+	bool read_words(size_t stream, bool xor_coded, std::vector<uint32_t>& words) const; // Decoded words of a column or index stream
+public:
+	CompressedSnapshotFile(const std::string& filename);
+
+	bool is_valid() const; // The file was read and its chunk table is consistent
+	const CompressedSnapshotHeader& get_header() const;
+	bool read_column(SnapshotColumn column, std::vector<float>& values) const; // In the order of the snapshot
+	bool read_original_indices(std::vector<uint32_t>& indices) const; // Index in the simulation of every particle of the snapshot
+	bool to_particles(std::vector<Particle>& particles) const; // In the original order of the simulation
+};
@@ -0,0 +1,85 @@
+#include "Fft.h"
+#include "Settings.h"
+#include <cmath>
+#include <utility>
+#include <tbb/parallel_for.h>
+
+Fft::Fft(size_t size) : size_(size), twiddles_(size / 2), bit_reversal_(size) {
+	const double pi = 3.14159265358979323846;
+	for (size_t k = 0; k < size / 2; ++k)
+		twiddles_[k] = std::polar(1.0, -2.0 * pi * static_cast<double>(k) / static_cast<double>(size));
+
+	size_t bit_count = 0;
+	while ((static_cast<size_t>(1) << bit_count) < size)
+		++bit_count;
+	for (size_t index = 0; index < size; ++index) {
+		size_t reversed = 0;
+		for (size_t bit = 0; bit < bit_count; ++bit)
+			reversed |= ((index >> bit) & 1) << (bit_count - 1 - bit);
+		bit_reversal_[index] = reversed;
+	}
+}
+
+size_t Fft::get_size() const {
+	return size_;
+}
+
+// Iterative Cooley-Tukey transform of one contiguous line
+void Fft::transform_line(std::complex<double>* line, bool inverse) const {
+	for (size_t index = 0; index < size_; ++index) {
+		if (index < bit_reversal_[index])
+			std::swap(line[index], line[bit_reversal_[index]]);
+	}
+
+	for (size_t length = 2; length <= size_; length <<= 1) {
+		size_t half = length / 2;
+		size_t twiddle_step = size_ / length;
+		for (size_t start = 0; start < size_; start += length) {
+			for (size_t k = 0; k < half; ++k) {
+				std::complex<double> twiddle = twiddles_[k * twiddle_step];
+				if (inverse)
+					twiddle = std::conj(twiddle);
+				std::complex<double> odd = multiply_complex(line[start + k + half], twiddle);
+				line[start + k + half] = line[start + k] - odd;
+				line[start + k] += odd;
+			}
+		}
+	}
+}
+
+void Fft::transform_grid(std::vector<std::complex<double>>& grid, bool inverse, size_t row_count) const {
+	auto transform_rows = [&]() {
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, row_count),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t row = r.begin(); row != r.end(); ++row)
+				transform_line(&grid[row * size_], inverse);
+		}); // Implicit barrier
+	};
+
+	// The columns are gathered into a contiguous line, transformed and scattered back
+	auto transform_columns = [&]() {
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, size_, FFT_COLUMN_GRAIN),
+			[&](const tbb::blocked_range<size_t>& r) {
+			std::vector<std::complex<double>> line(size_); // Thread local variable
+			for (size_t column = r.begin(); column != r.end(); ++column) {
+				for (size_t row = 0; row < size_; ++row)
+					line[row] = grid[row * size_ + column];
+				transform_line(line.data(), inverse);
+				for (size_t row = 0; row < size_; ++row)
+					grid[row * size_ + column] = line[row];
+			}
+		}); // Implicit barrier
+	};
+
+	if (inverse) {
+		transform_columns();
+		transform_rows();
+	} else {
+		transform_rows();
+		transform_columns();
+	}
+}
+
+void Fft::transform_grid(std::vector<std::complex<double>>& grid, bool inverse) const {
+	transform_grid(grid, inverse, size_);
+}
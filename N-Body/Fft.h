@@ -0,0 +1,28 @@
+#pragma once
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+// Complex product without the infinity and NaN recovery of std::complex, which is not inlined by every compiler
+inline std::complex<double> multiply_complex(const std::complex<double>& a, const std::complex<double>& b) {
+	return std::complex<double>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+// Radix-2 complex fast Fourier transform of square grids, the rows and the columns are transformed in parallel.
+// The transforms are not normalized, a forward and an inverse transform scale the grid by the cell count
+class Fft {
+	size_t size_; // Cells per side, a power of two
+	std::vector<std::complex<double>> twiddles_; // exp(-2 pi i k / size) for the first half of the circle
+	std::vector<size_t> bit_reversal_;
+
+	void transform_line(std::complex<double>* line, bool inverse) const;
+public:
+	explicit Fft(size_t size);
+
+	size_t get_size() const;
+
+	// Transform a size x size grid in place. Only the first row_count rows are transformed along the rows, the others
+	// must be zero on a forward transform and are not needed after an inverse transform
+	void transform_grid(std::vector<std::complex<double>>& grid, bool inverse, size_t row_count) const;
+	void transform_grid(std::vector<std::complex<double>>& grid, bool inverse) const;
+};
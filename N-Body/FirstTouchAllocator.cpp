@@ -0,0 +1,43 @@
+#include "FirstTouchAllocator.h"
+#include "Settings.h"
+#include <cstdlib>
+#include <cstring>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+void* allocate_first_touch(size_t element_count, size_t element_size) {
+	size_t size = element_count * element_size;
+	if (size == 0)
+		size = 1;
+
+	// Page aligned, so that no page is shared by the partitions of two threads more than necessary
+	void* pointer;
+#ifdef _WIN32
+	pointer = _aligned_malloc(size, FIRST_TOUCH_ALIGNMENT);
+#else
+	if (posix_memalign(&pointer, FIRST_TOUCH_ALIGNMENT, size) != 0)
+		pointer = nullptr;
+#endif
+	if (pointer == nullptr)
+		return nullptr;
+
+	// Write every element range from the thread that owns it in the particle loops
+	char* bytes = static_cast<char*>(pointer);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, element_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		memset(bytes + r.begin() * element_size, 0, r.size() * element_size);
+	}, tbb::static_partitioner()); // Implicit barrier
+
+	return pointer;
+}
+
+void free_first_touch(void* pointer) {
+#ifdef _WIN32
+	_aligned_free(pointer);
+#else
+	free(pointer);
+#endif
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "Particle.h"
+#include "TreeParticle.h"
+#include <cstddef>
+#include <new>
+#include <vector>
+
+void* allocate_first_touch(size_t element_count, size_t element_size); // nullptr when out of memory
+void free_first_touch(void* pointer);
+
+// Allocator of aligned memory whose pages are first written by the threads that will compute on them. The memory is
+// touched in parallel with a static partitioning of the element range, the same partitioning as the loops over the
+// particles, so on NUMA machines every page is placed on the node of the thread that uses it
+template <typename T>
+class FirstTouchAllocator {
+public:
+	typedef T value_type;
+
+	FirstTouchAllocator() { }
+
+	template <typename U>
+	FirstTouchAllocator(const FirstTouchAllocator<U>&) { }
+
+	T* allocate(size_t count) {
+		void* pointer = allocate_first_touch(count, sizeof(T));
+		if (pointer == nullptr)
+			throw std::bad_alloc(); // Required by the allocator interface
+		return static_cast<T*>(pointer);
+	}
+
+	void deallocate(T* pointer, size_t) {
+		free_first_touch(pointer);
+	}
+
+	template <typename U>
+	bool operator==(const FirstTouchAllocator<U>&) const {
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const FirstTouchAllocator<U>&) const {
+		return false;
+	}
+};
+
+typedef std::vector<Particle, FirstTouchAllocator<Particle>> ParticleVector;
+typedef std::vector<TreeParticle, FirstTouchAllocator<TreeParticle>> TreeParticleVector;
@@ -0,0 +1,99 @@
+#pragma once
+#include "Particle.h"
+#include <cmath>
+#include <cstdint>
+
+static const uint8_t FIXED_POINT_BITS = 32; // Bits per axis, the deepest split of a fixed point tree reads the last one
+
+// Position of a particle in fixed point, 32 bits per axis spread evenly over the universe box. Differences of coordinates
+// are exact, and the quadrant of a tree node at depth k is read from bit 31 - k of both axes
+struct FixedPosition {
+	uint32_t x_;
+	uint32_t y_;
+
+	// Spread the 32 bits of a coordinate to the even bits of a 64 bit number
+	static uint64_t spread_bits(uint32_t value) {
+		uint64_t bits = value;
+		bits = (bits | (bits << 16)) & 0x0000ffff0000ffffULL;
+		bits = (bits | (bits << 8)) & 0x00ff00ff00ff00ffULL;
+		bits = (bits | (bits << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		bits = (bits | (bits << 2)) & 0x3333333333333333ULL;
+		bits = (bits | (bits << 1)) & 0x5555555555555555ULL;
+		return bits;
+	}
+
+	// Morton key, the bits of both axes interleaved from the most significant one down so that the keys sort along the
+	// Z curve. x is the high bit of every pair, as in the quadrant numbering of QuadParticleTree
+	uint64_t get_morton_key() const {
+		return (spread_bits(x_) << 1) | spread_bits(y_);
+	}
+};
+
+// Conversions between the float positions of the kernels and the fixed point positions of a universe box, and the
+// integrator of the fixed point positions
+class FixedPointBox {
+	double scale_x_, scale_y_; // Fixed point steps per universe unit
+	double step_x_, step_y_; // Universe units per fixed point step
+
+	// Nearest fixed point coordinate, the walls of the universe are the first and the last coordinates
+	static uint32_t to_fixed(float position, double scale) {
+		double coordinate = std::floor(static_cast<double>(position) * scale + 0.5);
+		if (coordinate < 0.0)
+			return 0;
+		if (coordinate > static_cast<double>(MAX_COORDINATE))
+			return MAX_COORDINATE;
+		return static_cast<uint32_t>(coordinate);
+	}
+
+	// Moves one coordinate by whole fixed point steps, it bounces off the walls of the universe
+	static void advance(uint32_t& coordinate, float& velocity, float acceleration, float time_step, double scale) {
+		velocity += time_step * acceleration;
+		int64_t new_coordinate = static_cast<int64_t>(coordinate) +
+			static_cast<int64_t>(std::floor(static_cast<double>(velocity * time_step) * scale + 0.5));
+		if (new_coordinate < 0) {
+			velocity *= -1;
+			new_coordinate = 0;
+		} else if (new_coordinate > static_cast<int64_t>(MAX_COORDINATE)) {
+			velocity *= -1;
+			new_coordinate = MAX_COORDINATE;
+		}
+		coordinate = static_cast<uint32_t>(new_coordinate);
+	}
+public:
+	static const uint32_t MAX_COORDINATE = UINT32_MAX;
+
+	FixedPointBox(float size_x, float size_y) : scale_x_(4294967296.0 / size_x), scale_y_(4294967296.0 / size_y),
+		step_x_(size_x / 4294967296.0), step_y_(size_y / 4294967296.0) {
+	}
+
+	FixedPosition to_fixed(const Particle& particle) const {
+		FixedPosition position;
+		position.x_ = to_fixed(particle.x_, scale_x_);
+		position.y_ = to_fixed(particle.y_, scale_y_);
+		return position;
+	}
+
+	// The float position of the particle follows the fixed point one
+	void to_float(const FixedPosition& position, Particle& particle) const {
+		particle.x_ = static_cast<float>(position.x_ * step_x_);
+		particle.y_ = static_cast<float>(position.y_ * step_y_);
+	}
+
+	// Exact difference of two positions, rounded once to the precision of the kernel
+	template <typename Scalar>
+	void get_displacement(const FixedPosition& from, const FixedPosition& to, Scalar (&displacement)[2]) const {
+		displacement[0] = static_cast<Scalar>(static_cast<double>(static_cast<int64_t>(to.x_) - from.x_) * step_x_);
+		displacement[1] = static_cast<Scalar>(static_cast<double>(static_cast<int64_t>(to.y_) - from.y_) * step_y_);
+	}
+
+	// Moves the particle for a specific time in whole fixed point steps, as Particle::advance does with floats
+	void advance(Particle& particle, FixedPosition& position, float time_step) const {
+		advance(position.x_, particle.velocity_x_, particle.acceleration_x_, time_step, scale_x_);
+		advance(position.y_, particle.velocity_y_, particle.acceleration_y_, time_step, scale_y_);
+		to_float(position, particle);
+
+		// Reset accelerations
+		particle.acceleration_x_ = 0.0;
+		particle.acceleration_y_ = 0.0;
+	}
+};
@@ -0,0 +1,45 @@
+#include "ForceSplit.h"
+#include <algorithm>
+#include <cmath>
+
+static const double PI = 3.14159265358979323846;
+
+double get_gaussian_long_range_potential(double distance, double split_scale) {
+	if (distance < 1e-6 * split_scale)
+		return -1.0 / (sqrt(PI) * split_scale);
+	return -erf(distance / (2.0 * split_scale)) / distance;
+}
+
+ForceSplit::ForceSplit(float split_scale, float cutoff) : split_scale_(split_scale), cutoff_(cutoff), cutoff_square_(cutoff * cutoff),
+	table_step_(cutoff * cutoff / TREE_PM_TABLE_SIZE), short_range_factors_(TREE_PM_TABLE_SIZE + 1) {
+
+	// The softened direct force minus the long range force, both over the distance so that the factor multiplies dx and dy
+	for (size_t entry = 0; entry <= TREE_PM_TABLE_SIZE; ++entry) {
+		double distance_square = static_cast<double>(entry) * table_step_;
+		double distance = sqrt(distance_square);
+		double softened_square = std::max(distance_square, static_cast<double>(MIN_DISTANCE));
+		double direct_factor = 1.0 / (softened_square * sqrt(softened_square));
+
+		double long_range_factor;
+		double x = distance / (2.0 * split_scale_);
+		if (x < 1e-3) // Limit of the expression below, which cancels catastrophically
+			long_range_factor = 1.0 / (6.0 * sqrt(PI) * split_scale_ * split_scale_ * split_scale_);
+		else
+			long_range_factor = (erf(x) - 2.0 * x / sqrt(PI) * exp(-x * x)) / (distance_square * distance);
+
+		short_range_factors_[entry] = static_cast<float>(direct_factor - long_range_factor);
+	}
+	short_range_factors_[TREE_PM_TABLE_SIZE] = 0.0f; // The short range force fades out over the last entry instead of jumping to zero
+}
+
+float ForceSplit::get_split_scale() const {
+	return split_scale_;
+}
+
+float ForceSplit::get_cutoff() const {
+	return cutoff_;
+}
+
+double ForceSplit::get_long_range_potential(double distance) const {
+	return get_gaussian_long_range_potential(distance, split_scale_);
+}
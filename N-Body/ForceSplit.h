@@ -0,0 +1,38 @@
+#pragma once
+#include "Particle.h"
+#include "Settings.h"
+#include <vector>
+
+double get_gaussian_long_range_potential(double distance, double split_scale); // -erf(r / 2 rs) / r, finite at zero distance
+
+// Gaussian split of the softened 1/r^2 force. The long range part is smooth on the split scale and is left to the mesh,
+// the short range part falls off with erfc and is cut off a few split scales away, where the tree walk stops
+class ForceSplit {
+	float split_scale_;
+	float cutoff_;
+	float cutoff_square_;
+	float table_step_; // Squared distance between two table entries
+	std::vector<float> short_range_factors_; // Short range acceleration over G m dr, by squared distance
+public:
+	ForceSplit(float split_scale, float cutoff);
+
+	float get_split_scale() const;
+	float get_cutoff() const;
+	double get_long_range_potential(double distance) const; // Per unit G m, finite at zero distance
+
+	// Short range pull of a mass at (x, y), nothing beyond the cutoff
+	void add_short_range_acceleration(Particle& particle, float x, float y, float mass) const {
+		float dx = x - particle.x_;
+		float dy = y - particle.y_;
+		float distance_square = dx * dx + dy * dy;
+		if (distance_square >= cutoff_square_)
+			return;
+
+		float position = distance_square / table_step_;
+		size_t entry = static_cast<size_t>(position);
+		float fraction = position - static_cast<float>(entry);
+		float factor = short_range_factors_[entry] + fraction * (short_range_factors_[entry + 1] - short_range_factors_[entry]);
+		particle.acceleration_x_ += GRAVITATIONAL_CONSTANT * mass * factor * dx;
+		particle.acceleration_y_ += GRAVITATIONAL_CONSTANT * mass * factor * dy;
+	}
+};
@@ -0,0 +1,182 @@
+#include "FrameSink.h"
+#include "ParticleHandler.h"
+#include <cstring>
+
+static const char FRAME_STREAM_MAGIC[8] = { 'N', 'B', 'O', 'D', 'Y', 'F', 'R', 'M' };
+static const size_t MIN_ZERO_RUN = 3; // Shorter runs of unchanged pixels stay in the literals
+
+// Append an unsigned number in 7 bit groups, lowest group first
+static void append_varint(std::vector<uint8_t>& buffer, size_t value) {
+	while (value >= 0x80) {
+		buffer.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back(static_cast<uint8_t>(value));
+}
+
+static bool read_varint(const std::vector<uint8_t>& buffer, size_t& position, size_t& value) {
+	value = 0;
+	for (int shift = 0; position < buffer.size() && shift < 64; shift += 7) {
+		uint8_t byte = buffer[position++];
+		value |= static_cast<size_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+FrameSink::FrameSink(const std::string& filename, FrameStreamEncoding encoding, size_t width, size_t height, uint64_t seed) :
+	encoding_(encoding), width_(static_cast<uint32_t>(width)), height_(static_cast<uint32_t>(height)), frame_count_(0) {
+	file_ = fopen(filename.c_str(), "wb"); // Also opens named pipes, the reader must already be waiting on them
+	if (file_ == nullptr || encoding_ == FRAME_STREAM_PIPE_RGB)
+		return; // Bare frames, the video encoder is told the size and format
+
+	FrameStreamHeader header;
+	memcpy(header.magic, FRAME_STREAM_MAGIC, sizeof(FRAME_STREAM_MAGIC));
+	header.version = FRAME_STREAM_VERSION;
+	header.width = width_;
+	header.height = height_;
+	header.keyframe_interval = encoding_ == FRAME_STREAM_DELTA ? FRAME_STREAM_KEYFRAME_EVERY : 1;
+	header.seed = seed;
+	if (fwrite(&header, sizeof(header), 1, file_) != 1) {
+		fclose(file_);
+		file_ = nullptr;
+	}
+}
+
+FrameSink::~FrameSink() {
+	if (file_ != nullptr)
+		fclose(file_);
+}
+
+bool FrameSink::is_open() const {
+	return file_ != nullptr;
+}
+
+// Append one frame of density levels
+bool FrameSink::write_frame(const std::vector<uint8_t>& levels, double time) {
+	if (file_ == nullptr || levels.size() != static_cast<size_t>(width_) * height_)
+		return false;
+
+	bool written;
+	if (encoding_ == FRAME_STREAM_PIPE_RGB) {
+		const uint8_t* palette = ParticleHandler::get_density_palette();
+		payload_.resize(levels.size() * 3);
+		for (size_t pixel = 0; pixel < levels.size(); ++pixel) {
+			for (int channel = 0; channel < 3; ++channel)
+				payload_[3 * pixel + channel] = palette[4 * levels[pixel] + channel];
+		}
+		written = fwrite(payload_.data(), 1, payload_.size(), file_) == payload_.size();
+	} else {
+		FrameHeader header;
+		header.time = time;
+
+		bool key_frame = encoding_ == FRAME_STREAM_RAW || frame_count_ % FRAME_STREAM_KEYFRAME_EVERY == 0;
+		const std::vector<uint8_t>* payload = &levels;
+		if (key_frame) {
+			header.type = FRAME_KEY;
+		} else {
+			// Runs of unchanged pixels followed by the changed bytes, xor-ed with the previous frame
+			header.type = FRAME_DELTA;
+			payload_.clear();
+			size_t pixel = 0;
+			while (pixel < levels.size()) {
+				size_t zero_run = 0;
+				while (pixel + zero_run < levels.size() && levels[pixel + zero_run] == previous_levels_[pixel + zero_run])
+					++zero_run;
+
+				size_t literal_start = pixel + zero_run;
+				size_t literal_end = literal_start;
+				size_t unchanged = 0;
+				while (literal_end < levels.size() && unchanged < MIN_ZERO_RUN) {
+					unchanged = levels[literal_end] == previous_levels_[literal_end] ? unchanged + 1 : 0;
+					++literal_end;
+				}
+				if (unchanged == MIN_ZERO_RUN)
+					literal_end -= unchanged; // Leave the unchanged pixels to the next run
+
+				append_varint(payload_, zero_run);
+				append_varint(payload_, literal_end - literal_start);
+				for (size_t index = literal_start; index < literal_end; ++index)
+					payload_.push_back(levels[index] ^ previous_levels_[index]);
+				pixel = literal_end;
+			}
+			payload = &payload_;
+		}
+
+		header.payload_size = static_cast<uint32_t>(payload->size());
+		written = fwrite(&header, sizeof(header), 1, file_) == 1 &&
+			fwrite(payload->data(), 1, payload->size(), file_) == payload->size();
+		previous_levels_ = levels;
+	}
+
+	++frame_count_;
+	return fflush(file_) == 0 && written; // Readers on a pipe get whole frames
+}
+
+FrameStreamReader::FrameStreamReader(const std::string& filename) : has_previous_frame_(false) {
+	file_ = fopen(filename.c_str(), "rb");
+	if (file_ != nullptr && (fread(&header_, sizeof(header_), 1, file_) != 1 ||
+		memcmp(header_.magic, FRAME_STREAM_MAGIC, sizeof(FRAME_STREAM_MAGIC)) != 0 || header_.version != FRAME_STREAM_VERSION)) {
+		fclose(file_);
+		file_ = nullptr;
+	}
+}
+
+FrameStreamReader::~FrameStreamReader() {
+	if (file_ != nullptr)
+		fclose(file_);
+}
+
+bool FrameStreamReader::is_valid() const {
+	return file_ != nullptr;
+}
+
+uint32_t FrameStreamReader::get_width() const {
+	return header_.width;
+}
+
+uint32_t FrameStreamReader::get_height() const {
+	return header_.height;
+}
+
+uint64_t FrameStreamReader::get_seed() const {
+	return header_.seed;
+}
+
+// Read the next frame, false at the end of the stream or on a damaged frame
+bool FrameStreamReader::read_frame(std::vector<uint8_t>& levels, double& time) {
+	FrameHeader header;
+	if (file_ == nullptr || fread(&header, sizeof(header), 1, file_) != 1)
+		return false;
+
+	payload_.resize(header.payload_size);
+	if (fread(payload_.data(), 1, payload_.size(), file_) != payload_.size())
+		return false;
+	time = header.time;
+
+	size_t pixel_count = static_cast<size_t>(header_.width) * header_.height;
+	if (header.type == FRAME_KEY) {
+		if (payload_.size() != pixel_count)
+			return false;
+		levels = payload_;
+	} else {
+		if (!has_previous_frame_ || levels.size() != pixel_count)
+			return false;
+
+		size_t position = 0, pixel = 0;
+		while (position < payload_.size()) {
+			size_t zero_run, literal_count;
+			if (!read_varint(payload_, position, zero_run) || !read_varint(payload_, position, literal_count) ||
+				pixel + zero_run + literal_count > pixel_count || position + literal_count > payload_.size())
+				return false;
+
+			pixel += zero_run;
+			for (size_t index = 0; index < literal_count; ++index)
+				levels[pixel++] ^= payload_[position++];
+		}
+	}
+
+	has_previous_frame_ = true;
+	return true;
+}
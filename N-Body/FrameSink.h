@@ -0,0 +1,67 @@
+#pragma once
+#include "Settings.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static const uint32_t FRAME_STREAM_VERSION = 2;
+
+// Header at the start of a frame stream
+struct FrameStreamHeader {
+	char magic[8]; // "NBODYFRM"
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t keyframe_interval;
+	uint64_t seed; // Seed of the initial conditions
+};
+
+// Header before every frame of a frame stream
+struct FrameHeader {
+	uint32_t type; // FRAME_KEY or FRAME_DELTA
+	uint32_t payload_size;
+	double time;
+};
+
+enum FrameType { FRAME_KEY, FRAME_DELTA };
+
+// Append-only sink of rasterized frames, one density level per pixel. Frames are stored raw or as the run length encoded
+// difference to the previous frame, compression to images happens offline. The pipe encoding writes bare RGB frames for
+// an external video encoder reading from a named pipe
+class FrameSink {
+	FILE* file_;
+	FrameStreamEncoding encoding_;
+	uint32_t width_;
+	uint32_t height_;
+	uint64_t frame_count_;
+	std::vector<uint8_t> previous_levels_;
+	std::vector<uint8_t> payload_;
+public:
+	FrameSink(const std::string& filename, FrameStreamEncoding encoding, size_t width, size_t height, uint64_t seed);
+	~FrameSink();
+	FrameSink(const FrameSink&) = delete;
+	FrameSink& operator=(const FrameSink&) = delete;
+
+	bool is_open() const;
+	bool write_frame(const std::vector<uint8_t>& levels, double time);
+};
+
+// Reads back the frames of a stream written by FrameSink
+class FrameStreamReader {
+	FILE* file_;
+	FrameStreamHeader header_;
+	std::vector<uint8_t> payload_;
+	bool has_previous_frame_;
+public:
+	FrameStreamReader(const std::string& filename);
+	~FrameStreamReader();
+	FrameStreamReader(const FrameStreamReader&) = delete;
+	FrameStreamReader& operator=(const FrameStreamReader&) = delete;
+
+	bool is_valid() const;
+	uint32_t get_width() const;
+	uint32_t get_height() const;
+	uint64_t get_seed() const;
+	bool read_frame(std::vector<uint8_t>& levels, double& time); // Levels must hold the previous frame of the stream
+};
@@ -0,0 +1,157 @@
+#include "HaloFinder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/partitioner.h>
+
+HaloFinder::HaloFinder(const PeriodicBox* periodic_box) : periodic_box_(periodic_box), spatial_hash_(periodic_box), parent_capacity_(0) {
+}
+
+// Root of the tree of a particle, halving the path on the way. The parents only ever move up, so relaxed loads of a link
+// that is being changed still lead to the root
+uint32_t HaloFinder::find_root(uint32_t particle_index) {
+	uint32_t parent = parents_[particle_index].load(std::memory_order_relaxed);
+	while (parent != particle_index) {
+		uint32_t grandparent = parents_[parent].load(std::memory_order_relaxed);
+		if (grandparent != parent) // A failed exchange means that another thread already moved the link up
+			parents_[particle_index].compare_exchange_weak(parent, grandparent, std::memory_order_relaxed);
+		particle_index = grandparent;
+		parent = parents_[particle_index].load(std::memory_order_relaxed);
+	}
+	return particle_index;
+}
+
+// Link the higher root below the lower one, again when another thread has linked it first
+void HaloFinder::unite(uint32_t first_particle, uint32_t second_particle) {
+	while (true) {
+		uint32_t first_root = find_root(first_particle);
+		uint32_t second_root = find_root(second_particle);
+		if (first_root == second_root)
+			return;
+		if (first_root > second_root)
+			std::swap(first_root, second_root);
+		uint32_t expected = second_root;
+		if (parents_[second_root].compare_exchange_strong(expected, first_root, std::memory_order_relaxed))
+			return;
+	}
+}
+
+// Every pair of friends is joined once, from its higher particle
+void HaloFinder::link_friends(const Particle* particles, size_t particle_count, float linking_length) {
+	if (particle_count > parent_capacity_) {
+		parent_capacity_ = particle_count;
+		parents_.reset(new std::atomic<uint32_t>[parent_capacity_]);
+	}
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) // Using index range
+			parents_[index].store(static_cast<uint32_t>(index), std::memory_order_relaxed);
+	}, tbb::static_partitioner()); // Implicit barrier
+
+	spatial_hash_.build(particles, particle_count, linking_length);
+	float linking_length_square = linking_length * linking_length;
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			const Particle& particle = particles[index];
+			spatial_hash_.for_each_neighbour(particle, [&](uint32_t other) {
+				if (other >= index)
+					return;
+				float dx, dy;
+				spatial_hash_.get_displacement(particle, particles[other], dx, dy);
+				if (dx * dx + dy * dy <= linking_length_square)
+					unite(static_cast<uint32_t>(index), other);
+			});
+		}
+	}); // Implicit barrier, the neighbourhoods differ in size so the range is balanced dynamically
+}
+
+// Sort the particles by label so that every group is contiguous and in particle order, then sum the large groups in
+// parallel. Periodic groups are summed around their first particle, they must be smaller than half the universe
+void HaloFinder::build_catalog(const Particle* particles, size_t particle_count, uint32_t min_group_size) {
+	group_order_.resize(particle_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) // Using index range
+			group_order_[index] = std::make_pair(find_root(static_cast<uint32_t>(index)), static_cast<uint32_t>(index));
+	}, tbb::static_partitioner()); // Implicit barrier
+	tbb::parallel_sort(group_order_.begin(), group_order_.end());
+
+	// The groups start where the label changes
+	groups_.clear();
+	group_starts_.clear();
+	for (size_t slot = 0; slot < particle_count;) {
+		size_t end = slot + 1;
+		while (end < particle_count && group_order_[end].first == group_order_[slot].first)
+			++end;
+		if (end - slot >= min_group_size) {
+			HaloGroup group = HaloGroup();
+			group.first_particle = group_order_[slot].first;
+			group.particle_count = static_cast<uint32_t>(end - slot);
+			groups_.push_back(group);
+			group_starts_.push_back(static_cast<uint32_t>(slot));
+		}
+		slot = end;
+	}
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, groups_.size()),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t group_index = r.begin(); group_index != r.end(); ++group_index) {
+			HaloGroup& group = groups_[group_index];
+			const Particle& first_particle = particles[group.first_particle];
+			double mass = 0.0, offset_x = 0.0, offset_y = 0.0, momentum_x = 0.0, momentum_y = 0.0;
+			size_t end = group_starts_[group_index] + group.particle_count;
+			for (size_t slot = group_starts_[group_index]; slot != end; ++slot) {
+				const Particle& particle = particles[group_order_[slot].second];
+				float dx, dy;
+				spatial_hash_.get_displacement(first_particle, particle, dx, dy);
+				mass += particle.mass_;
+				offset_x += static_cast<double>(particle.mass_) * dx;
+				offset_y += static_cast<double>(particle.mass_) * dy;
+				momentum_x += static_cast<double>(particle.mass_) * particle.velocity_x_;
+				momentum_y += static_cast<double>(particle.mass_) * particle.velocity_y_;
+			}
+			group.mass = mass;
+			double inverse_mass = mass > 0.0 ? 1.0 / mass : 0.0;
+			group.center_x = first_particle.x_ + offset_x * inverse_mass;
+			group.center_y = first_particle.y_ + offset_y * inverse_mass;
+			group.velocity_x = momentum_x * inverse_mass;
+			group.velocity_y = momentum_y * inverse_mass;
+			if (periodic_box_ != nullptr) { // The center of mass may be across a wall
+				double size_x = periodic_box_->get_size_x();
+				double size_y = periodic_box_->get_size_y();
+				group.center_x -= size_x * std::floor(group.center_x / size_x);
+				group.center_y -= size_y * std::floor(group.center_y / size_y);
+			}
+		}
+	}); // Implicit barrier
+}
+
+const std::vector<HaloGroup>& HaloFinder::find_groups(const Particle* particles, size_t particle_count, float linking_length,
+	uint32_t min_group_size) {
+	link_friends(particles, particle_count, linking_length);
+	build_catalog(particles, particle_count, std::max<uint32_t>(min_group_size, 1));
+	return groups_;
+}
+
+const std::vector<HaloGroup>& HaloFinder::get_groups() const {
+	return groups_;
+}
+
+bool HaloFinder::save_catalog(const std::string& filename, double time, uint64_t seed) const {
+	FILE* file = fopen(filename.c_str(), "w");
+	if (file == nullptr)
+		return false;
+	bool written = fprintf(file, "# time %.9g, seed %llu, groups %zu\n"
+		"# first_particle particle_count mass center_x center_y velocity_x velocity_y\n", time, static_cast<unsigned long long>(seed),
+		groups_.size()) > 0;
+	for (size_t group_index = 0; written && group_index < groups_.size(); ++group_index) {
+		const HaloGroup& group = groups_[group_index];
+		written = fprintf(file, "%u %u %.9g %.9g %.9g %.9g %.9g\n", group.first_particle, group.particle_count, group.mass, group.center_x,
+			group.center_y, group.velocity_x, group.velocity_y) > 0;
+	}
+	return fclose(file) == 0 && written;
+}
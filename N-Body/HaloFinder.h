@@ -0,0 +1,49 @@
+#pragma once
+#include "Particle.h"
+#include "PeriodicBox.h"
+#include "SpatialHash.h"
+#include "Settings.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One friends-of-friends group of a catalog
+struct HaloGroup {
+	uint32_t first_particle; // Lowest particle index of the group, its label
+	uint32_t particle_count;
+	double mass;
+	double center_x, center_y; // Center of mass
+	double velocity_x, velocity_y; // Velocity of the center of mass
+};
+
+// Friends-of-friends groups (Davis et al. 1985). Particles closer than the linking length are friends and the groups are
+// the connected components of the friendships. The friends are found in a SpatialHash of cells as wide as the linking
+// length and joined with a lock-free union-find, in parallel. A root is always linked below the lower root, so every group
+// is labelled by its lowest particle whatever the threads, and the catalog sums every group in particle order
+class HaloFinder {
+	const PeriodicBox* periodic_box_;
+	SpatialHash spatial_hash_;
+	std::unique_ptr<std::atomic<uint32_t>[]> parents_; // Union-find forest, every parent is below its child
+	size_t parent_capacity_;
+	std::vector<std::pair<uint32_t, uint32_t>> group_order_; // Label and particle index, sorted by label
+	std::vector<uint32_t> group_starts_; // First slot of every catalog group in the sorted order
+	std::vector<HaloGroup> groups_;
+
+	uint32_t find_root(uint32_t particle_index);
+	void unite(uint32_t first_particle, uint32_t second_particle);
+	void link_friends(const Particle* particles, size_t particle_count, float linking_length);
+	void build_catalog(const Particle* particles, size_t particle_count, uint32_t min_group_size);
+public:
+	explicit HaloFinder(const PeriodicBox* periodic_box = nullptr);
+	HaloFinder(const HaloFinder&) = delete;
+	HaloFinder& operator=(const HaloFinder&) = delete;
+
+	// Groups of at least min_group_size particles, by label
+	const std::vector<HaloGroup>& find_groups(const Particle* particles, size_t particle_count, float linking_length,
+		uint32_t min_group_size = FOF_MIN_GROUP_SIZE);
+	const std::vector<HaloGroup>& get_groups() const; // Of the last search
+	bool save_catalog(const std::string& filename, double time, uint64_t seed) const; // One line of text per group
+};
@@ -0,0 +1,175 @@
+#pragma once
+#include "Settings.h"
+#include <cmath>
+
+// Softening laws of the interaction kernel. Each one turns the squared distance into the one used by the kernel, gives the
+// magnitude of the acceleration per unit mass, and the potential per unit mass when the kernel accumulates it
+
+// Squared distance kept above MIN_DISTANCE, the law of the original engines
+struct ClampSoftening {
+	template <typename Scalar>
+	static Scalar soften(Scalar distance_square) {
+		if (distance_square < MIN_DISTANCE)
+			distance_square = MIN_DISTANCE;
+		return distance_square;
+	}
+
+	template <typename Scalar>
+	static Scalar get_force(Scalar distance_square, Scalar) {
+		return GRAVITATIONAL_CONSTANT / distance_square;
+	}
+
+	template <typename Scalar>
+	static Scalar get_potential(Scalar, Scalar distance) {
+		return -GRAVITATIONAL_CONSTANT / distance;
+	}
+};
+
+// Plummer sphere of radius SOFTENING_LENGTH instead of a point mass, the force is smooth everywhere
+struct PlummerSoftening {
+	template <typename Scalar>
+	static Scalar soften(Scalar distance_square) {
+		return distance_square + static_cast<Scalar>(SOFTENING_LENGTH) * static_cast<Scalar>(SOFTENING_LENGTH);
+	}
+
+	template <typename Scalar>
+	static Scalar get_force(Scalar distance_square, Scalar) {
+		return GRAVITATIONAL_CONSTANT / distance_square;
+	}
+
+	template <typename Scalar>
+	static Scalar get_potential(Scalar, Scalar distance) {
+		return -GRAVITATIONAL_CONSTANT / distance;
+	}
+};
+
+// Cubic spline mass distribution of Monaghan & Lattanzio (1985), in the form of GADGET-2 (Springel 2005). The force is
+// exactly Newtonian beyond the support h = SPLINE_SUPPORT_LENGTHS * SOFTENING_LENGTH and vanishes at zero distance
+struct SplineSoftening {
+	template <typename Scalar>
+	static Scalar get_support() {
+		return static_cast<Scalar>(SPLINE_SUPPORT_LENGTHS) * static_cast<Scalar>(SOFTENING_LENGTH);
+	}
+
+	// Only keeps the direction finite for coincident particles, the force itself goes to zero
+	template <typename Scalar>
+	static Scalar soften(Scalar distance_square) {
+		const Scalar min_distance_square = static_cast<Scalar>(1e-12) * get_support<Scalar>() * get_support<Scalar>();
+		return distance_square < min_distance_square ? min_distance_square : distance_square;
+	}
+
+	template <typename Scalar>
+	static Scalar get_force(Scalar distance_square, Scalar distance) {
+		const Scalar h = get_support<Scalar>();
+		Scalar u = distance / h;
+		if (u >= 1)
+			return GRAVITATIONAL_CONSTANT / distance_square;
+		Scalar factor;
+		if (u < static_cast<Scalar>(0.5))
+			factor = static_cast<Scalar>(10.666666666667) + u * u * (static_cast<Scalar>(32.0) * u - static_cast<Scalar>(38.4));
+		else
+			factor = static_cast<Scalar>(21.333333333333) - static_cast<Scalar>(48.0) * u + static_cast<Scalar>(38.4) * u * u -
+				static_cast<Scalar>(10.666666666667) * u * u * u - static_cast<Scalar>(0.066666666667) / (u * u * u);
+		return GRAVITATIONAL_CONSTANT * factor * distance / (h * h * h);
+	}
+
+	template <typename Scalar>
+	static Scalar get_potential(Scalar, Scalar distance) {
+		const Scalar h = get_support<Scalar>();
+		Scalar u = distance / h;
+		if (u >= 1)
+			return -GRAVITATIONAL_CONSTANT / distance;
+		Scalar factor;
+		if (u < static_cast<Scalar>(0.5))
+			factor = static_cast<Scalar>(-2.8) + u * u * (static_cast<Scalar>(5.333333333333) + u * u * (static_cast<Scalar>(6.4) * u -
+				static_cast<Scalar>(9.6)));
+		else
+			factor = static_cast<Scalar>(-3.2) + static_cast<Scalar>(0.066666666667) / u + u * u * (static_cast<Scalar>(10.666666666667) +
+				u * (static_cast<Scalar>(-16.0) + u * (static_cast<Scalar>(9.6) - static_cast<Scalar>(2.133333333333) * u)));
+		return GRAVITATIONAL_CONSTANT * factor / h;
+	}
+};
+
+// Float sum that carries its own rounding error (Kahan 1965), close to the accuracy of a double sum with float arithmetic.
+// Only valid without value unsafe optimizations, they fold the compensation away
+class CompensatedFloat {
+	float sum_;
+	float compensation_; // Rounding error of the previous additions, removed from the next one
+public:
+	CompensatedFloat(float value = 0.0f) : sum_(value), compensation_(0.0f) { }
+
+	CompensatedFloat& operator+=(float value) {
+		float corrected_value = value - compensation_;
+		float sum = sum_ + corrected_value;
+		compensation_ = (sum - sum_) - corrected_value;
+		sum_ = sum;
+		return *this;
+	}
+
+	CompensatedFloat& operator-=(float value) {
+		return *this += -value;
+	}
+
+	explicit operator float() const {
+		return sum_ - compensation_;
+	}
+
+	explicit operator double() const {
+		return static_cast<double>(sum_) - static_cast<double>(compensation_);
+	}
+};
+
+// The one pair interaction of the engines, specialized at compile time on the arithmetic, the softening law and whether
+// the potential is accumulated, so that the inner loops carry no branch for any of them. The pair is computed with Scalar
+// and summed into Accumulator, a wider or compensated accumulator keeps the sum of many small pulls accurate while the
+// pairs stay in the fast arithmetic. Displacements point from the particle towards the interacting mass, DIM is taken
+// from the arrays
+template <typename Scalar, typename Softening, bool WITH_POTENTIAL, typename Accumulator = Scalar>
+struct InteractionKernel {
+	typedef Scalar ScalarType;
+	typedef Accumulator AccumulatorType;
+
+	// Pull of one mass on the particle
+	template <int DIM>
+	static void add_acceleration(const Scalar (&displacement)[DIM], Scalar mass, Accumulator (&acceleration)[DIM], Accumulator& potential) {
+		Scalar distance_square = displacement[0] * displacement[0];
+		for (int d = 1; d < DIM; ++d)
+			distance_square += displacement[d] * displacement[d];
+		distance_square = Softening::soften(distance_square);
+		Scalar distance = std::sqrt(distance_square);
+
+		Scalar acceleration_factor = Softening::get_force(distance_square, distance) * mass;
+		for (int d = 0; d < DIM; ++d)
+			acceleration[d] += acceleration_factor * (displacement[d] / distance);
+		if (WITH_POTENTIAL)
+			potential += Softening::get_potential(distance_square, distance) * mass;
+	}
+
+	// Pull of both particles on each other in one sweep
+	template <int DIM>
+	static void add_acceleration_pairwise(const Scalar (&displacement)[DIM], Scalar mass, Scalar interacting_mass,
+		Accumulator (&acceleration)[DIM], Accumulator (&interacting_acceleration)[DIM], Accumulator& potential, Accumulator& interacting_potential) {
+		Scalar distance_square = displacement[0] * displacement[0];
+		for (int d = 1; d < DIM; ++d)
+			distance_square += displacement[d] * displacement[d];
+		distance_square = Softening::soften(distance_square);
+		Scalar distance = std::sqrt(distance_square);
+
+		Scalar force = Softening::get_force(distance_square, distance);
+		Scalar acceleration_factor = force * interacting_mass;
+		Scalar interacting_acceleration_factor = force * mass;
+		for (int d = 0; d < DIM; ++d) {
+			Scalar direction = displacement[d] / distance;
+			acceleration[d] += acceleration_factor * direction;
+			interacting_acceleration[d] -= interacting_acceleration_factor * direction;
+		}
+		if (WITH_POTENTIAL) {
+			Scalar pair_potential = Softening::get_potential(distance_square, distance);
+			potential += pair_potential * interacting_mass;
+			interacting_potential += pair_potential * mass;
+		}
+	}
+};
+
+// Kernel of the float engines, the clamped law of the original engines
+typedef InteractionKernel<float, ClampSoftening, false> DefaultKernel;
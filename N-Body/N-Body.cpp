@@ -3,133 +3,33 @@
 #include <vector>
 #include <tbb/tick_count.h>
 #include "Particle.h"
-#include <tbb/cache_aligned_allocator.h>
-#include <tbb/concurrent_vector.h>
 #include "ParticleHandler.h"
-#include <tbb/parallel_for.h>
-#include <tbb/task_scheduler_init.h>
-#include <cassert>
+#include <cstdlib>
 #include "QuadParticleTree.h"
+#include "Snapshot.h"
+#include "CompressedSnapshot.h"
+#include "OutputPipeline.h"
+#include "Simulation.h"
+#include "ThreadArena.h"
+#include <cstring>
+#include <memory>
 
-// Advance the simulation using Thread Bulding Blocks parallelization
-void simulate_tbb(tbb::concurrent_vector<Particle>& particles, float total_time_steps, float time_step, size_t particle_count,
-	size_t universe_size_x, size_t universe_size_y) {
-
-	// Do Simulate
-	int png_step_counter = 0;
-	for (float current_time_step = 0.0; current_time_step < total_time_steps; current_time_step += time_step) {
-
-		parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get the range for this thread
-			[&](const tbb::blocked_range<size_t>& r) {
-				Particle current_particle = particles[r.begin()]; // Thread local variable
-				for (size_t i = r.begin(); i != r.end(); ++i) {
-					current_particle = particles[i]; // Store the current particle locally
-					for (size_t j = i + 1; j < particle_count; ++j) { // Calculate pairs of accelerations
-						current_particle.add_acceleration_pairwise(particles[j]);					
-					}
-					particles[i] = current_particle; // Store data back into the shared memory
-				}
-			}
-		); // Implicit barrier for all the points of the simulation
-
-		// Now that all the new accelerations were calculated, advance the particles in time
-		parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
-			[&](const tbb::blocked_range<size_t>& r) {  
-				for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
-					particles[index].advance(time_step);
-				}
-			}
-		);
-
-		++png_step_counter;
-		if (SAVE_INTERMEDIATE_PNG_STEPS && SAVE_PNG && png_step_counter >= SAVE_PNG_EVERY) { // Save the intermediate step as png
-			png_step_counter = 0;
-
-			std::string file_name = "universe_tbb_timestep_" + std::to_string(current_time_step) + ".png";
-
-			ParticleHandler::universe_to_png(ParticleHandler::to_vector(particles), universe_size_x, universe_size_y, file_name.c_str());
-		}
-	}
-}
-
-void simulate_parallel_barnes_hut(tbb::concurrent_vector<Particle>& particles, float total_time_steps, float time_step, size_t particle_count,
-	size_t universe_size_x, size_t universe_size_y) {
-
-	int png_step_counter = 0;
-	tbb::atomic<QuadParticleTree*> atomic_quad_tree;
-
-	for (float current_time_step = 0.0; current_time_step < total_time_steps; current_time_step += time_step) {
-
-		// (Re)Allocate all the vector particles into the tree			
-		atomic_quad_tree = new QuadParticleTree(Particle(0.0f, 0.0f, 0.0f), //Crate a new quad tree with limits from zero, up to grid size x and y
-			Particle(static_cast<float>(universe_size_x) * 2, static_cast<float>(universe_size_y) * 2, 0.0f)); // x2 due to an issue on the tree min/max bounds
-
-		// Insert the points in the quad tree
-		tbb::concurrent_vector<TreeParticle, tbb::cache_aligned_allocator<TreeParticle>> quad_tree_particles(particle_count);
-
-		parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
-			[&](const tbb::blocked_range<size_t>& r) {
-			for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
-				quad_tree_particles[index].set_particle(particles[index]);
-			}
-		}); // Implicit barrier
-
-		// Must be performed serially. Parallel version requires lots of safe regions anyway
-		for (size_t i = 0; i < particle_count; ++i) {
-			atomic_quad_tree->insert(&quad_tree_particles[i]);
-		}
-
-		parallel_for(tbb::blocked_range<size_t>(0, particle_count),
-			[&](const tbb::blocked_range<size_t>& r) {
-			for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range				
-				atomic_quad_tree->apply_acceleration(particles[index]);
-			}
-		}); // Implicit barrier
-
-		 // Now that all the new accelerations were calculated, advance the particles in time
-		parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
-			[&](const tbb::blocked_range<size_t>& r) {
-			for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
-				Particle current_particle = particles[index]; // Thread local variable
-				current_particle.advance(time_step);
-				std::swap(particles[index], current_particle);
-			}
-		}
-		); // Implicit barrier
-
-		// Recursively de-allocate the tree
-		delete atomic_quad_tree;
-
-		++png_step_counter;
-		if (SAVE_INTERMEDIATE_PNG_STEPS && SAVE_PNG && png_step_counter >= SAVE_PNG_EVERY) {
-
-			png_step_counter = 0;
-			std::string file_name = "universe_serial_barnes_hut_timestep_" + std::to_string(current_time_step) + ".png";
-
-			// TODO: fix the ability to print universe
-			ParticleHandler::universe_to_png(ParticleHandler::to_vector(particles), universe_size_x, universe_size_y, file_name.c_str());
-		}
-	}
-}
-
-void simulate_serial_barnes_hut_sample(std::vector<Particle>& particles, float total_time_steps, float time_step, size_t particle_count,
-	size_t universe_size_x, size_t universe_size_y) {
+void simulate_serial_barnes_hut_sample(float total_time_steps, float time_step, OutputPipeline& output_pipeline) {
 
 	// Hardcode sizes for the sample
-	particle_count = 8;
-	universe_size_x = 100;
-	universe_size_y = 100;
+	size_t universe_size_x = 100;
+	size_t universe_size_y = 100;
 
 	int png_step_counter = 0;
 
-	QuadParticleTree* quad_tree;	
-	
+	QuadParticleTree* quad_tree;
+
 	// Allocate particles into the vector
-	std::vector<Particle> particles_local;	
+	std::vector<Particle> particles_local;
 	particles_local = ParticleHandler::get_random_particles_Barns_Hut_sample();
 
 	for (float current_time_step = 0.0; current_time_step < total_time_steps; current_time_step += time_step) {
-		
+
 		// (Re)Allocate all the vector particles into the tree
 		quad_tree = ParticleHandler::to_quad_tree(particles_local, universe_size_x * 2, universe_size_y * 2);
 
@@ -139,7 +39,7 @@ void simulate_serial_barnes_hut_sample(std::vector<Particle>& particles, float t
 
 		// Advance the particles in time
 		for (Particle& current_particle : particles_local)
-			current_particle.advance(time_step); // Advance the particle positions in time
+			current_particle.advance(time_step, static_cast<float>(universe_size_x), static_cast<float>(universe_size_y)); // Advance the particle positions in time
 
 		// Recursively de-allocate the tree
 		delete quad_tree;
@@ -148,80 +48,72 @@ void simulate_serial_barnes_hut_sample(std::vector<Particle>& particles, float t
 		if (SAVE_INTERMEDIATE_PNG_STEPS && SAVE_PNG && png_step_counter >= SAVE_PNG_EVERY) {
 
 			png_step_counter = 0;
-			std::string file_name = "universe_serial_barnes_hut_timestep_" + std::to_string(current_time_step) + ".png";
-
 			// TODO: fix the ability to print universe
-			ParticleHandler::universe_to_png(particles, universe_size_x, universe_size_y, file_name.c_str());
+			output_pipeline.submit_step(particles_local, particles_local.size(), universe_size_x, universe_size_y, "universe_serial_barnes_hut", current_time_step);
 		}
 	}
 }
 
-void simulate_serial_barnes_hut(std::vector<Particle>& particles, float total_time_steps, float time_step, size_t particle_count,
- 	size_t universe_size_x, size_t universe_size_y) {
-		
-	int png_step_counter = 0;
-	QuadParticleTree* quad_tree;
-
-	for (float current_time_step = 0.0; current_time_step < total_time_steps; current_time_step += time_step) {
-
-		// (Re)Allocate all the vector particles into the tree
-		quad_tree = ParticleHandler::to_quad_tree(particles, universe_size_x * 2, universe_size_y * 2);
-
-		// Apply acceleration force to all the particles of the vector
-		for (Particle& current_particle : particles)
-			quad_tree->apply_acceleration(current_particle);
-
-		// Advance the particles in time
-		for (Particle& current_particle : particles)
-			current_particle.advance(time_step); // Advance the particle positions in time
-
-		// Recursively de-allocate the tree
-		delete quad_tree;
-
-		++png_step_counter;
-		if (SAVE_INTERMEDIATE_PNG_STEPS && SAVE_PNG && png_step_counter >= SAVE_PNG_EVERY) {
-
-			png_step_counter = 0;
-			std::string file_name = "universe_serial_barnes_hut_timestep_" + std::to_string(current_time_step) + ".png";
-
-			// TODO: fix the ability to print universe
-			ParticleHandler::universe_to_png(particles, universe_size_x, universe_size_y, file_name.c_str());
-		}
-	}
+// Advance a simulation until the end time and print how long it took
+template <typename SimulationType>
+void benchmark(SimulationType& simulation, float total_time_steps, const char* description) {
+	std::cout << std::endl << description << "... ";
+	tbb::tick_count before = tbb::tick_count::now();
+	simulation.run(total_time_steps);
+	tbb::tick_count after = tbb::tick_count::now();
+	std::cout << 1000 * (after - before).seconds() << " ms" << std::endl;
 }
 
-// Advance the simulation using serial execution
-void simulate_serial(std::vector<Particle>& particles, float total_time_steps, float time_step, size_t particle_count,
-	size_t universe_size_x, size_t universe_size_y) {
-
-	// Do simulate
-	int png_step_counter = 0;
-	for (float current_time_step = 0.0; current_time_step < total_time_steps; current_time_step += time_step) {
-
-		// Calculate all the applied forces as acceleration on every particle
-		for (size_t i = 0; i < particle_count; ++i) {
-			for (size_t j = 0; j < particle_count; ++j) {
-				if (j != i)
-					particles[i].add_acceleration(particles[j]); // Gather and apply force for every point combination
-			}
-		}
+// Parse the thread placement of the command line
+bool parse_pinning(const char* argument, ThreadPinning& pinning) {
+	if (strcmp(argument, "none") == 0)
+		pinning = PIN_NONE;
+	else if (strcmp(argument, "cores") == 0)
+		pinning = PIN_CORES;
+	else if (strcmp(argument, "numa") == 0)
+		pinning = PIN_NUMA_NODES;
+	else
+		return false;
+	return true;
+}
 
-		for (Particle& current_particle : particles)
-			current_particle.advance(time_step); // Advance the particle posiitions in time
+bool parse_boundary_condition(const char* argument, BoundaryCondition& boundary_condition) {
+	if (strcmp(argument, "reflective") == 0)
+		boundary_condition = BOUNDARY_REFLECTIVE;
+	else if (strcmp(argument, "periodic") == 0)
+		boundary_condition = BOUNDARY_PERIODIC;
+	else
+		return false;
+	return true;
+}
 
-		++png_step_counter;
-		if (SAVE_INTERMEDIATE_PNG_STEPS && SAVE_PNG && png_step_counter >= SAVE_PNG_EVERY) { // Save the intermediate step as png
-		
-			png_step_counter = 0;
-			std::string file_name = "universe_serial_timestep_" + std::to_string(current_time_step) + ".png";
+bool parse_initial_condition(const char* argument, InitialCondition& initial_condition) {
+	if (strcmp(argument, "uniform") == 0)
+		initial_condition = UNIFORM_RANDOM;
+	else if (strcmp(argument, "plummer") == 0)
+		initial_condition = PLUMMER_SPHERE;
+	else if (strcmp(argument, "disk") == 0)
+		initial_condition = EXPONENTIAL_DISK;
+	else if (strcmp(argument, "clusters") == 0)
+		initial_condition = SONEIRA_PEEBLES_CLUSTERS;
+	else
+		return false;
+	return true;
+}
 
-			ParticleHandler::universe_to_png(particles, universe_size_x, universe_size_y, file_name.c_str());
-		}
-	}
+bool parse_reduction_mode(const char* argument, ReductionMode& reduction_mode) {
+	if (strcmp(argument, "fast") == 0)
+		reduction_mode = REDUCTION_FAST;
+	else if (strcmp(argument, "deterministic") == 0)
+		reduction_mode = REDUCTION_DETERMINISTIC;
+	else
+		return false;
+	return true;
 }
 
-// Application entry point
-int main()
+// Application entry point, usage: N-Body [particle_count] [total_time] [universe_size] [thread_count] [none|cores|numa] [reflective|periodic]
+// [fast|deterministic] [seed] [uniform|plummer|disk|clusters]
+int main(int argc, char* argv[])
 {
 	// Get the default simulation values
 	int thread_count = DEFAULT_NUMBER_OF_THREADS;
@@ -230,102 +122,187 @@ int main()
 	float time_step = TIME_STEP;
 	size_t universe_size_x = UNIVERSE_SIZE_X;
 	size_t universe_size_y = UNIVERSE_SIZE_Y;
-
-	// TODO: User input data
+	uint64_t random_seed = DEFAULT_RANDOM_SEED;
+	InitialCondition initial_condition = DEFAULT_INITIAL_CONDITION;
+	float start_time = 0.0f;
+	ThreadPinning pinning = DEFAULT_THREAD_PINNING;
+	BoundaryCondition boundary_condition = DEFAULT_BOUNDARY_CONDITION;
+	ReductionMode reduction_mode = DEFAULT_REDUCTION_MODE;
+
+	// Size of the default run
 	particle_count = 300;
 	total_time_steps = 10.0f;
 	universe_size_x = 300;
 	universe_size_y = 300;
 	thread_count = 4;
 
-	tbb::task_scheduler_init init(thread_count); // Set the number of threads on the TBB scheduler
-	
-	if (total_time_steps > 0.0 && particle_count > 0 && universe_size_x > 0 && universe_size_y > 0) {
-		
-		// Print calculation info
-		std::cout << "= Parallel N-Body simulation serially and with Thread Building Blocks =" << std::endl;
-		std::cout << "Number of threads: " << thread_count << std::endl;
-		std::cout << "Total time steps: " << total_time_steps << std::endl;
-		std::cout << "Time step: " << time_step << std::endl;
-		std::cout << "Particle count: " << particle_count << std::endl << std::endl;
-		std::cout << "Universe Size: " << universe_size_x << " x " << universe_size_y << std::endl << std::endl;
-
-		tbb::tick_count before, after; // Execution timers
-
-		// Initialize particle container
-		std::vector<Particle> particles;
-
-		// Put random particles
-		ParticleHandler::allocate_random_particles(particle_count, particles, universe_size_x, universe_size_y);
-
-		// TODO: Show Init vector universe
-		if (VERBOSE) {
-			std::cout << "Init Universe" << std::endl;
-		}
+	// Optional command line overrides
+	if (argc > 1)
+		particle_count = strtoul(argv[1], nullptr, 10);
+	if (argc > 2)
+		total_time_steps = static_cast<float>(atof(argv[2]));
+	if (argc > 3)
+		universe_size_x = universe_size_y = strtoul(argv[3], nullptr, 10);
+	if (argc > 4)
+		thread_count = atoi(argv[4]);
+	bool valid_pinning = argc <= 5 || parse_pinning(argv[5], pinning);
+	bool valid_boundary_condition = argc <= 6 || parse_boundary_condition(argv[6], boundary_condition);
+	bool valid_reduction_mode = argc <= 7 || parse_reduction_mode(argv[7], reduction_mode);
+	if (argc > 8)
+		random_seed = strtoull(argv[8], nullptr, 10);
+	bool valid_initial_condition = argc <= 9 || parse_initial_condition(argv[9], initial_condition);
+
+	if (total_time_steps <= 0.0 || particle_count == 0 || universe_size_x == 0 || universe_size_y == 0 || thread_count <= 0 || !valid_pinning ||
+		!valid_boundary_condition || !valid_reduction_mode || !valid_initial_condition) {
+		std::cerr << "Usage: " << argv[0] << " [particle_count] [total_time] [universe_size] [thread_count] [none|cores|numa] [reflective|periodic]"
+			" [fast|deterministic] [seed] [uniform|plummer|disk|clusters]" << std::endl;
+		return 1;
+	}
 
-		// Simulate
-
-		// Copy the particle universes into the serial and parallel execution containers
-		std::vector<Particle> particles_serial(particles);
-		tbb::concurrent_vector<Particle, tbb::cache_aligned_allocator<Particle>> particles_tbb(ParticleHandler::to_concurrent_vector(particles));
-		std::vector<Particle> particles_serial_barnes_hut(particles);
-		tbb::concurrent_vector<Particle, tbb::cache_aligned_allocator<Particle>> particles_parallel_barnes_hut(ParticleHandler::to_concurrent_vector(particles));
-
-		// Benchmark the Serial execution
-		std::cout << std::endl << "Serial execution... ";
-		before = tbb::tick_count::now();
-		simulate_serial(particles_serial, total_time_steps, time_step, particle_count, universe_size_x, universe_size_y); // Advance Simulation serially
-		after = tbb::tick_count::now();
-		std::cout << 1000 * (after - before).seconds() << " ms" << std::endl;
-
-		// Barnes Serial execution
-		std::cout << std::endl << "Serial execution (Barnes-Hut)... ";
-		before = tbb::tick_count::now();
-		simulate_serial_barnes_hut(particles_serial_barnes_hut, total_time_steps, time_step, particle_count, universe_size_x, universe_size_y); // Advance Simulation serially
-		//simulate_serial_barnes_hut_sample(particles_serial_barnes_hut, total_time_steps, time_step, particle_count, universe_size_x, universe_size_y); // Advance Simulation serially
-		after = tbb::tick_count::now();
-		std::cout << 1000 * (after - before).seconds() << " ms" << std::endl;
-		
-		// Barnes Parallel execution
-		std::cout << std::endl << "Parallel execution (Barnes-Hut)... ";
-		before = tbb::tick_count::now();
-		//simulate_serial_barnes_hut(particles_serial_barnes_hut, total_time_steps, time_step, particle_count, universe_size_x, universe_size_y); // Advance parallel
-		simulate_parallel_barnes_hut(particles_parallel_barnes_hut, total_time_steps, time_step, particle_count, universe_size_x, universe_size_y); // Advance Simulation with TBB
-		after = tbb::tick_count::now();
-		std::cout << 1000 * (after - before).seconds() << " ms" << std::endl;
-		
-		// Benchmark the Thread Building Blocks execution
-		std::cout << std::endl << "Thread Building Blocks execution... ";
-		before = tbb::tick_count::now();
-		simulate_tbb(particles_tbb, total_time_steps, time_step, particle_count, universe_size_x, universe_size_y); // Advance Simulation with TBB
-		after = tbb::tick_count::now();
-		std::cout << 1000 * (after - before).seconds() << " ms" << std::endl;
-
-		// Assert the equality and validity of the results
-		assert(ParticleHandler::are_equal(particles_serial, ParticleHandler::to_vector(particles_tbb)) == true); // compare serial with parallel
-		assert(ParticleHandler::are_equal(particles, particles_serial) == false); // compare serial with init
-		assert(ParticleHandler::are_equal(particles, ParticleHandler::to_vector(particles_tbb)) == false); // compare parallel with init
-
-		// TODO: Show universe in the console
-		if (VERBOSE) {
-
-			std::cout << "Final Universe Serial" << std::endl;
-			//grid_modifier.debug_show_universe(universe_serial, universe_size_x, universe_size_y);
-
-			std::cout << "Final Universe TBB" << std::endl;
-			//grid_modifier.debug_show_universe(UniverseModifier::to_vector(universe_tbb), universe_size_x, universe_size_y);
+	ThreadArena thread_arena(thread_count, pinning); // Set the number of threads and their placement
+
+	// Print calculation info
+	std::cout << "= Parallel N-Body simulation serially and with Thread Building Blocks =" << std::endl;
+	std::cout << "Number of threads: " << thread_count << (thread_arena.is_pinned() ? " (pinned)" : "") << std::endl;
+	std::cout << "Total time steps: " << total_time_steps << std::endl;
+	std::cout << "Time step: " << time_step << std::endl;
+	std::cout << "Boundaries: " << (boundary_condition == BOUNDARY_PERIODIC ? "periodic" : "reflective") << std::endl;
+	std::cout << "Reductions: " << (reduction_mode == REDUCTION_DETERMINISTIC ? "deterministic" : "fast") << std::endl;
+	std::cout << "Particle count: " << particle_count << std::endl;
+	const char* initial_condition_names[] = { "uniform", "plummer", "disk", "clusters" };
+	std::cout << "Initial condition: " << initial_condition_names[initial_condition] << std::endl;
+	std::cout << "Random seed: " << random_seed << std::endl << std::endl;
+	std::cout << "Universe Size: " << universe_size_x << " x " << universe_size_y << std::endl << std::endl;
+
+	// Initialize particle container
+	std::vector<Particle> particles;
+
+	// Continue a previous run from its checkpoint
+	bool restarted = false;
+	if (RESTART_FROM_CHECKPOINT) {
+		SnapshotFile checkpoint(RESTART_CHECKPOINT_FILENAME);
+		if (checkpoint.is_valid()) {
+			checkpoint.to_particles(particles);
+			particle_count = particles.size();
+			const SnapshotHeader& header = checkpoint.get_header();
+			start_time = static_cast<float>(header.time);
+			random_seed = header.seed;
+			restarted = true;
+
+			// The universe and the time step of the saved run are kept, the particles only make sense in them
+			if (header.universe_size_x != universe_size_x || header.universe_size_y != universe_size_y || header.time_step != time_step)
+				std::cout << "Using the universe size and the time step of the checkpoint" << std::endl;
+			universe_size_x = header.universe_size_x;
+			universe_size_y = header.universe_size_y;
+			time_step = header.time_step;
+			std::cout << "Restarting " << particle_count << " particles from " << RESTART_CHECKPOINT_FILENAME << " at time " << start_time
+				<< " (seed " << random_seed << ", universe " << universe_size_x << " x " << universe_size_y << ", time step " << time_step
+				<< ")" << std::endl << std::endl;
+		} else {
+			std::cerr << "Cannot restart from " << RESTART_CHECKPOINT_FILENAME << ", using new initial conditions" << std::endl << std::endl;
 		}
+	}
 
-		if (SAVE_PNG) { // Save final universes to png
-			ParticleHandler::universe_to_png(particles, universe_size_x, universe_size_y, "init_universe.png");
-			ParticleHandler::universe_to_png(particles_serial, universe_size_x, universe_size_y, "final_serial_universe.png");
-			ParticleHandler::universe_to_png(particles_serial_barnes_hut, universe_size_x, universe_size_y, "final_serial_universe_barnes_hut.png");
-			ParticleHandler::universe_to_png(ParticleHandler::to_vector(particles_parallel_barnes_hut), universe_size_x, universe_size_y, "final_parallel_universe_barnes_hut.png");
-			ParticleHandler::universe_to_png(ParticleHandler::to_vector(particles_tbb), universe_size_x, universe_size_y, "final_tbb_universe.png");
-		}
+	// Put random particles, reproducible through the seed
+	if (!restarted)
+		ParticleHandler::allocate_particles(initial_condition, particle_count, particles, universe_size_x, universe_size_y, random_seed);
+
+	// Every engine simulates its own copy of the initial universe, allocated inside the arena so that the pages of the
+	// particles are first touched by the threads that compute on them
+	std::unique_ptr<Simulation> simulations[6];
+	thread_arena.execute([&]() {
+		simulations[0].reset(new Simulation(ENGINE_SERIAL, "serial", particles, universe_size_x, universe_size_y, time_step, start_time,
+			boundary_condition));
+		simulations[1].reset(new Simulation(ENGINE_SERIAL_BARNES_HUT, "serial_barnes_hut", particles, universe_size_x, universe_size_y,
+			time_step, start_time, boundary_condition));
+		simulations[2].reset(new Simulation(ENGINE_PARALLEL_BARNES_HUT, "parallel_barnes_hut", particles, universe_size_x, universe_size_y,
+			time_step, start_time, boundary_condition));
+		simulations[3].reset(new Simulation(ENGINE_TBB, "tbb", particles, universe_size_x, universe_size_y, time_step, start_time,
+			boundary_condition));
+		simulations[4].reset(new Simulation(ENGINE_PARTICLE_MESH, "particle_mesh", particles, universe_size_x, universe_size_y, time_step,
+			start_time, boundary_condition));
+		simulations[5].reset(new Simulation(ENGINE_TREE_PM, "tree_pm", particles, universe_size_x, universe_size_y, time_step, start_time,
+			boundary_condition));
+	});
+	Simulation& serial = *simulations[0];
+	Simulation& serial_barnes_hut = *simulations[1];
+	Simulation& parallel_barnes_hut = *simulations[2];
+	Simulation& tbb = *simulations[3];
+	Simulation& particle_mesh = *simulations[4];
+	Simulation& tree_pm = *simulations[5];
+
+	// Images are encoded in the background while the simulations continue
+	OutputPipeline output_pipeline(random_seed);
+	for (Simulation* simulation : { &serial, &serial_barnes_hut, &parallel_barnes_hut, &tbb, &particle_mesh, &tree_pm }) {
+		simulation->set_output_pipeline(&output_pipeline);
+		simulation->set_reduction_mode(reduction_mode);
+	}
 
-		system("pause");
+	// Periodic snapshots of the parallel executions
+	std::unique_ptr<CheckpointWriter> checkpoint_tbb, checkpoint_parallel_barnes_hut;
+	if (SAVE_CHECKPOINTS) {
+		checkpoint_tbb.reset(new CheckpointWriter("checkpoint_tbb.snap", random_seed, time_step, universe_size_x, universe_size_y));
+		checkpoint_parallel_barnes_hut.reset(new CheckpointWriter("checkpoint_parallel_barnes_hut.snap", random_seed, time_step,
+			universe_size_x, universe_size_y));
+		tbb.set_checkpoint_writer(checkpoint_tbb.get());
+		parallel_barnes_hut.set_checkpoint_writer(checkpoint_parallel_barnes_hut.get());
 	}
 
-}
+	// Compressed analysis snapshots of the parallel executions
+	std::unique_ptr<CompressedSnapshotWriter> snapshot_writer;
+	if (SAVE_COMPRESSED_SNAPSHOTS) {
+		snapshot_writer.reset(new CompressedSnapshotWriter(random_seed, time_step, universe_size_x, universe_size_y));
+		tbb.set_snapshot_writer(snapshot_writer.get());
+		parallel_barnes_hut.set_snapshot_writer(snapshot_writer.get());
+	}
 
+	// Friends-of-friends catalogs of the parallel executions
+	if (SAVE_HALO_CATALOGS) {
+		tbb.set_halo_catalogs(true, random_seed);
+		parallel_barnes_hut.set_halo_catalogs(true, random_seed);
+	}
+
+	// Benchmark the executions inside the arena
+	thread_arena.execute([&]() {
+		benchmark(serial, total_time_steps, "Serial execution");
+		benchmark(serial_barnes_hut, total_time_steps, "Serial execution (Barnes-Hut)");
+		//simulate_serial_barnes_hut_sample(total_time_steps, time_step, output_pipeline);
+		benchmark(parallel_barnes_hut, total_time_steps, "Parallel execution (Barnes-Hut)");
+		benchmark(tbb, total_time_steps, "Thread Building Blocks execution");
+		benchmark(particle_mesh, total_time_steps, "Particle-mesh execution");
+		benchmark(tree_pm, total_time_steps, "TreePM execution");
+	});
+
+	// Wait for the last snapshots to reach the disk
+	if (SAVE_CHECKPOINTS && (!checkpoint_tbb->wait() || !checkpoint_parallel_barnes_hut->wait()))
+		std::cerr << "Could not write the checkpoints" << std::endl;
+
+	// Check the equality and validity of the results. The deterministic reductions reproduce the serial engine, the fast
+	// ones add the same pairs in an order that depends on the ranges of the threads
+	std::vector<Particle> particles_serial = serial.get_particles();
+	std::vector<Particle> particles_tbb = tbb.get_particles();
+	bool serial_matches_tbb = reduction_mode == REDUCTION_DETERMINISTIC ? ParticleHandler::are_equal(particles_serial, particles_tbb) :
+		ParticleHandler::are_close(particles_serial, particles_tbb, FAST_REDUCTION_TOLERANCE);
+	int exit_code = 0;
+	if (!serial_matches_tbb) { // compare serial with parallel
+		std::cerr << "The serial and the Thread Building Blocks executions differ" << std::endl;
+		exit_code = 1;
+	}
+	if (ParticleHandler::are_equal(particles, particles_serial) || ParticleHandler::are_equal(particles, particles_tbb)) { // compare with init
+		std::cerr << "The particles did not move" << std::endl;
+		exit_code = 1;
+	}
+
+	if (SAVE_PNG) { // Save final universes to png
+		output_pipeline.submit_png(particles, particles.size(), universe_size_x, universe_size_y, "init_universe.png");
+		output_pipeline.submit_png(particles_serial, particle_count, universe_size_x, universe_size_y, "final_serial_universe.png");
+		output_pipeline.submit_png(serial_barnes_hut.get_particles(), particle_count, universe_size_x, universe_size_y, "final_serial_universe_barnes_hut.png");
+		output_pipeline.submit_png(parallel_barnes_hut.get_particles(), particle_count, universe_size_x, universe_size_y, "final_parallel_universe_barnes_hut.png");
+		output_pipeline.submit_png(particles_tbb, particle_count, universe_size_x, universe_size_y, "final_tbb_universe.png");
+		output_pipeline.submit_png(particle_mesh.get_particles(), particle_count, universe_size_x, universe_size_y, "final_particle_mesh_universe.png");
+		output_pipeline.submit_png(tree_pm.get_particles(), particle_count, universe_size_x, universe_size_y, "final_tree_pm_universe.png");
+	}
+	output_pipeline.flush();
+
+	return exit_code;
+}
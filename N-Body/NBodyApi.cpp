@@ -0,0 +1,336 @@
+#include "NBodyApi.h"
+#include "Particle.h"
+#include "ParticleHandler.h"
+#include "Settings.h"
+#include "Simulation.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <tbb/parallel_for.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && sizeof(nbody_sequence_counter) == sizeof(uint64_t),
+	"The sequence counter of the shared memory must be a lock-free 64 bit word");
+
+static const char SHARED_MEMORY_MAGIC[8] = { 'N', 'B', 'O', 'D', 'Y', 'S', 'H', 'M' };
+static const size_t SHARED_COLUMN_ALIGNMENT = 64; // Columns start on a cache line
+
+// State behind the opaque C handle. The simulation keeps its own particles, every nbody_step publishes them as columns
+// in a private vector or in the shared memory segment
+struct nbody_simulation {
+	std::unique_ptr<Simulation> simulation;
+	std::vector<float> private_columns;
+	float* columns[NBODY_COLUMN_COUNT];
+	size_t particle_capacity;
+	size_t particle_count;
+
+	nbody_shared_header* shared_header;
+	size_t shared_size;
+	std::string shared_name;
+#ifdef _WIN32
+	void* mapping_handle;
+#endif
+};
+
+// Map a shared memory segment, created for writing or opened for reading
+static void* map_shared_memory(const char* name, size_t size, bool create, size_t& mapped_size, void*& handle) {
+	handle = nullptr;
+#ifdef _WIN32
+	if (create) {
+		uint64_t segment_size = size;
+		handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(segment_size >> 32),
+			static_cast<DWORD>(segment_size), name);
+	} else {
+		handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+	}
+	if (handle == nullptr)
+		return nullptr;
+
+	void* mapping = MapViewOfFile(handle, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, create ? size : 0);
+	if (mapping == nullptr) {
+		CloseHandle(handle);
+		handle = nullptr;
+		return nullptr;
+	}
+	if (!create) {
+		CloseHandle(handle); // The view keeps the segment alive
+		handle = nullptr;
+
+		// Readers map the whole segment, its size is the one of the view
+		MEMORY_BASIC_INFORMATION region;
+		if (VirtualQuery(mapping, &region, sizeof(region)) == 0 || region.RegionSize < sizeof(nbody_shared_header)) {
+			UnmapViewOfFile(mapping);
+			return nullptr;
+		}
+		size = region.RegionSize;
+	}
+	mapped_size = size;
+	return mapping;
+#else
+	int file_descriptor = shm_open(name, create ? O_CREAT | O_RDWR : O_RDONLY, 0600);
+	if (file_descriptor < 0)
+		return nullptr;
+
+	if (create) {
+		if (ftruncate(file_descriptor, static_cast<off_t>(size)) != 0) {
+			::close(file_descriptor);
+			shm_unlink(name);
+			return nullptr;
+		}
+	} else {
+		struct stat file_status;
+		if (fstat(file_descriptor, &file_status) != 0 || static_cast<size_t>(file_status.st_size) < sizeof(nbody_shared_header)) {
+			::close(file_descriptor);
+			return nullptr;
+		}
+		size = static_cast<size_t>(file_status.st_size);
+	}
+
+	void* mapping = mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file_descriptor, 0);
+	::close(file_descriptor); // The mapping keeps the segment alive
+	if (mapping == MAP_FAILED) {
+		if (create)
+			shm_unlink(name);
+		return nullptr;
+	}
+	mapped_size = size;
+	return mapping;
+#endif
+}
+
+static void unmap_shared_memory(const void* mapping, size_t size) {
+#ifdef _WIN32
+	UnmapViewOfFile(mapping);
+#else
+	munmap(const_cast<void*>(mapping), size);
+#endif
+}
+
+static size_t align_column(size_t offset) {
+	return (offset + SHARED_COLUMN_ALIGNMENT - 1) / SHARED_COLUMN_ALIGNMENT * SHARED_COLUMN_ALIGNMENT;
+}
+
+// Lay out the header and the columns in a new shared memory segment
+static bool place_in_shared_memory(nbody_simulation& simulation, const char* name) {
+	size_t column_size = align_column(simulation.particle_capacity * sizeof(float));
+	size_t first_column_offset = align_column(sizeof(nbody_shared_header));
+	size_t size = first_column_offset + NBODY_COLUMN_COUNT * column_size;
+
+	void* handle;
+	void* mapping = map_shared_memory(name, size, true, simulation.shared_size, handle);
+	if (mapping == nullptr)
+		return false;
+#ifdef _WIN32
+	simulation.mapping_handle = handle;
+#endif
+	simulation.shared_name = name;
+
+	nbody_shared_header* header = new (mapping) nbody_shared_header();
+	memcpy(header->magic, SHARED_MEMORY_MAGIC, sizeof(SHARED_MEMORY_MAGIC));
+	header->version = NBODY_API_VERSION;
+	header->column_count = NBODY_COLUMN_COUNT;
+	header->segment_size = size;
+	header->particle_capacity = simulation.particle_capacity;
+	for (size_t column = 0; column < NBODY_COLUMN_COUNT; ++column) {
+		header->column_offset[column] = first_column_offset + column * column_size;
+		simulation.columns[column] = reinterpret_cast<float*>(static_cast<char*>(mapping) + header->column_offset[column]);
+	}
+	header->sequence.store(0, std::memory_order_relaxed);
+	simulation.shared_header = header;
+	return true;
+}
+
+// Copy the particles of the simulation into the columns
+static void write_columns(nbody_simulation& simulation) {
+	const Particle* particles = simulation.simulation->get_particle_data();
+	float* const* columns = simulation.columns;
+	simulation.particle_count = simulation.simulation->get_particle_count();
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, simulation.particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			const Particle& particle = particles[index];
+			columns[NBODY_COLUMN_X][index] = particle.x_;
+			columns[NBODY_COLUMN_Y][index] = particle.y_;
+			columns[NBODY_COLUMN_VELOCITY_X][index] = particle.velocity_x_;
+			columns[NBODY_COLUMN_VELOCITY_Y][index] = particle.velocity_y_;
+			columns[NBODY_COLUMN_MASS][index] = particle.mass_;
+		}
+	}); // Implicit barrier
+}
+
+// Writer side of the seqlock, the only writer of the segment is this process
+static void publish_columns(nbody_simulation& simulation) {
+	nbody_shared_header* header = simulation.shared_header;
+	if (header == nullptr) {
+		write_columns(simulation);
+		return;
+	}
+
+	uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+	header->sequence.store(sequence + 1, std::memory_order_relaxed); // Odd, the columns are being written
+	std::atomic_thread_fence(std::memory_order_release); // The odd counter is visible before any column write
+	write_columns(simulation);
+	header->particle_count = simulation.particle_count;
+	header->time = simulation.simulation->get_time();
+	header->sequence.store(sequence + 2, std::memory_order_release); // Even, the columns are consistent again
+}
+
+extern "C" {
+
+void nbody_default_config(nbody_config* config) {
+	if (config == nullptr)
+		return;
+	config->particle_count = DEFAULT_PARTICLE_COUNT;
+	config->universe_size_x = UNIVERSE_SIZE_X;
+	config->universe_size_y = UNIVERSE_SIZE_Y;
+	config->time_step = TIME_STEP;
+	config->seed = DEFAULT_RANDOM_SEED;
+	config->initial_condition = DEFAULT_INITIAL_CONDITION;
+	config->engine = ENGINE_PARALLEL_BARNES_HUT;
+	config->boundary_condition = DEFAULT_BOUNDARY_CONDITION;
+	config->kernel_precision = DEFAULT_KERNEL_PRECISION;
+	config->softening_law = DEFAULT_SOFTENING_LAW;
+	config->reduction_mode = DEFAULT_REDUCTION_MODE;
+	config->shared_memory_name = nullptr;
+}
+
+nbody_simulation* nbody_create(const nbody_config* config) {
+	if (config == nullptr || config->particle_count == 0 || config->universe_size_x == 0 || config->universe_size_y == 0 ||
+		config->initial_condition < UNIFORM_RANDOM || config->initial_condition > SONEIRA_PEEBLES_CLUSTERS ||
+		config->engine < ENGINE_SERIAL || config->engine > ENGINE_TREE_PM ||
+		config->boundary_condition < BOUNDARY_REFLECTIVE || config->boundary_condition > BOUNDARY_PERIODIC ||
+		config->kernel_precision < PRECISION_FLOAT || config->kernel_precision > PRECISION_COMPENSATED ||
+		config->softening_law < SOFTENING_CLAMP || config->softening_law > SOFTENING_SPLINE ||
+		config->reduction_mode < REDUCTION_FAST || config->reduction_mode > REDUCTION_DETERMINISTIC)
+		return nullptr;
+
+	std::unique_ptr<nbody_simulation> simulation(new nbody_simulation());
+	simulation->shared_header = nullptr;
+	simulation->shared_size = 0;
+#ifdef _WIN32
+	simulation->mapping_handle = nullptr;
+#endif
+
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(static_cast<InitialCondition>(config->initial_condition), config->particle_count,
+		particles, config->universe_size_x, config->universe_size_y, config->seed);
+	simulation->simulation.reset(new Simulation(static_cast<SimulationEngine>(config->engine), "api", particles,
+		config->universe_size_x, config->universe_size_y, config->time_step, 0.0f,
+		static_cast<BoundaryCondition>(config->boundary_condition)));
+	if (!simulation->simulation->set_interaction_kernel(static_cast<KernelPrecision>(config->kernel_precision),
+		static_cast<SofteningLaw>(config->softening_law), DEFAULT_ACCUMULATE_POTENTIAL))
+		return nullptr; // Periodic universes only have the float clamped kernel
+	simulation->simulation->set_reduction_mode(static_cast<ReductionMode>(config->reduction_mode));
+	simulation->particle_capacity = particles.size(); // Merging collisions only lowers the count
+
+	if (config->shared_memory_name != nullptr) {
+		if (!place_in_shared_memory(*simulation, config->shared_memory_name))
+			return nullptr;
+	} else {
+		simulation->private_columns.resize(NBODY_COLUMN_COUNT * simulation->particle_capacity);
+		for (size_t column = 0; column < NBODY_COLUMN_COUNT; ++column)
+			simulation->columns[column] = simulation->private_columns.data() + column * simulation->particle_capacity;
+	}
+	publish_columns(*simulation);
+	return simulation.release();
+}
+
+void nbody_destroy(nbody_simulation* simulation) {
+	if (simulation == nullptr)
+		return;
+
+	if (simulation->shared_header != nullptr) {
+		unmap_shared_memory(simulation->shared_header, simulation->shared_size);
+#ifdef _WIN32
+		CloseHandle(simulation->mapping_handle);
+#else
+		shm_unlink(simulation->shared_name.c_str()); // Attached readers keep their mapping
+#endif
+	}
+	delete simulation;
+}
+
+// Advance with the configured engine, readers see the particles of the last step only
+int nbody_step(nbody_simulation* simulation, unsigned step_count) {
+	if (simulation == nullptr)
+		return NBODY_ERROR_INVALID_ARGUMENT;
+
+	for (unsigned step = 0; step < step_count; ++step)
+		simulation->simulation->step();
+	publish_columns(*simulation);
+	return NBODY_OK;
+}
+
+size_t nbody_get_particle_count(const nbody_simulation* simulation) {
+	return simulation != nullptr ? simulation->particle_count : 0;
+}
+
+double nbody_get_time(const nbody_simulation* simulation) {
+	return simulation != nullptr ? simulation->simulation->get_time() : 0.0;
+}
+
+const float* nbody_get_column(const nbody_simulation* simulation, int column) {
+	if (simulation == nullptr || column < 0 || column >= NBODY_COLUMN_COUNT)
+		return nullptr;
+	return simulation->columns[column];
+}
+
+const nbody_shared_header* nbody_attach_shared(const char* shared_memory_name) {
+	if (shared_memory_name == nullptr)
+		return nullptr;
+
+	size_t mapped_size;
+	void* handle;
+	const nbody_shared_header* header = static_cast<const nbody_shared_header*>(map_shared_memory(shared_memory_name, 0, false,
+		mapped_size, handle));
+	if (header == nullptr)
+		return nullptr;
+
+	if (memcmp(header->magic, SHARED_MEMORY_MAGIC, sizeof(SHARED_MEMORY_MAGIC)) != 0 || header->version != NBODY_API_VERSION ||
+		header->column_count != NBODY_COLUMN_COUNT || header->segment_size > mapped_size) {
+		unmap_shared_memory(header, mapped_size);
+		return nullptr;
+	}
+	return header;
+}
+
+void nbody_detach_shared(const nbody_shared_header* header) {
+	if (header != nullptr)
+		unmap_shared_memory(header, static_cast<size_t>(header->segment_size));
+}
+
+const float* nbody_get_shared_column(const nbody_shared_header* header, int column) {
+	if (header == nullptr || column < 0 || column >= NBODY_COLUMN_COUNT)
+		return nullptr;
+	return reinterpret_cast<const float*>(reinterpret_cast<const char*>(header) + header->column_offset[column]);
+}
+
+// Reader side of the seqlock, an odd counter means the writer is inside publish_columns
+uint64_t nbody_read_begin(const nbody_shared_header* header) {
+	uint64_t sequence = header->sequence.load(std::memory_order_acquire);
+	while (sequence & 1) {
+		std::this_thread::yield();
+		sequence = header->sequence.load(std::memory_order_acquire);
+	}
+	return sequence;
+}
+
+int nbody_read_retry(const nbody_shared_header* header, uint64_t sequence) {
+	std::atomic_thread_fence(std::memory_order_acquire); // The copy is complete before the counter is read again
+	return header->sequence.load(std::memory_order_relaxed) != sequence;
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+/* C interface of the simulation, for analysis tools that link the simulation or attach to its shared memory */
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __cplusplus
+#include <atomic>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NBODY_API_VERSION 2
+
+/* Error codes returned by the api */
+#define NBODY_OK 0
+#define NBODY_ERROR_INVALID_ARGUMENT 1
+#define NBODY_ERROR_SHARED_MEMORY 2
+
+/* Columns of the published particles, one float per particle each */
+#define NBODY_COLUMN_X 0
+#define NBODY_COLUMN_Y 1
+#define NBODY_COLUMN_VELOCITY_X 2
+#define NBODY_COLUMN_VELOCITY_Y 3
+#define NBODY_COLUMN_MASS 4
+#define NBODY_COLUMN_COUNT 5
+
+typedef struct nbody_simulation nbody_simulation;
+
+/* Parameters of a new simulation */
+typedef struct nbody_config {
+	size_t particle_count;
+	size_t universe_size_x;
+	size_t universe_size_y;
+	float time_step;
+	uint64_t seed;
+	int initial_condition; /* One of the InitialCondition values of Settings.h */
+	int engine; /* One of the SimulationEngine values of Simulation.h */
+	int boundary_condition; /* BoundaryCondition of Settings.h */
+	int kernel_precision; /* KernelPrecision of Settings.h, for the direct sum and Barnes-Hut engines */
+	int softening_law; /* SofteningLaw of Settings.h, for the direct sum and Barnes-Hut engines. Periodic universes only take the float clamped kernel */
+	int reduction_mode; /* ReductionMode of Settings.h */
+	const char* shared_memory_name; /* Publish the particles in this shared memory segment, NULL keeps them private */
+} nbody_config;
+
+/* Sequence counter of the shared memory, lock-free 64 bit. C readers only access it through nbody_read_begin and nbody_read_retry */
+#ifdef __cplusplus
+typedef std::atomic<uint64_t> nbody_sequence_counter;
+#else
+typedef uint64_t nbody_sequence_counter;
+#endif
+
+/* Start of the shared memory segment, the columns follow at their offsets */
+typedef struct nbody_shared_header {
+	char magic[8]; /* "NBODYSHM" */
+	uint32_t version;
+	uint32_t column_count; /* NBODY_COLUMN_COUNT */
+	uint64_t segment_size;
+	uint64_t particle_capacity; /* Floats reserved per column */
+	uint64_t column_offset[NBODY_COLUMN_COUNT]; /* From the start of the segment */
+	nbody_sequence_counter sequence; /* Odd while a step publishes the columns */
+	uint64_t particle_count; /* Published with the columns, merging collisions lowers it */
+	double time; /* Published with the columns */
+} nbody_shared_header;
+
+void nbody_default_config(nbody_config* config);
+nbody_simulation* nbody_create(const nbody_config* config); /* NULL when the configuration or the shared memory is invalid */
+void nbody_destroy(nbody_simulation* simulation);
+int nbody_step(nbody_simulation* simulation, unsigned step_count); /* Publishes the columns once the steps are done */
+
+size_t nbody_get_particle_count(const nbody_simulation* simulation);
+double nbody_get_time(const nbody_simulation* simulation);
+
+/* Column of the last published particles, valid until the simulation is destroyed. NULL for an unknown column */
+const float* nbody_get_column(const nbody_simulation* simulation, int column);
+
+/* Read-only view of the shared memory of a running simulation, from another process */
+const nbody_shared_header* nbody_attach_shared(const char* shared_memory_name);
+void nbody_detach_shared(const nbody_shared_header* header);
+const float* nbody_get_shared_column(const nbody_shared_header* header, int column);
+
+/* Seqlock of the shared columns. Copy particle_count, time and the columns between the two calls,
+   and copy again while nbody_read_retry returns nonzero:
+       do { sequence = nbody_read_begin(header); ...copy... } while (nbody_read_retry(header, sequence)); */
+uint64_t nbody_read_begin(const nbody_shared_header* header); /* Waits while a step publishes */
+int nbody_read_retry(const nbody_shared_header* header, uint64_t sequence);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+#include "OutputPipeline.h"
+#include "ParticleHandler.h"
+
+OutputPipeline::OutputPipeline(uint64_t seed, size_t capacity) : capacity_(capacity > 0 ? capacity : 1), reserved_slots_(0), busy_(false),
+	stopping_(false), seed_(seed) {
+	worker_ = std::thread(&OutputPipeline::run, this);
+}
+
+// Save the remaining frames before stopping the worker
+OutputPipeline::~OutputPipeline() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	frame_ready_.notify_all();
+	worker_.join();
+}
+
+// Wait for a free queue slot and hand out a recycled buffer for the copy
+std::vector<Particle> OutputPipeline::reserve_slot() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	frame_done_.wait(lock, [this] { return queue_.size() + reserved_slots_ < capacity_; });
+	++reserved_slots_;
+
+	std::vector<Particle> buffer;
+	if (!free_buffers_.empty()) {
+		buffer = std::move(free_buffers_.back());
+		free_buffers_.pop_back();
+	}
+	return buffer;
+}
+
+void OutputPipeline::enqueue(Frame&& frame) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		--reserved_slots_;
+		queue_.push_back(std::move(frame));
+	}
+	frame_ready_.notify_one();
+}
+
+// Worker loop, encodes frames in submission order
+void OutputPipeline::run() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;) {
+		frame_ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+		if (queue_.empty())
+			break; // Stopping and nothing left to save
+
+		Frame frame = std::move(queue_.front());
+		queue_.pop_front();
+		busy_ = true;
+
+		lock.unlock();
+		if (frame.streamed)
+			stream_frame(frame);
+		else
+			ParticleHandler::universe_to_png(frame.particles, frame.universe_size_x, frame.universe_size_y, frame.filename.c_str());
+		lock.lock();
+
+		busy_ = false;
+		free_buffers_.push_back(std::move(frame.particles));
+		frame_done_.notify_all();
+	}
+}
+
+// Rasterize a frame and append it to its stream, the stream is opened by its first frame
+void OutputPipeline::stream_frame(const Frame& frame) {
+	std::unique_ptr<FrameSink>& frame_sink = frame_sinks_[frame.filename];
+	if (!frame_sink)
+		frame_sink.reset(new FrameSink(frame.filename, DEFAULT_FRAME_STREAM_ENCODING, frame.universe_size_y, frame.universe_size_x,
+			seed_));
+
+	ParticleHandler::rasterize_universe(frame.particles, frame.universe_size_x, frame.universe_size_y, levels_);
+	frame_sink->write_frame(levels_, frame.time);
+}
+
+void OutputPipeline::flush() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	frame_done_.wait(lock, [this] { return queue_.empty() && reserved_slots_ == 0 && !busy_; });
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "Particle.h"
+#include "Settings.h"
+#include "FrameSink.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Background image output. The simulation only copies the particles into a recycled buffer, a worker thread
+// rasterizes and encodes the frames. The queue is bounded, a full queue makes the simulation wait for the worker
+class OutputPipeline {
+	struct Frame {
+		std::vector<Particle> particles;
+		size_t universe_size_x;
+		size_t universe_size_y;
+		std::string filename; // Png file, or frame stream when the frame is streamed
+		bool streamed;
+		double time;
+	};
+
+	std::mutex mutex_;
+	std::condition_variable frame_ready_;
+	std::condition_variable frame_done_;
+	std::deque<Frame> queue_;
+	std::vector<std::vector<Particle>> free_buffers_; // Buffers of encoded frames, reused by the next submissions
+	size_t capacity_;
+	size_t reserved_slots_; // Slots taken by submissions that are still copying
+	bool busy_; // The worker is encoding a frame
+	bool stopping_;
+	std::thread worker_;
+	std::map<std::string, std::unique_ptr<FrameSink>> frame_sinks_; // Open frame streams, only used by the worker
+	std::vector<uint8_t> levels_; // Rasterized frame of the worker
+	uint64_t seed_;
+
+	std::vector<Particle> reserve_slot();
+	void enqueue(Frame&& frame);
+	void run();
+	void stream_frame(const Frame& frame);
+public:
+	explicit OutputPipeline(uint64_t seed, size_t capacity = OUTPUT_QUEUE_CAPACITY); // Seed of the run, written in the frame streams
+	~OutputPipeline();
+	OutputPipeline(const OutputPipeline&) = delete;
+	OutputPipeline& operator=(const OutputPipeline&) = delete;
+
+	// Copy the particles and queue them to be saved as png, any indexable particle container can be submitted
+	template <typename Container>
+	void submit_png(const Container& particles, size_t particle_count, size_t universe_size_x, size_t universe_size_y,
+		const std::string& filename) {
+		submit(particles, particle_count, universe_size_x, universe_size_y, filename, false, 0.0);
+	}
+
+	// Queue an intermediate frame of a simulation, as a png per frame or appended to the frame stream of the simulation
+	template <typename Container>
+	void submit_step(const Container& particles, size_t particle_count, size_t universe_size_x, size_t universe_size_y,
+		const std::string& simulation_name, double time) {
+		if (STREAM_INTERMEDIATE_FRAMES)
+			submit(particles, particle_count, universe_size_x, universe_size_y, simulation_name + ".frames", true, time);
+		else
+			submit(particles, particle_count, universe_size_x, universe_size_y, simulation_name + "_timestep_" + std::to_string(time) + ".png",
+				false, time);
+	}
+
+	template <typename Container>
+	void submit(const Container& particles, size_t particle_count, size_t universe_size_x, size_t universe_size_y,
+		const std::string& filename, bool streamed, double time) {
+		Frame frame;
+		frame.particles = reserve_slot();
+		frame.particles.resize(particle_count);
+		for (size_t index = 0; index < particle_count; ++index)
+			frame.particles[index] = particles[index];
+		frame.universe_size_x = universe_size_x;
+		frame.universe_size_y = universe_size_y;
+		frame.filename = filename;
+		frame.streamed = streamed;
+		frame.time = time;
+		enqueue(std::move(frame));
+	}
+
+	void flush(); // Block until every queued frame is saved
+};
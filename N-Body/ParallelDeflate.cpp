@@ -0,0 +1,105 @@
+#include "ParallelDeflate.h"
+#include "Settings.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <tbb/parallel_for.h>
+
+static const unsigned ADLER_BASE = 65521; // Largest prime below 2^16
+
+// Same combination as zlib's adler32_combine
+unsigned adler32_combine(unsigned first_adler, unsigned second_adler, size_t second_size) {
+	uint64_t remainder = second_size % ADLER_BASE;
+	uint64_t sum_1 = first_adler & 0xffff;
+	uint64_t sum_2 = (remainder * sum_1) % ADLER_BASE;
+
+	sum_1 += (second_adler & 0xffff) + ADLER_BASE - 1;
+	sum_2 += ((first_adler >> 16) & 0xffff) + ((second_adler >> 16) & 0xffff) + ADLER_BASE - remainder;
+
+	if (sum_1 >= ADLER_BASE) sum_1 -= ADLER_BASE;
+	if (sum_1 >= ADLER_BASE) sum_1 -= ADLER_BASE;
+	if (sum_2 >= (static_cast<uint64_t>(ADLER_BASE) << 1)) sum_2 -= (static_cast<uint64_t>(ADLER_BASE) << 1);
+	if (sum_2 >= ADLER_BASE) sum_2 -= ADLER_BASE;
+
+	return static_cast<unsigned>(sum_1 | (sum_2 << 16));
+}
+
+// Deflated data and checksum of one input chunk
+struct DeflateChunk {
+	unsigned char* data = nullptr;
+	size_t size = 0;
+	unsigned adler = 1;
+	unsigned error = 0;
+};
+
+unsigned parallel_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize,
+	const LodePNGCompressSettings* settings) {
+
+	// The chunks are compressed by lodepng itself
+	LodePNGCompressSettings chunk_settings = *settings;
+	chunk_settings.custom_zlib = nullptr;
+	chunk_settings.custom_deflate = nullptr;
+
+	size_t chunk_count = (insize + PARALLEL_DEFLATE_CHUNK_SIZE - 1) / PARALLEL_DEFLATE_CHUNK_SIZE;
+	if (chunk_count < 2) // Not worth splitting
+		return lodepng_zlib_compress(out, outsize, in, insize, &chunk_settings);
+
+	std::vector<DeflateChunk> chunks(chunk_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, chunk_count, 1),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t chunk = r.begin(); chunk != r.end(); ++chunk) {
+			size_t start = chunk * PARALLEL_DEFLATE_CHUNK_SIZE;
+			size_t size = std::min(PARALLEL_DEFLATE_CHUNK_SIZE, insize - start);
+			unsigned final = chunk == chunk_count - 1;
+
+			chunks[chunk].error = lodepng_deflate_partial(&chunks[chunk].data, &chunks[chunk].size, in + start, size,
+				&chunk_settings, final);
+			chunks[chunk].adler = lodepng_update_adler32(1, in + start, static_cast<unsigned>(size));
+		}
+	}); // Implicit barrier
+
+	// Stitch the zlib header, the deflated chunks and the combined checksum
+	unsigned error = 0;
+	size_t deflated_size = 0;
+	unsigned adler = 1;
+	for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+		if (chunks[chunk].error && !error)
+			error = chunks[chunk].error;
+		deflated_size += chunks[chunk].size;
+
+		size_t size = std::min(PARALLEL_DEFLATE_CHUNK_SIZE, insize - chunk * PARALLEL_DEFLATE_CHUNK_SIZE);
+		adler = chunk == 0 ? chunks[chunk].adler : adler32_combine(adler, chunks[chunk].adler, size);
+	}
+
+	if (!error) {
+		// lodepng releases the output with free(), as long as its default allocators are compiled
+		unsigned char* stream = static_cast<unsigned char*>(realloc(*out, *outsize + 2 + deflated_size + 4));
+		if (stream == nullptr) {
+			error = 83; // lodepng's allocation failure code
+		} else {
+			unsigned char* position = stream + *outsize;
+			*position++ = 0x78; // CM 8 with a 32K window
+			*position++ = 0x01; // No dictionary, FCHECK makes the header a multiple of 31
+
+			for (const DeflateChunk& current_chunk : chunks) {
+				memcpy(position, current_chunk.data, current_chunk.size);
+				position += current_chunk.size;
+			}
+
+			*position++ = static_cast<unsigned char>(adler >> 24);
+			*position++ = static_cast<unsigned char>(adler >> 16);
+			*position++ = static_cast<unsigned char>(adler >> 8);
+			*position++ = static_cast<unsigned char>(adler);
+
+			*out = stream;
+			*outsize = static_cast<size_t>(position - stream);
+		}
+	}
+
+	for (DeflateChunk& current_chunk : chunks)
+		free(current_chunk.data);
+
+	return error;
+}
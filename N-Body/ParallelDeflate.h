@@ -0,0 +1,11 @@
+#pragma once
+#include "lodepng.h"
+
+// Multithreaded zlib compression for lodepng, in the style of pigz. The input is split in chunks that are deflated
+// concurrently, every chunk but the last ends with a sync flush so the pieces concatenate into one valid stream,
+// and the adler32 checksums of the chunks are combined. Plug it in LodePNGCompressSettings::custom_zlib
+unsigned parallel_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in, size_t insize,
+	const LodePNGCompressSettings* settings);
+
+// Checksum of two concatenated buffers from the checksums of both buffers and the size of the second one
+unsigned adler32_combine(unsigned first_adler, unsigned second_adler, size_t second_size);
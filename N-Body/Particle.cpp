@@ -2,38 +2,25 @@
 #include "Particle.h"
 #include <cmath>
 #include "Settings.h"
+#include "InteractionKernel.h"
 
 // Apply acceleration on both particles in one sweep
 void Particle::add_acceleration_pairwise(Particle& interacting_particle) {
 
 	// We calculate the acceleration instead of the forces for faster calculation
-
-	// Get distances
-	float dx = interacting_particle.x_ - x_;
-	float dy = interacting_particle.y_ - y_;
-
-	// Square of distances
-	float distance_square = dx * dx + dy * dy;
-
-	// Keep a minimum square of distance
-	if (distance_square < MIN_DISTANCE)
-		distance_square = MIN_DISTANCE;
-
-	float distance = sqrt(distance_square);
-
-	velocity_x_ = dx / distance;
-	velocity_y_ = dy / distance;
-
-	// Use the mass of the other particle
-	float acceleration_factor = (GRAVITATIONAL_CONSTANT / distance_square) * interacting_particle.mass_;
-	float interacting_acceleration_factor = (GRAVITATIONAL_CONSTANT / distance_square) * mass_;
-
-	// Apply accelerations
-	acceleration_x_ -= acceleration_factor * velocity_x_;
-	acceleration_y_ -= acceleration_factor * velocity_y_;
-	
-	interacting_particle.acceleration_x_ += interacting_acceleration_factor * velocity_x_;
-	interacting_particle.acceleration_y_ += interacting_acceleration_factor * velocity_y_;
+	const float displacement[2] = { interacting_particle.x_ - x_, interacting_particle.y_ - y_ };
+	float acceleration[2] = { acceleration_x_, acceleration_y_ };
+	float interacting_acceleration[2] = { interacting_particle.acceleration_x_, interacting_particle.acceleration_y_ };
+	float potential = 0.0f, interacting_potential = 0.0f; // Not accumulated by the default kernel
+
+	// Both particles are pulled towards each other
+	DefaultKernel::add_acceleration_pairwise(displacement, mass_, interacting_particle.mass_, acceleration, interacting_acceleration, potential,
+		interacting_potential);
+
+	acceleration_x_ = acceleration[0];
+	acceleration_y_ = acceleration[1];
+	interacting_particle.acceleration_x_ = interacting_acceleration[0];
+	interacting_particle.acceleration_y_ = interacting_acceleration[1];
 }
 
 // Aquire the distance of the particle from another particle
@@ -45,67 +32,28 @@ float Particle::get_distance(const Particle& second_particle) const {
 	// Square of distances
 	float distance_square = dx * dx + dy * dy;
 
-	// Keep a minimum square of distance
-	if (distance_square < MIN_DISTANCE)
-		distance_square = MIN_DISTANCE;
-
-	return sqrt(distance_square);
+	return sqrt(ClampSoftening::soften(distance_square)); // Keep a minimum square of distance
 }
 
 // Apply acceleration on one particle from a center of mass
 void Particle::add_acceleration(float total_mass, float center_of_mass_x, float center_of_mass_y) {
+	const float displacement[2] = { center_of_mass_x - x_, center_of_mass_y - y_ };
+	float acceleration[2] = { acceleration_x_, acceleration_y_ };
+	float potential = 0.0f;
 
-	// Get distances
-	float dx = center_of_mass_x - x_;
-	float dy = center_of_mass_y - y_;
-
-	// Square of distances
-	float distance_square = dx * dx + dy * dy;
-
-	// Keep a minimum square of distance
-	if (distance_square < MIN_DISTANCE)
-		distance_square = MIN_DISTANCE;
-
-	float distance = sqrt(distance_square);
+	DefaultKernel::add_acceleration(displacement, total_mass, acceleration, potential);
 
-	velocity_x_ = dx / distance;
-	velocity_y_ = dy / distance;
-
-	float acceleration_factor = (GRAVITATIONAL_CONSTANT / distance_square) * total_mass;
-
-	// Apply accelerations
-	acceleration_x_ -= acceleration_factor * velocity_x_;
-	acceleration_y_ -= acceleration_factor * velocity_y_;
+	acceleration_x_ = acceleration[0];
+	acceleration_y_ = acceleration[1];
 }
 
 // Apply acceleration on one particle from forces of another particle
 void Particle::add_acceleration(const Particle& interacting_particle) {
-
-	// Get distances
-	float dx = interacting_particle.x_ - x_;
-	float dy = interacting_particle.y_ - y_;
-
-	// Square of distances
-	float distance_square = dx * dx + dy * dy;
-	
-	// Keep a minimum square of distance
-	if (distance_square < MIN_DISTANCE)
-		distance_square = MIN_DISTANCE;
-	
-	float distance = sqrt(distance_square);
-
-	velocity_x_ = dx / distance;
-	velocity_y_ = dy / distance;		
-
-	float acceleration_factor = (GRAVITATIONAL_CONSTANT / distance_square) * interacting_particle.mass_;
-
-	// Apply accelerations
-	acceleration_x_ -= acceleration_factor * velocity_x_;
-	acceleration_y_ -= acceleration_factor * velocity_y_;
+	add_acceleration(interacting_particle.mass_, interacting_particle.x_, interacting_particle.y_);
 }
 
-// Moves the current particle for a specific time
-void Particle::advance(float time_step) {
+// Moves the current particle for a specific time, bouncing on the walls of the universe
+void Particle::advance(float time_step, float size_x, float size_y) {
 
 	// Add accelerations on velocities
 	velocity_x_ += time_step * acceleration_x_;
@@ -119,17 +67,17 @@ void Particle::advance(float time_step) {
 	if (x_ < 0) {
 		velocity_x_ *= -1;
 		x_ = 0;
-	} else if (x_ > UNIVERSE_SIZE_X) {
+	} else if (x_ > size_x) {
 		velocity_x_ *= -1;
-		x_ = UNIVERSE_SIZE_X;
+		x_ = size_x;
 	}
 	
 	if (y_ < 0) {
 		velocity_y_ *= -1;
 		y_ = 0;
-	} else if (y_ > UNIVERSE_SIZE_Y) {
+	} else if (y_ > size_y) {
 		velocity_y_ *= -1;
-		y_ = UNIVERSE_SIZE_Y;
+		y_ = size_y;
 	}
 
 	// Reset accelerations
@@ -137,6 +85,30 @@ void Particle::advance(float time_step) {
 	acceleration_y_ = 0.0;
 }
 
+// Moves the current particle for a specific time, leaving one side of the periodic universe enters it from the other
+void Particle::advance_periodic(float time_step, float size_x, float size_y) {
+
+	// Add accelerations on velocities
+	velocity_x_ += time_step * acceleration_x_;
+	velocity_y_ += time_step * acceleration_y_;
+
+	// Get the new position
+	x_ += velocity_x_ * time_step;
+	y_ += velocity_y_ * time_step;
+
+	// Wrap around, the upper limit belongs to the next period
+	x_ -= size_x * floor(x_ / size_x);
+	y_ -= size_y * floor(y_ / size_y);
+	if (x_ >= size_x)
+		x_ = 0.0f;
+	if (y_ >= size_y)
+		y_ = 0.0f;
+
+	// Reset accelerations
+	acceleration_x_ = 0.0;
+	acceleration_y_ = 0.0;
+}
+
 // Combine two particles into one by adding them
 Particle Particle::operator+(const Particle& r) const {
 	return Particle(x_ + r.x_, y_ + r.y_, velocity_x_ + r.velocity_x_, velocity_y_ + r.velocity_y_, mass_ + r.mass_,
@@ -39,7 +39,8 @@ public:
 	float get_distance(const Particle& second_particle) const;
 	void add_acceleration(float total_mass, float center_of_mass_x, float center_of_mass_y);
 	void add_acceleration(const Particle& interacting_particle);
-	void advance(float time_stamp);
+	void advance(float time_step, float size_x, float size_y);
+	void advance_periodic(float time_step, float size_x, float size_y);
 	Particle operator+(const Particle& r) const;
 	Particle operator-(const Particle& r) const;
 	Particle operator*(float r) const;
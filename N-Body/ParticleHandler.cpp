@@ -1,23 +1,271 @@
-#include <random>
+#define _USE_MATH_DEFINES // M_PI on Visual C++
+#include <cmath>
+#include <algorithm>
 #include "Settings.h"
 #include "ParticleHandler.h"
 #include <tbb/concurrent_vector.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <limits>
+#include "PhiloxRandom.h"
 #include "lodepng.h"
+#include "ParallelDeflate.h"
 #include "TreeParticle.h"
 #include "QuadParticleTree.h"
 
-// Generate random particles
-void ParticleHandler::allocate_random_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y) {
+// Generate random particles in parallel. Each particle draws from its own Philox counter, so the same seed
+// produces the same universe for any number of threads
+void ParticleHandler::allocate_random_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y,
+	uint64_t seed) {
 	if (particle_count > 0) {
-		std::random_device random_device_;
-		std::mt19937 mt_engine(random_device_());
-		std::uniform_real_distribution<> real_position_x(0, static_cast<float>(size_x));
-		std::uniform_real_distribution<> real_position_y(0, static_cast<float>(size_y));
-		std::uniform_real_distribution<> real_mass(0, MAX_MASS);
-
-		for (size_t i = 0; i < particle_count; ++i)
-			particles.push_back(Particle(static_cast<float>(real_position_x(mt_engine)), static_cast<float>(real_position_y(mt_engine)),
-				0.0f, 0.0f, static_cast<float>(real_mass(mt_engine)), 0.0f, 0.0f));
+		const PhiloxRandom random(seed);
+		const float position_x_scale = static_cast<float>(size_x);
+		const float position_y_scale = static_cast<float>(size_y);
+
+		size_t first_particle = particles.size();
+		particles.resize(first_particle + particle_count);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count, PARTICLE_GENERATION_GRAIN),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+				PhiloxRandom::Block block = random.generate(index);
+				particles[first_particle + index] = Particle(PhiloxRandom::to_unit_float(block.word[0]) * position_x_scale,
+					PhiloxRandom::to_unit_float(block.word[1]) * position_y_scale,
+					0.0f, 0.0f, PhiloxRandom::to_unit_float(block.word[2]) * MAX_MASS, 0.0f, 0.0f);
+			}
+		}); // Implicit barrier
+	}
+}
+
+// Modified Bessel functions of the first and second kind, polynomial approximations from Abramowitz & Stegun 9.8
+static double bessel_i0(double x) {
+	double t = x / 3.75;
+	if (x <= 3.75) {
+		t *= t;
+		return 1.0 + t * (3.5156229 + t * (3.0899424 + t * (1.2067492 + t * (0.2659732 + t * (0.0360768 + t * 0.0045813)))));
+	}
+	t = 1.0 / t;
+	return (exp(x) / sqrt(x)) * (0.39894228 + t * (0.01328592 + t * (0.00225319 + t * (-0.00157565 + t * (0.00916281 +
+		t * (-0.02057706 + t * (0.02635537 + t * (-0.01647633 + t * 0.00392377))))))));
+}
+
+static double bessel_i1(double x) {
+	double t = x / 3.75;
+	if (x <= 3.75) {
+		t *= t;
+		return x * (0.5 + t * (0.87890594 + t * (0.51498869 + t * (0.15084934 + t * (0.02658733 + t * (0.00301532 + t * 0.00032411))))));
+	}
+	t = 1.0 / t;
+	return (exp(x) / sqrt(x)) * (0.39894228 + t * (-0.03988024 + t * (-0.00362018 + t * (0.00163801 + t * (-0.01031555 +
+		t * (0.02282967 + t * (-0.02895312 + t * (0.01787654 - t * 0.00420059))))))));
+}
+
+static double bessel_k0(double x) {
+	if (x <= 2.0) {
+		double u = x * x / 4.0;
+		return -log(x / 2.0) * bessel_i0(x) + (-0.57721566 + u * (0.42278420 + u * (0.23069756 + u * (0.03488590 +
+			u * (0.00262698 + u * (0.00010750 + u * 0.00000740))))));
+	}
+	double w = 2.0 / x;
+	return (exp(-x) / sqrt(x)) * (1.25331414 + w * (-0.07832358 + w * (0.02189568 + w * (-0.01062446 + w * (0.00587872 +
+		w * (-0.00251540 + w * 0.00053208))))));
+}
+
+static double bessel_k1(double x) {
+	if (x <= 2.0) {
+		double u = x * x / 4.0;
+		return log(x / 2.0) * bessel_i1(x) + (1.0 / x) * (1.0 + u * (0.15443144 + u * (-0.67278579 + u * (-0.18156897 +
+			u * (-0.01919402 + u * (-0.00110404 - u * 0.00004686))))));
+	}
+	double w = 2.0 / x;
+	return (exp(-x) / sqrt(x)) * (1.25331414 + w * (0.23498619 + w * (-0.03655620 + w * (0.01504268 + w * (-0.00780353 +
+		w * (0.00325614 - w * 0.00068245))))));
+}
+
+// Keep a generated position inside the universe limits
+static float clamp_to_universe(float position, float size) {
+	return std::min(std::max(position, 0.0f), size);
+}
+
+// Generate a Plummer sphere (Aarseth, Henon & Wielen 1974) projected on the universe plane. Positions and isotropic
+// velocities are drawn in 3D so that the projected system keeps the velocity dispersion of the full sphere
+void ParticleHandler::allocate_plummer_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y,
+	uint64_t seed) {
+	if (particle_count > 0) {
+		const PhiloxRandom random(seed);
+		const float center_x = static_cast<float>(size_x) / 2.0f;
+		const float center_y = static_cast<float>(size_y) / 2.0f;
+		const double max_radius = std::min(center_x, center_y);
+		const double scale_radius = PLUMMER_RADIUS_FRACTION * max_radius;
+		const float particle_mass = MAX_MASS / 2.0f; // Same total mass as the uniform universe
+		const double total_mass = static_cast<double>(particle_mass) * particle_count;
+
+		// Fraction of the mass inside the truncation radius, samples are drawn only within it
+		const double max_mass_fraction = pow(max_radius * max_radius / (max_radius * max_radius + scale_radius * scale_radius), 1.5);
+
+		size_t first_particle = particles.size();
+		particles.resize(first_particle + particle_count);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count, PARTICLE_GENERATION_GRAIN),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+				PhiloxRandom::Block block = random.generate(index, 0);
+
+				// Radius from the inverted cumulative mass profile
+				double mass_fraction = std::max(PhiloxRandom::to_unit_float(block.word[0]) * max_mass_fraction, 1e-12);
+				double radius = scale_radius / sqrt(pow(mass_fraction, -2.0 / 3.0) - 1.0);
+
+				// Isotropic direction, projected on the plane
+				double cos_theta = 2.0 * PhiloxRandom::to_unit_float(block.word[1]) - 1.0;
+				double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+				double phi = 2.0 * M_PI * PhiloxRandom::to_unit_float(block.word[2]);
+				float x = center_x + static_cast<float>(radius * sin_theta * cos(phi));
+				float y = center_y + static_cast<float>(radius * sin_theta * sin(phi));
+
+				// Speed as a fraction of the escape velocity, von Neumann rejection on q^2 (1 - q^2)^3.5
+				double escape_velocity = sqrt(2.0 * GRAVITATIONAL_CONSTANT * total_mass) *
+					pow(radius * radius + scale_radius * scale_radius, -0.25);
+				double q = 0.0;
+				for (uint32_t stream = 1; ; ++stream) {
+					PhiloxRandom::Block rejection_block = random.generate(index, stream);
+					q = PhiloxRandom::to_unit_float(rejection_block.word[0]);
+					double g = PhiloxRandom::to_unit_float(rejection_block.word[1]) * 0.1;
+					if (g < q * q * pow(1.0 - q * q, 3.5))
+						break;
+				}
+				double speed = q * escape_velocity;
+
+				cos_theta = 2.0 * PhiloxRandom::to_unit_float(block.word[3]) - 1.0;
+				sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+				phi = 2.0 * M_PI * PhiloxRandom::to_unit_float(random.generate(index, UINT32_MAX).word[0]);
+
+				particles[first_particle + index] = Particle(clamp_to_universe(x, static_cast<float>(size_x)),
+					clamp_to_universe(y, static_cast<float>(size_y)), static_cast<float>(speed * sin_theta * cos(phi)),
+					static_cast<float>(speed * sin_theta * sin(phi)), particle_mass, 0.0f, 0.0f);
+			}
+		}); // Implicit barrier
+	}
+}
+
+// Generate a rotating, razor thin exponential disk. Particles move on circular orbits with the exact circular velocity
+// of the exponential disk (Freeman 1970)
+void ParticleHandler::allocate_disk_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y,
+	uint64_t seed) {
+	if (particle_count > 0) {
+		const PhiloxRandom random(seed);
+		const float center_x = static_cast<float>(size_x) / 2.0f;
+		const float center_y = static_cast<float>(size_y) / 2.0f;
+		const double max_radius = std::min(center_x, center_y);
+		const double scale_length = max_radius / DISK_TRUNCATION_SCALE_LENGTHS;
+		const float particle_mass = MAX_MASS / 2.0f; // Same total mass as the uniform universe
+		const double total_mass = static_cast<double>(particle_mass) * particle_count;
+
+		// Central surface density, normalized so that the truncated disk holds the total mass
+		const double truncation = DISK_TRUNCATION_SCALE_LENGTHS;
+		const double max_mass_fraction = 1.0 - (1.0 + truncation) * exp(-truncation);
+		const double central_density = total_mass / (2.0 * M_PI * scale_length * scale_length * max_mass_fraction);
+
+		size_t first_particle = particles.size();
+		particles.resize(first_particle + particle_count);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count, PARTICLE_GENERATION_GRAIN),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+				PhiloxRandom::Block block = random.generate(index);
+
+				// Invert the cumulative mass 1 - (1 + x) e^-x by bisection, x is the radius in scale lengths
+				double mass_fraction = PhiloxRandom::to_unit_float(block.word[0]) * max_mass_fraction;
+				double low = 0.0, high = truncation;
+				for (int iteration = 0; iteration < 40; ++iteration) {
+					double middle = (low + high) / 2.0;
+					if (1.0 - (1.0 + middle) * exp(-middle) < mass_fraction)
+						low = middle;
+					else
+						high = middle;
+				}
+				double radius = std::max((low + high) / 2.0, 1e-6) * scale_length;
+				double phi = 2.0 * M_PI * PhiloxRandom::to_unit_float(block.word[1]);
+
+				// Circular velocity, v^2 = 4 pi G S0 h y^2 (I0 K0 - I1 K1) with y = R / 2h
+				double y = radius / (2.0 * scale_length);
+				double velocity_square = 4.0 * M_PI * GRAVITATIONAL_CONSTANT * central_density * scale_length * y * y *
+					(bessel_i0(y) * bessel_k0(y) - bessel_i1(y) * bessel_k1(y));
+				double speed = sqrt(std::max(velocity_square, 0.0));
+
+				// Counter-clockwise rotation
+				particles[first_particle + index] = Particle(
+					clamp_to_universe(center_x + static_cast<float>(radius * cos(phi)), static_cast<float>(size_x)),
+					clamp_to_universe(center_y + static_cast<float>(radius * sin(phi)), static_cast<float>(size_y)),
+					static_cast<float>(-speed * sin(phi)), static_cast<float>(speed * cos(phi)), particle_mass, 0.0f, 0.0f);
+			}
+		}); // Implicit barrier
+	}
+}
+
+// Generate a hierarchical clustered universe (Soneira & Peebles 1978). Every clump holds CLUSTER_SUBCLUMPS
+// smaller clumps, down to CLUSTER_LEVELS levels. The clump centers depend only on their path in the hierarchy,
+// so every particle can independently walk down to its own clump
+void ParticleHandler::allocate_clustered_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y,
+	uint64_t seed) {
+	if (particle_count > 0) {
+		const PhiloxRandom random(seed);
+		const PhiloxRandom clump_random(~seed); // Separate key for the shared clump centers
+		const float root_radius = std::min(static_cast<float>(size_x), static_cast<float>(size_y)) / 2.0f;
+
+		size_t first_particle = particles.size();
+		particles.resize(first_particle + particle_count);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count, PARTICLE_GENERATION_GRAIN),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+				float x = static_cast<float>(size_x) / 2.0f;
+				float y = static_cast<float>(size_y) / 2.0f;
+				float radius = root_radius;
+				uint64_t clump = 0; // Unique id of the clump path
+
+				for (int level = 0; level < CLUSTER_LEVELS; ++level) {
+					// Pick a sub-clump and move to its center, uniformly placed within the parent clump
+					uint32_t sub_clump = random.generate(index, level).word[0] % CLUSTER_SUBCLUMPS;
+					clump = clump * CLUSTER_SUBCLUMPS + sub_clump + 1;
+
+					PhiloxRandom::Block clump_block = clump_random.generate(clump);
+					float offset = radius * sqrt(PhiloxRandom::to_unit_float(clump_block.word[0]));
+					float angle = 2.0f * static_cast<float>(M_PI) * PhiloxRandom::to_unit_float(clump_block.word[1]);
+					x += offset * cos(angle);
+					y += offset * sin(angle);
+					radius /= CLUSTER_RADIUS_RATIO;
+				}
+
+				// Uniform position within the final clump
+				PhiloxRandom::Block block = random.generate(index, CLUSTER_LEVELS);
+				float offset = radius * sqrt(PhiloxRandom::to_unit_float(block.word[0]));
+				float angle = 2.0f * static_cast<float>(M_PI) * PhiloxRandom::to_unit_float(block.word[1]);
+
+				particles[first_particle + index] = Particle(clamp_to_universe(x + offset * cos(angle), static_cast<float>(size_x)),
+					clamp_to_universe(y + offset * sin(angle), static_cast<float>(size_y)),
+					0.0f, 0.0f, PhiloxRandom::to_unit_float(block.word[2]) * MAX_MASS, 0.0f, 0.0f);
+			}
+		}); // Implicit barrier
+	}
+}
+
+// Generate particles with the requested initial condition
+void ParticleHandler::allocate_particles(InitialCondition initial_condition, size_t particle_count, std::vector<Particle>& particles,
+	size_t size_x, size_t size_y, uint64_t seed) {
+	switch (initial_condition) {
+	case PLUMMER_SPHERE:
+		allocate_plummer_particles(particle_count, particles, size_x, size_y, seed);
+		break;
+	case EXPONENTIAL_DISK:
+		allocate_disk_particles(particle_count, particles, size_x, size_y, seed);
+		break;
+	case SONEIRA_PEEBLES_CLUSTERS:
+		allocate_clustered_particles(particle_count, particles, size_x, size_y, seed);
+		break;
+	default:
+		allocate_random_particles(particle_count, particles, size_x, size_y, seed);
+		break;
 	}
 }
 
@@ -47,30 +295,163 @@ std::vector<Particle> ParticleHandler::get_random_particles_Barns_Hut_sample() {
 	return particles;
 }
 
-// Generate an image from the given particle collection
-void ParticleHandler::universe_to_png(const std::vector<Particle>& universe, size_t universe_size_x, size_t universe_size_y, const char* filename) {
-	uint32_t width = static_cast<uint32_t>(universe_size_y);
-	uint32_t height = static_cast<uint32_t>(universe_size_x);
-	std::vector<uint8_t> image;
-	image.resize(width * height * 4);
-
-	// Paint all black
-	for (uint32_t x = 0; x < height; x++) {
-		for (uint32_t y = 0; y < width; y++) {
-			image[4 * width * x + 4 * y + 0] = 0;
-			image[4 * width * x + 4 * y + 1] = 0;
-			image[4 * width * x + 4 * y + 2] = 0;
-			image[4 * width * x + 4 * y + 3] = 255;
+// Colour ramp from density levels to RGBA, black for empty space then red, orange, yellow and white for the densest pixels
+const uint8_t* ParticleHandler::get_density_palette() {
+	static const struct DensityPalette {
+		uint8_t colours[256 * 4];
+
+		DensityPalette() {
+			for (int level = 0; level < 256; ++level) {
+				float t = level / 255.0f;
+				colours[4 * level + 0] = static_cast<uint8_t>(255.0f * std::min(1.0f, 3.0f * t));
+				colours[4 * level + 1] = static_cast<uint8_t>(255.0f * std::min(1.0f, std::max(0.0f, 3.0f * t - 1.0f)));
+				colours[4 * level + 2] = static_cast<uint8_t>(255.0f * std::min(1.0f, std::max(0.0f, 3.0f * t - 2.0f)));
+				colours[4 * level + 3] = 255;
+			}
+		}
+	} palette;
+	return palette.colours;
+}
+
+// Rasterize a particle collection into density levels, one byte per pixel. Every thread bins the particles of its ranges into
+// its own density tile, the tiles are then reduced and the summed mass is mapped to levels on a logarithmic scale
+void ParticleHandler::rasterize_universe(const std::vector<Particle>& universe, size_t universe_size_x, size_t universe_size_y,
+	std::vector<uint8_t>& levels) {
+	const size_t width = universe_size_y;
+	const size_t height = universe_size_x;
+	const size_t pixel_count = width * height;
+
+	// Bin the particles, positions outside the universe are skipped and the upper limits are clipped to the last pixel
+	tbb::enumerable_thread_specific<std::vector<float>> density_tiles([pixel_count]() { return std::vector<float>(pixel_count, 0.0f); });
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, universe.size(), RASTERIZER_GRAIN),
+		[&](const tbb::blocked_range<size_t>& r) {
+		std::vector<float>& density_tile = density_tiles.local();
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			const Particle& current_particle = universe[index];
+			if (!(current_particle.x_ >= 0.0f && current_particle.x_ <= static_cast<float>(height)) ||
+				!(current_particle.y_ >= 0.0f && current_particle.y_ <= static_cast<float>(width)))
+				continue; // Also skips NaN positions
+
+			size_t row = std::min(static_cast<size_t>(current_particle.x_), height - 1);
+			size_t column = std::min(static_cast<size_t>(current_particle.y_), width - 1);
+			density_tile[row * width + column] += current_particle.mass_;
+		}
+	}); // Implicit barrier
+
+	// Reduce the tiles and find the range of the non empty pixels
+	struct DensityRange {
+		float min, max;
+	};
+	std::vector<float> density(pixel_count);
+	DensityRange range = tbb::parallel_reduce(tbb::blocked_range<size_t>(0, pixel_count, RASTERIZER_GRAIN),
+		DensityRange{ std::numeric_limits<float>::max(), 0.0f },
+		[&](const tbb::blocked_range<size_t>& r, DensityRange local_range) {
+		for (size_t pixel = r.begin(); pixel != r.end(); ++pixel) {
+			float pixel_density = 0.0f;
+			for (const std::vector<float>& density_tile : density_tiles)
+				pixel_density += density_tile[pixel];
+			density[pixel] = pixel_density;
+
+			if (pixel_density > 0.0f) {
+				local_range.min = std::min(local_range.min, pixel_density);
+				local_range.max = std::max(local_range.max, pixel_density);
+			}
 		}
+		return local_range;
+	},
+		[](const DensityRange& left, const DensityRange& right) {
+		return DensityRange{ std::min(left.min, right.min), std::max(left.max, right.max) };
+	});
+
+	// Logarithmic scale, the lightest occupied pixel starts at the first quarter of the ramp
+	const float scale = range.max > range.min ? 1.0f / log(range.max / range.min) : 0.0f;
+	levels.resize(pixel_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, pixel_count, RASTERIZER_GRAIN),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t pixel = r.begin(); pixel != r.end(); ++pixel) {
+			if (density[pixel] > 0.0f) {
+				float t = log(density[pixel] / range.min) * scale;
+				levels[pixel] = static_cast<uint8_t>(64.0f + 191.0f * t);
+			} else {
+				levels[pixel] = 0;
+			}
+		}
+	}); // Implicit barrier
+}
+
+// Set the color mode and compression of an encoder preset. The fast presets write the density levels as they are,
+// so lodepng skips its color profiling pass, the filter search and the color conversion
+static void configure_png_encoder(lodepng::State& state, PngEncoderPreset preset) {
+	state.encoder.zlibsettings.custom_zlib = parallel_zlib_compress; // Deflate the image data on all threads
+	if (preset == PNG_PRESET_DEFAULT)
+		return; // RGBA input, lodepng chooses the output color type and filters
+
+	state.encoder.auto_convert = 0;
+	state.encoder.filter_palette_zero = 0;
+	state.encoder.filter_strategy = LFS_ZERO; // Sparse frames are mostly runs of zeroes, filtering does not help them
+
+	// A short window and greedy matching, runs are found at distance one anyway
+	state.encoder.zlibsettings.windowsize = PNG_FAST_WINDOW_SIZE;
+	state.encoder.zlibsettings.nicematch = 258;
+	state.encoder.zlibsettings.lazymatching = 0;
+
+	if (preset == PNG_PRESET_FAST_PALETTE) {
+		const uint8_t* palette = ParticleHandler::get_density_palette();
+		lodepng_palette_clear(&state.info_png.color);
+		lodepng_palette_clear(&state.info_raw);
+		for (int level = 0; level < 256; ++level) {
+			lodepng_palette_add(&state.info_png.color, palette[4 * level], palette[4 * level + 1], palette[4 * level + 2], 255);
+			lodepng_palette_add(&state.info_raw, palette[4 * level], palette[4 * level + 1], palette[4 * level + 2], 255);
+		}
+		state.info_png.color.colortype = LCT_PALETTE;
+		state.info_raw.colortype = LCT_PALETTE;
+	} else {
+		state.info_png.color.colortype = LCT_GREY;
+		state.info_raw.colortype = LCT_GREY;
 	}
+	state.info_png.color.bitdepth = 8;
+	state.info_raw.bitdepth = 8;
+}
 
-	// Paint red all the particles
-	for (const Particle& current_particle : universe) {
-		image[4 * width * static_cast<uint32_t>(current_particle.x_) + 4 * static_cast<uint32_t>(current_particle.y_) + 0] = 255; // red
+// Save density levels as png, with the encoder settings of the preset
+void ParticleHandler::levels_to_png(const std::vector<uint8_t>& levels, size_t universe_size_x, size_t universe_size_y, const char* filename,
+	PngEncoderPreset preset) {
+	uint32_t width = static_cast<uint32_t>(universe_size_y);
+	uint32_t height = static_cast<uint32_t>(universe_size_x);
+
+	lodepng::State state;
+	configure_png_encoder(state, preset);
+
+	std::vector<uint8_t> png;
+	unsigned error;
+	if (preset == PNG_PRESET_DEFAULT) {
+		// Paint the density levels with the colour ramp
+		const uint8_t* palette = get_density_palette();
+		std::vector<uint8_t> image(levels.size() * 4);
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, levels.size(), RASTERIZER_GRAIN),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t pixel = r.begin(); pixel != r.end(); ++pixel) {
+				for (int channel = 0; channel < 4; ++channel)
+					image[4 * pixel + channel] = palette[4 * levels[pixel] + channel];
+			}
+		}); // Implicit barrier
+
+		error = lodepng::encode(png, image, width, height, state);
+	} else {
+		error = lodepng::encode(png, levels, width, height, state);
 	}
 
 	// Do save to png
-	lodepng::encode(filename, image, width, height);
+	if (error == 0)
+		lodepng::save_file(png, filename);
+}
+
+// Generate an image from the given particle collection
+void ParticleHandler::universe_to_png(const std::vector<Particle>& universe, size_t universe_size_x, size_t universe_size_y, const char* filename,
+	PngEncoderPreset preset) {
+	std::vector<uint8_t> levels;
+	rasterize_universe(universe, universe_size_x, universe_size_y, levels);
+	levels_to_png(levels, universe_size_x, universe_size_y, filename, preset);
 }
 
 // Convert a vector particle collection into a concurrent vector collection
@@ -114,6 +495,24 @@ bool ParticleHandler::are_equal(const std::vector<Particle>& first_particles, co
 	return are_equal;
 }
 
+// Same particles up to a relative difference of the positions, velocities and masses
+bool ParticleHandler::are_close(const std::vector<Particle>& first_particles, const std::vector<Particle>& second_particles, float tolerance) {
+	if (first_particles.size() != second_particles.size())
+		return false;
+
+	auto is_close = [tolerance](float first, float second) {
+		return std::fabs(first - second) <= tolerance * std::max(1.0f, std::max(std::fabs(first), std::fabs(second)));
+	};
+	for (size_t i = 0; i < first_particles.size(); ++i) {
+		const Particle& first = first_particles[i];
+		const Particle& second = second_particles[i];
+		if (!is_close(first.x_, second.x_) || !is_close(first.y_, second.y_) || !is_close(first.velocity_x_, second.velocity_x_) ||
+			!is_close(first.velocity_y_, second.velocity_y_) || !is_close(first.mass_, second.mass_))
+			return false;
+	}
+	return true;
+}
+
 QuadParticleTree* ParticleHandler::to_quad_tree(const std::vector<Particle>& input_particles, size_t size_x, size_t size_y) {
 	
 	// Crate a new quad tree with limits from zero, up to grid size x and y
@@ -1,18 +1,31 @@
 #pragma once
 #include "Particle.h"
 #include <vector>
+#include <cstdint>
 #include <tbb/concurrent_vector.h>
 #include "QuadParticleTree.h"
+#include "Settings.h"
 
 // Handles conversions, allocations and image saving of various particle collections
 class ParticleHandler
 {
 public:
-	static void allocate_random_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y);
+	static void allocate_random_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y, uint64_t seed);
+	static void allocate_plummer_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y, uint64_t seed);
+	static void allocate_disk_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y, uint64_t seed);
+	static void allocate_clustered_particles(size_t particle_count, std::vector<Particle>& particles, size_t size_x, size_t size_y, uint64_t seed);
+	static void allocate_particles(InitialCondition initial_condition, size_t particle_count, std::vector<Particle>& particles,
+		size_t size_x, size_t size_y, uint64_t seed);
 	static std::vector<Particle> get_random_particles_Barns_Hut_sample();
-	static void universe_to_png(const std::vector<Particle>& universe, size_t universe_size_x, size_t universe_size_y, const char* filename);
+	static const uint8_t* get_density_palette();
+	static void rasterize_universe(const std::vector<Particle>& universe, size_t universe_size_x, size_t universe_size_y, std::vector<uint8_t>& levels);
+	static void levels_to_png(const std::vector<uint8_t>& levels, size_t universe_size_x, size_t universe_size_y, const char* filename,
+		PngEncoderPreset preset = DEFAULT_PNG_PRESET);
+	static void universe_to_png(const std::vector<Particle>& universe, size_t universe_size_x, size_t universe_size_y, const char* filename,
+		PngEncoderPreset preset = DEFAULT_PNG_PRESET);
 	static tbb::concurrent_vector<Particle> to_concurrent_vector(const std::vector<Particle>& input_particles);
 	static std::vector<Particle> to_vector(const tbb::concurrent_vector<Particle>& input_particles);
 	static bool are_equal(const std::vector<Particle>& first_particles, const std::vector<Particle>& second_particles);
+	static bool are_close(const std::vector<Particle>& first_particles, const std::vector<Particle>& second_particles, float tolerance);
 	static QuadParticleTree* to_quad_tree(const std::vector<Particle>& input_particles, size_t size_x, size_t size_y);
 };
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include "ParticleMesh.h"
+#include "Settings.h"
+#include <algorithm>
+#include <cmath>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+
+// Smallest power of two that is at least the requested grid size, and at least two cells
+static size_t round_up_grid_size(size_t grid_size) {
+	size_t rounded = 2;
+	while (rounded < grid_size)
+		rounded <<= 1;
+	return rounded;
+}
+
+// The four cells a particle is spread over, and their weights
+struct CloudInCell {
+	size_t cells[4];
+	double weights[4];
+};
+
+// Cell centers are at (i + 0.5) * cell size. Positions outside the universe are clamped to the outer cell centers, or
+// wrapped around it when it is periodic
+static CloudInCell get_cloud(const Particle& particle, double cell_size_x, double cell_size_y, size_t grid_size, bool periodic) {
+	double u = particle.x_ / cell_size_x - 0.5;
+	double v = particle.y_ / cell_size_y - 0.5;
+	if (!(u == u)) // NaN positions
+		u = 0.0;
+	if (!(v == v))
+		v = 0.0;
+
+	size_t lower_x, lower_y, upper_x, upper_y;
+	if (periodic) {
+		double period = static_cast<double>(grid_size);
+		u -= period * floor(u / period);
+		v -= period * floor(v / period);
+		lower_x = std::min(static_cast<size_t>(u), grid_size - 1);
+		lower_y = std::min(static_cast<size_t>(v), grid_size - 1);
+		upper_x = (lower_x + 1) % grid_size;
+		upper_y = (lower_y + 1) % grid_size;
+	} else {
+		double upper = static_cast<double>(grid_size - 1);
+		u = std::min(std::max(u, 0.0), upper);
+		v = std::min(std::max(v, 0.0), upper);
+		lower_x = std::min(static_cast<size_t>(u), grid_size - 2);
+		lower_y = std::min(static_cast<size_t>(v), grid_size - 2);
+		upper_x = lower_x + 1;
+		upper_y = lower_y + 1;
+	}
+	double fraction_x = u - static_cast<double>(lower_x);
+	double fraction_y = v - static_cast<double>(lower_y);
+
+	CloudInCell cloud = { { lower_x * grid_size + lower_y, lower_x * grid_size + upper_y, upper_x * grid_size + lower_y, upper_x * grid_size + upper_y },
+		{ (1.0 - fraction_x) * (1.0 - fraction_y), (1.0 - fraction_x) * fraction_y, fraction_x * (1.0 - fraction_y), fraction_x * fraction_y } };
+	return cloud;
+}
+
+ParticleMesh::ParticleMesh(size_t grid_size, size_t universe_size_x, size_t universe_size_y, const ForceSplit* force_split,
+	BoundaryCondition boundary_condition) : grid_size_(round_up_grid_size(grid_size)), periodic_(boundary_condition == BOUNDARY_PERIODIC),
+	padded_size_(periodic_ ? grid_size_ : 2 * grid_size_), cell_size_x_(static_cast<double>(universe_size_x) / grid_size_),
+	cell_size_y_(static_cast<double>(universe_size_y) / grid_size_), fft_(padded_size_), force_split_(force_split), green_function_(padded_size_ * padded_size_),
+	transformed_grid_(padded_size_ * padded_size_), density_(grid_size_ * grid_size_), potential_(grid_size_ * grid_size_),
+	mesh_acceleration_x_(grid_size_ * grid_size_), mesh_acceleration_y_(grid_size_ * grid_size_),
+	local_densities_([this]() { return std::vector<double>(grid_size_ * grid_size_, 0.0); }) {
+
+	build_green_function();
+}
+
+size_t ParticleMesh::get_grid_size() const {
+	return grid_size_;
+}
+
+void ParticleMesh::set_deterministic(bool deterministic) {
+	if (!deterministic) {
+		std::vector<std::vector<double>>().swap(block_densities_);
+		return;
+	}
+	if (block_densities_.empty())
+		block_densities_.assign(DETERMINISTIC_BLOCK_COUNT, std::vector<double>(grid_size_ * grid_size_, 0.0));
+}
+
+bool ParticleMesh::is_deterministic() const {
+	return !block_densities_.empty();
+}
+
+// Potential of a unit mass at every cell distance, with the same minimum distance as the direct sum or the long range
+// potential of the force split. The distances wrap around the padded grid, so the convolution of the lower quadrant
+// never reaches the images of the universe
+void ParticleMesh::build_green_function() {
+	const double normalization = 1.0 / static_cast<double>(padded_size_ * padded_size_);
+	if (periodic_) {
+		build_periodic_green_function();
+		return;
+	}
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, padded_size_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t row = r.begin(); row != r.end(); ++row) {
+			double dx = static_cast<double>(row <= grid_size_ ? row : padded_size_ - row) * cell_size_x_;
+			for (size_t column = 0; column < padded_size_; ++column) {
+				double dy = static_cast<double>(column <= grid_size_ ? column : padded_size_ - column) * cell_size_y_;
+				double potential;
+				if (force_split_ != nullptr)
+					potential = force_split_->get_long_range_potential(sqrt(dx * dx + dy * dy));
+				else
+					potential = -1.0 / sqrt(std::max(dx * dx + dy * dy, static_cast<double>(MIN_DISTANCE)));
+				green_function_[row * padded_size_ + column] = GRAVITATIONAL_CONSTANT * potential * normalization;
+			}
+		}
+	}); // Implicit barrier
+
+	fft_.transform_grid(green_function_, false);
+}
+
+// The images of a periodic universe are summed in Fourier space, where the Gaussian screened 1/r of the plane is
+// 2 pi erfc(k rs) / k, without the k = 0 mode so that the mean density is cancelled. Without a force split the softened
+// rest of the potential is short ranged and is added from the nearest images in real space
+void ParticleMesh::build_periodic_green_function() {
+	const double normalization = 1.0 / static_cast<double>(padded_size_ * padded_size_);
+	const double pi = 3.14159265358979323846;
+	const double split_scale = force_split_ != nullptr ? force_split_->get_split_scale() :
+		PM_PERIODIC_SPLIT_SCALE_CELLS * std::max(cell_size_x_, cell_size_y_);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, padded_size_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t row = r.begin(); row != r.end(); ++row) {
+			double dx = static_cast<double>(row <= padded_size_ / 2 ? row : padded_size_ - row) * cell_size_x_;
+			for (size_t column = 0; column < padded_size_; ++column) {
+				double dy = static_cast<double>(column <= padded_size_ / 2 ? column : padded_size_ - column) * cell_size_y_;
+				double potential = 0.0;
+				if (force_split_ == nullptr) {
+					double distance_square = dx * dx + dy * dy;
+					potential = -1.0 / sqrt(std::max(distance_square, static_cast<double>(MIN_DISTANCE))) -
+						get_gaussian_long_range_potential(sqrt(distance_square), split_scale);
+				}
+				green_function_[row * padded_size_ + column] = GRAVITATIONAL_CONSTANT * potential * normalization;
+			}
+		}
+	}); // Implicit barrier
+
+	if (force_split_ == nullptr)
+		fft_.transform_grid(green_function_, false);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, padded_size_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t row = r.begin(); row != r.end(); ++row) {
+			double k_x = 2.0 * pi * static_cast<double>(row <= padded_size_ / 2 ? row : padded_size_ - row) / (padded_size_ * cell_size_x_);
+			for (size_t column = 0; column < padded_size_; ++column) {
+				double k_y = 2.0 * pi * static_cast<double>(column <= padded_size_ / 2 ? column : padded_size_ - column) / (padded_size_ * cell_size_y_);
+				double k = sqrt(k_x * k_x + k_y * k_y);
+				if (k == 0.0)
+					continue;
+				double potential = -2.0 * pi / (k * cell_size_x_ * cell_size_y_) * erfc(k * split_scale);
+				green_function_[row * padded_size_ + column] += GRAVITATIONAL_CONSTANT * potential * normalization;
+			}
+		}
+	}); // Implicit barrier
+}
+
+// Cloud-in-cell assignment. Every thread spreads the particles of its ranges on its own grid, the grids are then
+// reduced, cleared for the next step and copied into the lower quadrant of the padded grid
+void ParticleMesh::assign_masses(const Particle* particles, size_t particle_count) {
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count, PM_ASSIGNMENT_GRAIN),
+		[&](const tbb::blocked_range<size_t>& r) {
+		std::vector<double>& local_density = local_densities_.local();
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			const Particle& current_particle = particles[index];
+			CloudInCell cloud = get_cloud(current_particle, cell_size_x_, cell_size_y_, grid_size_, periodic_);
+			for (int corner = 0; corner < 4; ++corner)
+				local_density[cloud.cells[corner]] += current_particle.mass_ * cloud.weights[corner];
+		}
+	}); // Implicit barrier
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, padded_size_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t row = r.begin(); row != r.end(); ++row) {
+			std::complex<double>* padded_row = &transformed_grid_[row * padded_size_];
+			std::fill(padded_row, padded_row + padded_size_, std::complex<double>(0.0, 0.0));
+			if (row >= grid_size_)
+				continue;
+
+			for (size_t column = 0; column < grid_size_; ++column) {
+				size_t cell = row * grid_size_ + column;
+				double cell_mass = 0.0;
+				for (std::vector<double>& local_density : local_densities_) {
+					cell_mass += local_density[cell];
+					local_density[cell] = 0.0;
+				}
+				density_[cell] = cell_mass;
+				padded_row[column] = cell_mass;
+			}
+		}
+	}); // Implicit barrier
+}
+
+// Cloud-in-cell assignment in a fixed order. The particles are cut into blocks that only depend on their number, at
+// most DETERMINISTIC_BLOCK_COUNT of PM_ASSIGNMENT_GRAIN particles or more. Every block is spread in particle order on its
+// own grid and every cell sums the blocks in order
+void ParticleMesh::assign_masses_deterministic(const Particle* particles, size_t particle_count) {
+	size_t block_count = std::min(block_densities_.size(), std::max<size_t>(1, particle_count / PM_ASSIGNMENT_GRAIN));
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, block_count, 1),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t block = r.begin(); block != r.end(); ++block) {
+			std::vector<double>& block_density = block_densities_[block];
+			size_t end = particle_count * (block + 1) / block_count;
+			for (size_t index = particle_count * block / block_count; index != end; ++index) {
+				const Particle& current_particle = particles[index];
+				CloudInCell cloud = get_cloud(current_particle, cell_size_x_, cell_size_y_, grid_size_, periodic_);
+				for (int corner = 0; corner < 4; ++corner)
+					block_density[cloud.cells[corner]] += current_particle.mass_ * cloud.weights[corner];
+			}
+		}
+	}); // Implicit barrier
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, padded_size_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t row = r.begin(); row != r.end(); ++row) {
+			std::complex<double>* padded_row = &transformed_grid_[row * padded_size_];
+			std::fill(padded_row, padded_row + padded_size_, std::complex<double>(0.0, 0.0));
+			if (row >= grid_size_)
+				continue;
+
+			for (size_t column = 0; column < grid_size_; ++column) {
+				size_t cell = row * grid_size_ + column;
+				double cell_mass = 0.0;
+				for (size_t block = 0; block < block_count; ++block) {
+					cell_mass += block_densities_[block][cell];
+					block_densities_[block][cell] = 0.0;
+				}
+				density_[cell] = cell_mass;
+				padded_row[column] = cell_mass;
+			}
+		}
+	}); // Implicit barrier
+}
+
+// Convolve the density with the Green's function, only the rows of the universe are transformed back
+void ParticleMesh::solve_potential() {
+	fft_.transform_grid(transformed_grid_, false, grid_size_);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, transformed_grid_.size()),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t cell = r.begin(); cell != r.end(); ++cell)
+			transformed_grid_[cell] = multiply_complex(transformed_grid_[cell], green_function_[cell]);
+	}); // Implicit barrier
+
+	fft_.transform_grid(transformed_grid_, true, grid_size_);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, grid_size_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t row = r.begin(); row != r.end(); ++row) {
+			for (size_t column = 0; column < grid_size_; ++column)
+				potential_[row * grid_size_ + column] = transformed_grid_[row * padded_size_ + column].real();
+		}
+	}); // Implicit barrier
+}
+
+// Accelerations on the cells, central differences of the potential inside the grid and one sided ones on its edges,
+// or central differences across the edges of a periodic grid
+void ParticleMesh::differentiate_potential() {
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, grid_size_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t row = r.begin(); row != r.end(); ++row) {
+			size_t lower_row = row > 0 ? row - 1 : (periodic_ ? grid_size_ - 1 : row);
+			size_t upper_row = row + 1 < grid_size_ ? row + 1 : (periodic_ ? 0 : row);
+			double row_distance = (periodic_ || (row > 0 && row + 1 < grid_size_) ? 2.0 : 1.0) * cell_size_x_;
+			for (size_t column = 0; column < grid_size_; ++column) {
+				size_t lower_column = column > 0 ? column - 1 : (periodic_ ? grid_size_ - 1 : column);
+				size_t upper_column = column + 1 < grid_size_ ? column + 1 : (periodic_ ? 0 : column);
+				double column_distance = (periodic_ || (column > 0 && column + 1 < grid_size_) ? 2.0 : 1.0) * cell_size_y_;
+
+				size_t cell = row * grid_size_ + column;
+				mesh_acceleration_x_[cell] = -(potential_[upper_row * grid_size_ + column] - potential_[lower_row * grid_size_ + column]) / row_distance;
+				mesh_acceleration_y_[cell] = -(potential_[row * grid_size_ + upper_column] - potential_[row * grid_size_ + lower_column]) / column_distance;
+			}
+		}
+	}); // Implicit barrier
+}
+
+// Gather the cell accelerations with the same cloud-in-cell weights as the assignment, so a particle does not pull itself
+void ParticleMesh::interpolate_accelerations(Particle* particles, size_t particle_count) const {
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			Particle& current_particle = particles[index];
+			CloudInCell cloud = get_cloud(current_particle, cell_size_x_, cell_size_y_, grid_size_, periodic_);
+
+			double acceleration_x = 0.0, acceleration_y = 0.0;
+			for (int corner = 0; corner < 4; ++corner) {
+				acceleration_x += cloud.weights[corner] * mesh_acceleration_x_[cloud.cells[corner]];
+				acceleration_y += cloud.weights[corner] * mesh_acceleration_y_[cloud.cells[corner]];
+			}
+			current_particle.acceleration_x_ += static_cast<float>(acceleration_x);
+			current_particle.acceleration_y_ += static_cast<float>(acceleration_y);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+}
+
+void ParticleMesh::apply_acceleration(Particle* particles, size_t particle_count) {
+	if (is_deterministic())
+		assign_masses_deterministic(particles, particle_count);
+	else
+		assign_masses(particles, particle_count);
+	solve_potential();
+	differentiate_potential();
+	interpolate_accelerations(particles, particle_count);
+}
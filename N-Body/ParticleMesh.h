@@ -0,0 +1,50 @@
+#pragma once
+#include "Particle.h"
+#include "Fft.h"
+#include "ForceSplit.h"
+#include "Settings.h"
+#include <complex>
+#include <vector>
+#include <tbb/enumerable_thread_specific.h>
+
+// Particle-mesh gravity. The masses are assigned to a grid with the cloud-in-cell scheme, the potential is the
+// convolution of the grid with the softened 1/r Green's function, computed with FFTs on a zero padded grid so that the
+// universe is isolated, and the accelerations are interpolated back from its finite differences. With a force split
+// only the long range part of the force is computed. A periodic universe is convolved without padding. In deterministic
+// mode the particles are assigned in DETERMINISTIC_BLOCK_COUNT fixed blocks whose grids are summed in block order
+class ParticleMesh {
+	size_t grid_size_; // Cells per side of the universe
+	bool periodic_;
+	size_t padded_size_; // Cells per side of the transformed grid
+	double cell_size_x_;
+	double cell_size_y_;
+	Fft fft_;
+	const ForceSplit* force_split_;
+
+	std::vector<std::complex<double>> green_function_; // Transformed, normalized for the inverse transform
+	std::vector<std::complex<double>> transformed_grid_; // Padded density, then potential
+	std::vector<double> density_; // Mass per cell
+	std::vector<double> potential_;
+	std::vector<double> mesh_acceleration_x_;
+	std::vector<double> mesh_acceleration_y_;
+	tbb::enumerable_thread_specific<std::vector<double>> local_densities_; // Mass assignment grid of every thread
+	std::vector<std::vector<double>> block_densities_; // Mass assignment grid of every fixed block, deterministic mode only
+
+	void build_green_function();
+	void build_periodic_green_function();
+	void assign_masses(const Particle* particles, size_t particle_count);
+	void assign_masses_deterministic(const Particle* particles, size_t particle_count);
+	void solve_potential();
+	void differentiate_potential();
+	void interpolate_accelerations(Particle* particles, size_t particle_count) const;
+public:
+	ParticleMesh(size_t grid_size, size_t universe_size_x, size_t universe_size_y, const ForceSplit* force_split = nullptr,
+		BoundaryCondition boundary_condition = BOUNDARY_REFLECTIVE);
+	ParticleMesh(const ParticleMesh&) = delete;
+	ParticleMesh& operator=(const ParticleMesh&) = delete;
+
+	size_t get_grid_size() const;
+	void set_deterministic(bool deterministic); // Same densities whatever the number of threads and the scheduling
+	bool is_deterministic() const;
+	void apply_acceleration(Particle* particles, size_t particle_count); // Adds the mesh accelerations to the particles
+};
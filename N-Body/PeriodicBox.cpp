@@ -0,0 +1,81 @@
+#include "PeriodicBox.h"
+#include <tbb/parallel_for.h>
+
+static const double PI = 3.14159265358979323846;
+
+PeriodicBox::PeriodicBox(float size_x, float size_y) : size_x_(size_x), size_y_(size_y), table_step_x_(size_x / (2 * EWALD_TABLE_SIZE)),
+	table_step_y_(size_y / (2 * EWALD_TABLE_SIZE)), inverse_table_step_x_(1.0f / table_step_x_), inverse_table_step_y_(1.0f / table_step_y_),
+	corrections_((EWALD_TABLE_SIZE + 1) * (EWALD_TABLE_SIZE + 1)) {
+
+	build_correction_table();
+}
+
+float PeriodicBox::get_size_x() const {
+	return size_x_;
+}
+
+float PeriodicBox::get_size_y() const {
+	return size_y_;
+}
+
+// Ewald sum of d / |d|^3 over the images of a lattice in the plane, minus the nearest image. The real space part sums
+// erfc screened images, the reciprocal part uses the 2D transform of erf(a r) / r, which is 2 pi erfc(k / 2a) / k
+void PeriodicBox::build_correction_table() {
+	const double size_x = size_x_, size_y = size_y_;
+	const double shortest_side = std::min(size_x, size_y);
+	const double alpha = 2.0 / shortest_side;
+	const double area = size_x * size_y;
+
+	// Enough images for erfc(alpha r) and erfc(k / 2 alpha) to drop below double precision
+	const int image_range_x = static_cast<int>(std::ceil(3.0 * shortest_side / size_x)) + 1;
+	const int image_range_y = static_cast<int>(std::ceil(3.0 * shortest_side / size_y)) + 1;
+	const int wave_range_x = static_cast<int>(std::ceil(4.0 * size_x / shortest_side)) + 1;
+	const int wave_range_y = static_cast<int>(std::ceil(4.0 * size_y / shortest_side)) + 1;
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, EWALD_TABLE_SIZE + 1),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t row = r.begin(); row != r.end(); ++row) {
+			for (size_t column = 0; column <= EWALD_TABLE_SIZE; ++column) {
+				double dx = static_cast<double>(column) * table_step_x_;
+				double dy = static_cast<double>(row) * table_step_y_;
+				double sum_x = 0.0, sum_y = 0.0;
+
+				for (int image_x = -image_range_x; image_x <= image_range_x; ++image_x) {
+					for (int image_y = -image_range_y; image_y <= image_range_y; ++image_y) {
+						double x = dx + image_x * size_x;
+						double y = dy + image_y * size_y;
+						double distance = std::sqrt(x * x + y * y);
+						if (distance == 0.0)
+							continue;
+
+						// The nearest image itself is left to the direct kernels, only its screening is kept
+						double screened = std::erfc(alpha * distance);
+						if (image_x == 0 && image_y == 0)
+							screened -= 1.0;
+						double factor = (screened / distance + 2.0 * alpha / std::sqrt(PI) * std::exp(-alpha * alpha * distance * distance)) /
+							(distance * distance);
+						sum_x += factor * x;
+						sum_y += factor * y;
+					}
+				}
+
+				for (int wave_x = -wave_range_x; wave_x <= wave_range_x; ++wave_x) {
+					for (int wave_y = -wave_range_y; wave_y <= wave_range_y; ++wave_y) {
+						if (wave_x == 0 && wave_y == 0)
+							continue; // Cancelled by the background
+						double k_x = 2.0 * PI * wave_x / size_x;
+						double k_y = 2.0 * PI * wave_y / size_y;
+						double k = std::sqrt(k_x * k_x + k_y * k_y);
+						double factor = 2.0 * PI / area * std::erfc(k / (2.0 * alpha)) / k * std::sin(k_x * dx + k_y * dy);
+						sum_x += factor * k_x;
+						sum_y += factor * k_y;
+					}
+				}
+
+				size_t entry = row * (EWALD_TABLE_SIZE + 1) + column;
+				corrections_[entry].x = static_cast<float>(sum_x);
+				corrections_[entry].y = static_cast<float>(sum_y);
+			}
+		}
+	}); // Implicit barrier
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "Particle.h"
+#include "Settings.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Periodic universe. Forces come from the nearest image of every mass, plus a correction for all the other images of
+// the lattice that is tabulated once with an Ewald sum, against a uniform background that keeps the sum finite
+class PeriodicBox {
+	struct Correction {
+		float x, y;
+	};
+
+	float size_x_;
+	float size_y_;
+	float table_step_x_; // Distance between two table entries, the table covers the first quadrant up to half the box
+	float table_step_y_;
+	float inverse_table_step_x_;
+	float inverse_table_step_y_;
+	std::vector<Correction> corrections_; // Acceleration of the other images per unit G m, (EWALD_TABLE_SIZE + 1)^2 entries
+
+	void build_correction_table();
+public:
+	PeriodicBox(float size_x, float size_y);
+
+	float get_size_x() const;
+	float get_size_y() const;
+
+	// Shortest displacement between two points of the periodic universe. The particles are kept inside the universe, so
+	// a displacement is at most one period away from its nearest image
+	void get_minimum_image(float& dx, float& dy) const {
+		if (dx > 0.5f * size_x_)
+			dx -= size_x_;
+		else if (dx < -0.5f * size_x_)
+			dx += size_x_;
+		if (dy > 0.5f * size_y_)
+			dy -= size_y_;
+		else if (dy < -0.5f * size_y_)
+			dy += size_y_;
+	}
+
+	// Bilinear interpolation of the table, the correction is odd along its own axis and even along the other one
+	void get_correction(float dx, float dy, float& correction_x, float& correction_y) const {
+		float u = std::fabs(dx) * inverse_table_step_x_;
+		float v = std::fabs(dy) * inverse_table_step_y_;
+		size_t column = std::min(static_cast<size_t>(u), EWALD_TABLE_SIZE - 1);
+		size_t row = std::min(static_cast<size_t>(v), EWALD_TABLE_SIZE - 1);
+		float fraction_x = std::min(u - static_cast<float>(column), 1.0f);
+		float fraction_y = std::min(v - static_cast<float>(row), 1.0f);
+
+		size_t entry = row * (EWALD_TABLE_SIZE + 1) + column;
+		float weights[4] = { (1.0f - fraction_x) * (1.0f - fraction_y), fraction_x * (1.0f - fraction_y),
+			(1.0f - fraction_x) * fraction_y, fraction_x * fraction_y };
+		size_t entries[4] = { entry, entry + 1, entry + EWALD_TABLE_SIZE + 1, entry + EWALD_TABLE_SIZE + 2 };
+		correction_x = 0.0f;
+		correction_y = 0.0f;
+		for (int corner = 0; corner < 4; ++corner) {
+			correction_x += weights[corner] * corrections_[entries[corner]].x;
+			correction_y += weights[corner] * corrections_[entries[corner]].y;
+		}
+		if (dx < 0.0f)
+			correction_x = -correction_x;
+		if (dy < 0.0f)
+			correction_y = -correction_y;
+	}
+
+	// Pull of a mass at (x, y) and all its images, with the same minimum distance as the isolated kernels
+	void add_acceleration(Particle& particle, float x, float y, float mass) const {
+		float dx = x - particle.x_;
+		float dy = y - particle.y_;
+		get_minimum_image(dx, dy);
+
+		float distance_square = dx * dx + dy * dy;
+		if (distance_square < MIN_DISTANCE)
+			distance_square = MIN_DISTANCE;
+		float distance = std::sqrt(distance_square);
+		float correction_x, correction_y;
+		get_correction(dx, dy, correction_x, correction_y);
+
+		float acceleration_factor = GRAVITATIONAL_CONSTANT * mass;
+		particle.acceleration_x_ += acceleration_factor * (dx / (distance_square * distance) + correction_x);
+		particle.acceleration_y_ += acceleration_factor * (dy / (distance_square * distance) + correction_y);
+	}
+
+	void add_acceleration(Particle& particle, const Particle& interacting_particle) const {
+		add_acceleration(particle, interacting_particle.x_, interacting_particle.y_, interacting_particle.mass_);
+	}
+
+	// Apply acceleration on both particles in one sweep
+	void add_acceleration_pairwise(Particle& particle, Particle& interacting_particle) const {
+		float dx = interacting_particle.x_ - particle.x_;
+		float dy = interacting_particle.y_ - particle.y_;
+		get_minimum_image(dx, dy);
+
+		float distance_square = dx * dx + dy * dy;
+		if (distance_square < MIN_DISTANCE)
+			distance_square = MIN_DISTANCE;
+		float distance = std::sqrt(distance_square);
+		float correction_x, correction_y;
+		get_correction(dx, dy, correction_x, correction_y);
+
+		float pull_x = GRAVITATIONAL_CONSTANT * (dx / (distance_square * distance) + correction_x);
+		float pull_y = GRAVITATIONAL_CONSTANT * (dy / (distance_square * distance) + correction_y);
+		particle.acceleration_x_ += pull_x * interacting_particle.mass_;
+		particle.acceleration_y_ += pull_y * interacting_particle.mass_;
+		interacting_particle.acceleration_x_ -= pull_x * particle.mass_;
+		interacting_particle.acceleration_y_ -= pull_y * particle.mass_;
+	}
+
+	// Distance to the nearest image, with the same minimum as Particle::get_distance
+	float get_distance(const Particle& particle, float x, float y) const {
+		float dx = x - particle.x_;
+		float dy = y - particle.y_;
+		get_minimum_image(dx, dy);
+		float distance_square = dx * dx + dy * dy;
+		if (distance_square < MIN_DISTANCE)
+			distance_square = MIN_DISTANCE;
+		return std::sqrt(distance_square);
+	}
+};
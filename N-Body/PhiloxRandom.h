@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+
+// Counter-based Philox4x32-10 random number generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3")
+// Every (counter, key) pair maps to an independent block of four random words, so any particle can be generated
+// from its own index without sharing state between threads
+class PhiloxRandom {
+	static const uint32_t MULTIPLIER_0 = 0xD2511F53;
+	static const uint32_t MULTIPLIER_1 = 0xCD9E8D57;
+	static const uint32_t WEYL_0 = 0x9E3779B9; // Golden ratio
+	static const uint32_t WEYL_1 = 0xBB67AE85; // sqrt(3) - 1
+	static const int ROUNDS = 10;
+
+	uint32_t key_[2];
+public:
+	// Four random words produced by one evaluation of the generator
+	struct Block {
+		uint32_t word[4];
+	};
+
+	PhiloxRandom(uint64_t seed) {
+		key_[0] = static_cast<uint32_t>(seed);
+		key_[1] = static_cast<uint32_t>(seed >> 32);
+	}
+
+	// Generate the random block of a specific counter. The stream separates independent uses of the same counter
+	Block generate(uint64_t counter, uint32_t stream = 0) const {
+		uint32_t state[4] = { static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), stream, 0 };
+		uint32_t key[2] = { key_[0], key_[1] };
+
+		for (int round = 0; round < ROUNDS; ++round) {
+			uint64_t product_0 = static_cast<uint64_t>(MULTIPLIER_0) * state[0];
+			uint64_t product_1 = static_cast<uint64_t>(MULTIPLIER_1) * state[2];
+
+			uint32_t next[4];
+			next[0] = static_cast<uint32_t>(product_1 >> 32) ^ state[1] ^ key[0];
+			next[1] = static_cast<uint32_t>(product_1);
+			next[2] = static_cast<uint32_t>(product_0 >> 32) ^ state[3] ^ key[1];
+			next[3] = static_cast<uint32_t>(product_0);
+
+			for (int i = 0; i < 4; ++i)
+				state[i] = next[i];
+
+			// Bump the key for the next round
+			key[0] += WEYL_0;
+			key[1] += WEYL_1;
+		}
+
+		Block block;
+		for (int i = 0; i < 4; ++i)
+			block.word[i] = state[i];
+		return block;
+	}
+
+	// Map a random word to a float in [0, 1)
+	static float to_unit_float(uint32_t word) {
+		return static_cast<float>(word >> 8) * (1.0f / 16777216.0f); // Keep the 24 bits of the float mantissa
+	}
+};
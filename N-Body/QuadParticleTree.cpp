@@ -1,9 +1,11 @@
-#pragma once
 #include "Particle.h"
 #include "QuadParticleTree.h"
 #include "Settings.h"
+#include <algorithm>
+#include <cmath>
 
-inline QuadParticleTree::QuadParticleTree(const Particle& origin, const Particle& halfDimension) : origin(origin), halfDimension(halfDimension), data(nullptr) {
+QuadParticleTree::QuadParticleTree(const Particle& origin, const Particle& halfDimension, bool fixed_point) : origin(origin),
+	halfDimension(halfDimension), data(nullptr), fixed_point(fixed_point) {
 	// Ensure that the children are empty on the new node
 	for (int i = 0; i < NUM_CHILDREN; ++i)
 		children[i] = nullptr;
@@ -13,7 +15,7 @@ float QuadParticleTree::get_side_size() const {
 	return origin.get_distance(halfDimension);
 }
 
-inline float QuadParticleTree::get_total_mass() const {
+float QuadParticleTree::get_total_mass() const {
 	return total_mass_;
 }
 
@@ -26,7 +28,7 @@ QuadParticleTree::~QuadParticleTree() {
 // Find which quandrant contains the point
 //x : --++
 //y : -+-+
-inline int QuadParticleTree::get_quadrant_containing_point(const Particle& point) const {
+int QuadParticleTree::get_quadrant_containing_point(const Particle& point) const {
 	int quadrant = 0;
 	if (point.x_ >= origin.x_)
 		quadrant |= 2;
@@ -35,7 +37,17 @@ inline int QuadParticleTree::get_quadrant_containing_point(const Particle& point
 	return quadrant;
 }
 
-inline bool QuadParticleTree::isLeafNode() const {
+// The bits of the coordinates are the comparisons with the origin of the node, no comparison is left to do
+int QuadParticleTree::get_quadrant_containing_point(const FixedPosition& point) const {
+	int shift = FIXED_POINT_BITS - 1 - depth;
+	return static_cast<int>(((point.x_ >> shift) & 1) << 1 | ((point.y_ >> shift) & 1));
+}
+
+int QuadParticleTree::get_quadrant_containing_point(const TreeParticle* point) const {
+	return fixed_point ? get_quadrant_containing_point(point->get_fixed_position()) : get_quadrant_containing_point(point->get_particle());
+}
+
+bool QuadParticleTree::isLeafNode() const {
 	// If this node is a leaf, then at least the first child will be null
 	return children[0] == nullptr;
 }
@@ -56,7 +68,8 @@ void QuadParticleTree::insert(TreeParticle* point) {
 		} else {
 			// We are at a leaf but there are data already stored
 
-			if (this->depth < MAX_TREE_DEPTH) { // TODO: switch to vector, to be able to add extra children on a terminal node
+			// Fixed point nodes stop splitting once the bits of the coordinates are used up
+			if (this->depth < (fixed_point ? std::min(MAX_TREE_DEPTH, FIXED_POINT_BITS) : MAX_TREE_DEPTH)) { // TODO: switch to vector, to be able to add extra children on a terminal node
 				TreeParticle *oldPoint = data; // Temporary placeholder
 				data = nullptr;
 
@@ -66,16 +79,16 @@ void QuadParticleTree::insert(TreeParticle* point) {
 					Particle newOrigin = origin;
 					newOrigin.x_ += halfDimension.x_ * (i & 2 ? .5f : -.5f);
 					newOrigin.y_ += halfDimension.y_ * (i & 1 ? .5f : -.5f);
-					children[i] = new QuadParticleTree(newOrigin, halfDimension *.5f);
+					children[i] = new QuadParticleTree(newOrigin, halfDimension *.5f, fixed_point);
 					// Increase the node depth
 					children[i]->depth = depth + 1;
 				}
 
 				// Re-insert the older data of the leaf into the correct child
-				children[get_quadrant_containing_point(oldPoint->get_particle())]->insert(oldPoint);
+				children[get_quadrant_containing_point(oldPoint)]->insert(oldPoint);
 				// Continue to recursively find were to insert the requested point. We don't have
 				// to search from the tree root. We can continue from the current node.
-				children[get_quadrant_containing_point(point->get_particle())]->insert(point);
+				children[get_quadrant_containing_point(point)]->insert(point);
 			}
 		}
 	} else {
@@ -102,31 +115,101 @@ void QuadParticleTree::insert(TreeParticle* point) {
 			this->center_of_mass_y_ = center_y / this->total_mass_;
 		}
 
-		int quadrant = get_quadrant_containing_point(point->get_particle());
+		int quadrant = get_quadrant_containing_point(point);
 
 		children[quadrant]->insert(point);
 	}
 }
 
-void QuadParticleTree::apply_acceleration(Particle& input_particle) const {
+void QuadParticleTree::apply_acceleration(Particle& input_particle, const PeriodicBox* periodic_box, const FixedPosition* fixed_position) const {
 	// Start from root
 	if (isLeafNode()) {
 		Particle center_of_mass_particle = Particle(center_of_mass_x_, center_of_mass_y_, total_mass_);
-		if (input_particle.x_ != center_of_mass_particle.x_ && input_particle.y_ != center_of_mass_particle.y_ && input_particle.mass_ != total_mass_)
-			input_particle.add_acceleration(center_of_mass_particle);	
+		if (input_particle.x_ != center_of_mass_particle.x_ && input_particle.y_ != center_of_mass_particle.y_ && input_particle.mass_ != total_mass_) {
+			if (periodic_box != nullptr)
+				periodic_box->add_acceleration(input_particle, center_of_mass_particle);
+			else
+				input_particle.add_acceleration(center_of_mass_particle);
+		}
 	} else {
 		// Get distances	
 		Particle center_of_mass_particle = Particle(center_of_mass_x_, center_of_mass_y_, total_mass_);
-		float distance_from_center_of_mass = input_particle.get_distance(center_of_mass_particle);
+		float distance_from_center_of_mass = periodic_box != nullptr ? periodic_box->get_distance(input_particle, center_of_mass_x_, center_of_mass_y_) :
+			input_particle.get_distance(center_of_mass_particle);
 		float side = get_side_size();
 
 		if (side / distance_from_center_of_mass > THETA) {
 			// Go deeper in the tree
-			int quadtrant = get_quadrant_containing_point(input_particle);
-			children[quadtrant]->apply_acceleration(input_particle);
+			int quadtrant = fixed_position != nullptr ? get_quadrant_containing_point(*fixed_position) : get_quadrant_containing_point(input_particle);
+			children[quadtrant]->apply_acceleration(input_particle, periodic_box, fixed_position);
 		} else {
-			if (input_particle.x_ != center_of_mass_particle.x_ && input_particle.y_ != center_of_mass_particle.y_ && input_particle.mass_ != total_mass_)
-				input_particle.add_acceleration(center_of_mass_particle);
+			if (input_particle.x_ != center_of_mass_particle.x_ && input_particle.y_ != center_of_mass_particle.y_ && input_particle.mass_ != total_mass_) {
+				if (periodic_box != nullptr)
+					periodic_box->add_acceleration(input_particle, center_of_mass_particle);
+				else
+					input_particle.add_acceleration(center_of_mass_particle);
+			}
 		}
 	}
-}
\ No newline at end of file
+}
+
+void QuadParticleTree::compute_mass_distribution() {
+	if (isLeafNode()) {
+		total_mass_ = data != nullptr ? data->get_mass() : 0.0f;
+		center_of_mass_x_ = data != nullptr ? data->get_particle().x_ : origin.x_;
+		center_of_mass_y_ = data != nullptr ? data->get_particle().y_ : origin.y_;
+		return;
+	}
+
+	float total_mass = 0.0f, center_x = 0.0f, center_y = 0.0f;
+	for (int i = 0; i < NUM_CHILDREN; ++i) {
+		children[i]->compute_mass_distribution();
+		total_mass += children[i]->total_mass_;
+		center_x += children[i]->center_of_mass_x_ * children[i]->total_mass_;
+		center_y += children[i]->center_of_mass_y_ * children[i]->total_mass_;
+	}
+	total_mass_ = total_mass;
+	center_of_mass_x_ = total_mass > 0.0f ? center_x / total_mass : origin.x_;
+	center_of_mass_y_ = total_mass > 0.0f ? center_y / total_mass : origin.y_;
+}
+
+// Walk every node that comes closer than the cutoff, the rest of the tree only holds long range forces. Needs the
+// mass distribution of compute_mass_distribution. In a periodic universe the nearest images of the nodes are walked,
+// the cutoff is well below half the universe so no other image is within reach
+void QuadParticleTree::apply_short_range_acceleration(Particle& input_particle, const TreeParticle* input_tree_particle,
+	const ForceSplit& force_split, const PeriodicBox* periodic_box) const {
+	if (total_mass_ <= 0.0f)
+		return;
+
+	// Distance of the particle from the bounding box of the node
+	float offset_x = input_particle.x_ - origin.x_;
+	float offset_y = input_particle.y_ - origin.y_;
+	if (periodic_box != nullptr)
+		periodic_box->get_minimum_image(offset_x, offset_y);
+	float gap_x = std::max(std::fabs(offset_x) - halfDimension.x_, 0.0f);
+	float gap_y = std::max(std::fabs(offset_y) - halfDimension.y_, 0.0f);
+	float cutoff = force_split.get_cutoff();
+	if (gap_x * gap_x + gap_y * gap_y >= cutoff * cutoff)
+		return;
+
+	// Displacement to the center of mass, or to the particle of a leaf
+	float dx = center_of_mass_x_ - input_particle.x_;
+	float dy = center_of_mass_y_ - input_particle.y_;
+	if (periodic_box != nullptr)
+		periodic_box->get_minimum_image(dx, dy);
+
+	if (isLeafNode()) {
+		if (data != nullptr && data != input_tree_particle)
+			force_split.add_short_range_acceleration(input_particle, input_particle.x_ + dx, input_particle.y_ + dy, data->get_mass());
+		return;
+	}
+
+	// Open the node unless it is small enough as seen from the particle
+	float side = 2.0f * std::max(halfDimension.x_, halfDimension.y_);
+	if (side * side < THETA * THETA * (dx * dx + dy * dy)) {
+		force_split.add_short_range_acceleration(input_particle, input_particle.x_ + dx, input_particle.y_ + dy, total_mass_);
+	} else {
+		for (int i = 0; i < NUM_CHILDREN; ++i)
+			children[i]->apply_short_range_acceleration(input_particle, input_tree_particle, force_split, periodic_box);
+	}
+}
@@ -1,7 +1,11 @@
 #pragma once
 
 #include "TreeParticle.h"
+#include "FixedPoint.h"
 #include "Particle.h"
+#include "ForceSplit.h"
+#include "PeriodicBox.h"
+#include "Settings.h"
 #include <cstdint>
 
 // A Quad tree that stores collections of particles
@@ -16,13 +20,48 @@ class QuadParticleTree {
 	float center_of_mass_y_ = 0.0;
 	float total_mass_ = 0.0;
 	uint8_t depth = 0; // The depth of the node compared to the root
+	bool fixed_point; // Quadrants from the coordinate bits of the fixed point positions of the points
+
+	int get_quadrant_containing_point(const TreeParticle* point) const;
 public:
-	QuadParticleTree(const Particle& origin, const Particle& halfDimension);
+	// A fixed point tree must cover the universe box exactly, its root splits at the middle of the box
+	QuadParticleTree(const Particle& origin, const Particle& halfDimension, bool fixed_point = false);
 	float get_side_size() const;
 	float get_total_mass() const;
 	~QuadParticleTree();
 	int get_quadrant_containing_point(const Particle& point) const; // Find the child node quadrant
+	int get_quadrant_containing_point(const FixedPosition& point) const; // Same from bit 31 - depth of the coordinates
 	bool isLeafNode() const; // Check if it is a leaf
 	void insert(TreeParticle* point); // Insert point in the node
-	void apply_acceleration(Particle& input_particle) const;
-};
\ No newline at end of file
+	// Nearest images when periodic. The walk of a fixed point tree follows the fixed point position of the particle
+	void apply_acceleration(Particle& input_particle, const PeriodicBox* periodic_box = nullptr, const FixedPosition* fixed_position = nullptr) const;
+	// The same walk with an interaction kernel, the pulls are summed into the accumulators of the kernel. Open universes only
+	template <typename Kernel>
+	void apply_acceleration(const Particle& input_particle, typename Kernel::AccumulatorType (&acceleration)[2],
+		typename Kernel::AccumulatorType& potential, const FixedPosition* fixed_position = nullptr) const;
+	void compute_mass_distribution(); // Mass weighted centers of all the nodes, bottom up, once all the points are inserted
+	void apply_short_range_acceleration(Particle& input_particle, const TreeParticle* input_tree_particle, const ForceSplit& force_split,
+		const PeriodicBox* periodic_box = nullptr) const;
+};
+
+template <typename Kernel>
+void QuadParticleTree::apply_acceleration(const Particle& input_particle, typename Kernel::AccumulatorType (&acceleration)[2],
+	typename Kernel::AccumulatorType& potential, const FixedPosition* fixed_position) const {
+	typedef typename Kernel::ScalarType Scalar;
+	if (!isLeafNode()) {
+		Particle center_of_mass_particle = Particle(center_of_mass_x_, center_of_mass_y_, total_mass_);
+		if (get_side_size() / input_particle.get_distance(center_of_mass_particle) > THETA) {
+			// Go deeper in the tree
+			int quadrant = fixed_position != nullptr ? get_quadrant_containing_point(*fixed_position) : get_quadrant_containing_point(input_particle);
+			children[quadrant]->apply_acceleration<Kernel>(input_particle, acceleration, potential, fixed_position);
+			return;
+		}
+	}
+
+	// Displacement to the center of mass in the arithmetic of the kernel
+	if (input_particle.x_ != center_of_mass_x_ && input_particle.y_ != center_of_mass_y_ && input_particle.mass_ != total_mass_) {
+		const Scalar displacement[2] = { static_cast<Scalar>(center_of_mass_x_) - static_cast<Scalar>(input_particle.x_),
+			static_cast<Scalar>(center_of_mass_y_) - static_cast<Scalar>(input_particle.y_) };
+		Kernel::add_acceleration(displacement, static_cast<Scalar>(total_mass_), acceleration, potential);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// Half open range of indices, it is never split
+template <typename Value>
+class blocked_range {
+	Value begin_;
+	Value end_;
+	size_t grainsize_;
+public:
+	typedef Value const_iterator;
+	typedef size_t size_type;
+
+	blocked_range(Value begin, Value end, size_t grainsize = 1) : begin_(begin), end_(end), grainsize_(grainsize) { }
+
+	const_iterator begin() const {
+		return begin_;
+	}
+
+	const_iterator end() const {
+		return end_;
+	}
+
+	size_type size() const {
+		return static_cast<size_type>(end_ - begin_);
+	}
+
+	size_type grainsize() const {
+		return grainsize_;
+	}
+
+	bool empty() const {
+		return !(begin_ < end_);
+	}
+
+	bool is_divisible() const {
+		return false;
+	}
+};
+
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <memory>
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// Without other threads there is no false sharing to avoid
+template <typename T>
+using cache_aligned_allocator = std::allocator<T>;
+
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "cache_aligned_allocator.h"
+#include <vector>
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// Without concurrent growth a plain vector is enough
+template <typename T, typename Allocator = cache_aligned_allocator<T>>
+class concurrent_vector : public std::vector<T, Allocator> {
+public:
+	using std::vector<T, Allocator>::vector;
+};
+
+}
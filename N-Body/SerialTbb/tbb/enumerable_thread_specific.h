@@ -0,0 +1,53 @@
+#pragma once
+#include <functional>
+#include <vector>
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// The only thread gets the only copy, created on first use
+template <typename T>
+class enumerable_thread_specific {
+	std::function<T()> initializer_;
+	std::vector<T> values_;
+public:
+	typedef typename std::vector<T>::iterator iterator;
+	typedef typename std::vector<T>::const_iterator const_iterator;
+
+	enumerable_thread_specific() : initializer_([]() { return T(); }) { }
+
+	template <typename Initializer>
+	explicit enumerable_thread_specific(Initializer initializer) : initializer_(initializer) { }
+
+	T& local() {
+		if (values_.empty())
+			values_.push_back(initializer_());
+		return values_.front();
+	}
+
+	size_t size() const {
+		return values_.size();
+	}
+
+	void clear() {
+		values_.clear();
+	}
+
+	iterator begin() {
+		return values_.begin();
+	}
+
+	iterator end() {
+		return values_.end();
+	}
+
+	const_iterator begin() const {
+		return values_.begin();
+	}
+
+	const_iterator end() const {
+		return values_.end();
+	}
+};
+
+}
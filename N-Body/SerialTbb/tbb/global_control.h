@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// Limits are accepted and ignored, there is always one thread
+class global_control {
+public:
+	enum parameter { max_allowed_parallelism, thread_stack_size, parameter_max };
+
+	global_control(parameter, size_t) { }
+
+	static size_t active_value(parameter setting) {
+		return setting == max_allowed_parallelism ? 1 : 0;
+	}
+};
+
+}
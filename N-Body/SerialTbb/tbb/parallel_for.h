@@ -0,0 +1,26 @@
+#pragma once
+#include "blocked_range.h"
+#include "partitioner.h"
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// The body runs once over the whole range
+template <typename Range, typename Body>
+void parallel_for(const Range& range, const Body& body) {
+	if (!range.empty())
+		body(range);
+}
+
+template <typename Range, typename Body, typename Partitioner>
+void parallel_for(const Range& range, const Body& body, const Partitioner&) {
+	parallel_for(range, body);
+}
+
+template <typename Index, typename Function>
+void parallel_for(Index first, Index last, const Function& function) {
+	for (Index index = first; index < last; ++index)
+		function(index);
+}
+
+}
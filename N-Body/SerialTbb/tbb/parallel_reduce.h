@@ -0,0 +1,15 @@
+#pragma once
+#include "blocked_range.h"
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// The body reduces the whole range at once, there is nothing to join
+template <typename Range, typename Value, typename RealBody, typename Reduction>
+Value parallel_reduce(const Range& range, const Value& identity, const RealBody& real_body, const Reduction&) {
+	if (range.empty())
+		return identity;
+	return real_body(range, identity);
+}
+
+}
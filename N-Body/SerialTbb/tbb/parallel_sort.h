@@ -0,0 +1,17 @@
+#pragma once
+#include <algorithm>
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+template <typename RandomAccessIterator>
+void parallel_sort(RandomAccessIterator begin, RandomAccessIterator end) {
+	std::sort(begin, end);
+}
+
+template <typename RandomAccessIterator, typename Compare>
+void parallel_sort(RandomAccessIterator begin, RandomAccessIterator end, const Compare& compare) {
+	std::sort(begin, end, compare);
+}
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// Partitioning hints, a serial loop has a single partition
+class auto_partitioner { };
+class simple_partitioner { };
+class static_partitioner { };
+class affinity_partitioner { };
+
+}
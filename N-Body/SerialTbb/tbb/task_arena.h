@@ -0,0 +1,37 @@
+#pragma once
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// The calling thread is the whole arena
+class task_arena {
+public:
+	static const int automatic = -1;
+
+	explicit task_arena(int = automatic, unsigned = 1) { }
+
+	void initialize() { }
+
+	int max_concurrency() const {
+		return 1;
+	}
+
+	template <typename Function>
+	void execute(const Function& function) {
+		function();
+	}
+};
+
+namespace this_task_arena {
+
+inline int current_thread_index() {
+	return 0;
+}
+
+inline int max_concurrency() {
+	return 1;
+}
+
+}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "task_arena.h"
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// The only thread enters when observing starts and leaves when it stops
+class task_scheduler_observer {
+	bool observing_;
+public:
+	task_scheduler_observer() : observing_(false) { }
+	explicit task_scheduler_observer(task_arena&) : observing_(false) { }
+	virtual ~task_scheduler_observer() { }
+
+	void observe(bool state = true) {
+		if (state == observing_)
+			return;
+		observing_ = state;
+		if (state)
+			on_scheduler_entry(false);
+		else
+			on_scheduler_exit(false);
+	}
+
+	bool is_observing() const {
+		return observing_;
+	}
+
+	virtual void on_scheduler_entry(bool) { }
+	virtual void on_scheduler_exit(bool) { }
+};
+
+}
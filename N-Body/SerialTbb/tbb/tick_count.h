@@ -0,0 +1,32 @@
+#pragma once
+#include <chrono>
+
+// Serial stand-in for Thread Building Blocks, used when the library is not available
+namespace tbb {
+
+// Wall clock time stamp
+class tick_count {
+	std::chrono::steady_clock::time_point time_;
+public:
+	class interval_t {
+		double seconds_;
+	public:
+		explicit interval_t(double seconds = 0.0) : seconds_(seconds) { }
+
+		double seconds() const {
+			return seconds_;
+		}
+	};
+
+	static tick_count now() {
+		tick_count current;
+		current.time_ = std::chrono::steady_clock::now();
+		return current;
+	}
+
+	friend interval_t operator-(const tick_count& end, const tick_count& begin) {
+		return interval_t(std::chrono::duration<double>(end.time_ - begin.time_).count());
+	}
+};
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
 
 // Default N-Body simulation settings
 
@@ -8,9 +9,41 @@ static const bool SAVE_PNG = true;
 
 static const bool SAVE_INTERMEDIATE_PNG_STEPS = false;
 static const int SAVE_PNG_EVERY = 500;
+static const size_t OUTPUT_QUEUE_CAPACITY = 4; // Frames waiting for the background png encoder
+
+// Intermediate frames can be appended to one frame stream per simulation instead of one png per frame
+enum FrameStreamEncoding { FRAME_STREAM_RAW, FRAME_STREAM_DELTA, FRAME_STREAM_PIPE_RGB };
+static const bool STREAM_INTERMEDIATE_FRAMES = false;
+static const FrameStreamEncoding DEFAULT_FRAME_STREAM_ENCODING = FRAME_STREAM_DELTA;
+static const uint32_t FRAME_STREAM_KEYFRAME_EVERY = 100; // Delta streams restart from a full frame that often
+static const size_t RASTERIZER_GRAIN = 16384; // Particles or pixels per parallel rasterizer chunk
+static const size_t PARALLEL_DEFLATE_CHUNK_SIZE = 131072; // Bytes of filtered image data deflated by each png encoding task
+
+// Png encoder presets, the default lets lodepng choose the color type, the fast ones write the density levels directly
+enum PngEncoderPreset { PNG_PRESET_DEFAULT, PNG_PRESET_FAST_PALETTE, PNG_PRESET_FAST_GREYSCALE };
+static const PngEncoderPreset DEFAULT_PNG_PRESET = PNG_PRESET_FAST_PALETTE;
+static const unsigned PNG_FAST_WINDOW_SIZE = 512; // LZ77 window of the fast presets, a power of two
+
+static const bool SAVE_CHECKPOINTS = false; // Restartable snapshots of the parallel simulations
+static const int SAVE_CHECKPOINT_EVERY = 10000;
+static const bool RESTART_FROM_CHECKPOINT = false;
+static const char* const RESTART_CHECKPOINT_FILENAME = "checkpoint_parallel_barnes_hut.snap";
+
+// Compressed snapshots for analysis, much smaller than the checkpoints but quantized and reordered
+static const bool SAVE_COMPRESSED_SNAPSHOTS = false;
+static const int SAVE_COMPRESSED_SNAPSHOT_EVERY = 1000;
+static const size_t COMPRESSED_SNAPSHOT_CHUNK_SIZE = 65536; // Particles per independently compressed chunk of a column
+static const uint32_t POSITION_QUANTIZATION_BITS = 16; // Relative to the universe bounds, 0 keeps the full float
+static const uint32_t VELOCITY_QUANTIZATION_BITS = 16; // Relative to the velocity range of the snapshot, 0 keeps the full float
+static const bool MORTON_ORDER_SNAPSHOTS = true; // Neighbouring particles compress better when stored next to each other
 
 static const int DEFAULT_NUMBER_OF_THREADS = 4;
 
+// Placement of the simulation threads, pinned to one core each or to the cores of a NUMA node
+enum ThreadPinning { PIN_NONE, PIN_CORES, PIN_NUMA_NODES };
+static const ThreadPinning DEFAULT_THREAD_PINNING = PIN_NONE;
+static const size_t FIRST_TOUCH_ALIGNMENT = 4096; // Particle buffers start on a page, they are first touched by their threads
+
 static const int DEFAULT_PARTICLE_COUNT = 10;
 static const float DEFAULT_TOTAL_TIME_STEPS = 10.0f;
 static const float TIME_STEP = 0.01f;
@@ -20,11 +53,71 @@ static const float MIN_DISTANCE = 10.0f;
 static const float MAX_RANDOM = 1.0f;
 static const float MAX_MASS = 1.0f;
 
+static const uint64_t DEFAULT_RANDOM_SEED = 20151208; // Same seed, same universe
+static const size_t PARTICLE_GENERATION_GRAIN = 4096; // Particles generated per parallel chunk
+
+// Initial conditions of the universe
+enum InitialCondition { UNIFORM_RANDOM, PLUMMER_SPHERE, EXPONENTIAL_DISK, SONEIRA_PEEBLES_CLUSTERS };
+static const InitialCondition DEFAULT_INITIAL_CONDITION = UNIFORM_RANDOM;
+
+static const float PLUMMER_RADIUS_FRACTION = 0.125f; // Plummer scale radius relative to the truncation radius
+static const float DISK_TRUNCATION_SCALE_LENGTHS = 5.0f; // Exponential disk is cut off after that many scale lengths
+static const int CLUSTER_LEVELS = 6; // Soneira-Peebles hierarchy depth
+static const int CLUSTER_SUBCLUMPS = 4; // Sub-clumps per clump, on every level
+static const float CLUSTER_RADIUS_RATIO = 2.2f; // Parent clump radius over sub-clump radius
+
+// Walls of the universe, particles bounce off them or wrap around them and feel all the periodic images of the masses
+enum BoundaryCondition { BOUNDARY_REFLECTIVE, BOUNDARY_PERIODIC };
+static const BoundaryCondition DEFAULT_BOUNDARY_CONDITION = BOUNDARY_REFLECTIVE;
+static const size_t EWALD_TABLE_SIZE = 64; // Ewald correction entries per side of a quarter of the universe
+
 static const float GRAVITATIONAL_CONSTANT = 6.673e-11f;
+
+// Interaction kernel of the direct sum and Barnes-Hut engines, chosen once per run among the compiled combinations
+// Mixed precision computes the pairs in float and sums them in double, compensated precision sums them in Kahan float pairs
+enum KernelPrecision { PRECISION_FLOAT, PRECISION_DOUBLE, PRECISION_MIXED, PRECISION_COMPENSATED };
+enum SofteningLaw { SOFTENING_CLAMP, SOFTENING_PLUMMER, SOFTENING_SPLINE };
+static const KernelPrecision DEFAULT_KERNEL_PRECISION = PRECISION_FLOAT;
+static const SofteningLaw DEFAULT_SOFTENING_LAW = SOFTENING_CLAMP;
+static const bool DEFAULT_ACCUMULATE_POTENTIAL = false;
+static const float SOFTENING_LENGTH = 3.1622777f; // Plummer radius, the square root of MIN_DISTANCE
+static const float SPLINE_SUPPORT_LENGTHS = 2.8f; // Support of the spline in softening lengths, same central potential as Plummer
 static const float THETA = 0.5f;
 
 static const uint8_t MAX_TREE_DEPTH = 100;
 
+// Particle-mesh engine, the grid covers the universe and is padded to twice its size for the isolated convolution
+static const size_t PM_GRID_SIZE = 256; // Cells per side, rounded up to a power of two
+static const size_t PM_ASSIGNMENT_GRAIN = 16384; // Particles per parallel mass assignment chunk
+static const size_t FFT_COLUMN_GRAIN = 8; // Grid columns gathered and transformed per parallel chunk
+static const float PM_PERIODIC_SPLIT_SCALE_CELLS = 2.0f; // Periodic grids sum the images beyond this Gaussian scale in Fourier space
+
+// TreePM engine, the force is split with a Gaussian between the particle-mesh grid and a tree walk limited to the cutoff
+static const float TREE_PM_SPLIT_SCALE_CELLS = 1.25f; // Split scale in mesh cells
+static const float TREE_PM_CUTOFF_SCALES = 4.5f; // Cutoff radius in split scales, the short range force is below 2% there
+static const size_t TREE_PM_TABLE_SIZE = 4096; // Tabulated short range factors, by squared distance
+
+// Positions of the particles, floats or 32 bit fixed point coordinates of the universe box
+enum PositionFormat { POSITION_FLOAT, POSITION_FIXED_POINT };
+static const PositionFormat DEFAULT_POSITION_FORMAT = POSITION_FLOAT;
+
+// Fast reductions depend on the scheduling of the threads, deterministic ones sum in a fixed order
+enum ReductionMode { REDUCTION_FAST, REDUCTION_DETERMINISTIC };
+static const ReductionMode DEFAULT_REDUCTION_MODE = REDUCTION_FAST;
+static const size_t DETERMINISTIC_BLOCK_COUNT = 32; // Fixed blocks of particles of the deterministic mass assignment
+static const float FAST_REDUCTION_TOLERANCE = 1e-4f; // Relative difference allowed between the serial and the fast parallel direct sums
+
+// Collisions of the planar engines, particles closer than the clamp of the force merge at the start of a step
+static const bool DEFAULT_MERGE_COLLISIONS = false;
+static const float COLLISION_DISTANCE_SQUARE = MIN_DISTANCE;
+static const size_t PREFIX_SUM_GRAIN = 16384; // Values per block of the parallel prefix sums of the spatial hash
+
+// In-situ friends-of-friends groups of the planar engines, small catalogs of the groups instead of full snapshots
+static const bool SAVE_HALO_CATALOGS = false;
+static const int SAVE_HALO_CATALOG_EVERY = 1000;
+static const float FOF_LINKING_FRACTION = 0.2f; // Linking length over the mean distance between the particles
+static const uint32_t FOF_MIN_GROUP_SIZE = 20; // Smaller groups are left out of the catalogs
+
 static const int UNIVERSE_SIZE_X = 300;
 static const int UNIVERSE_SIZE_Y = 300;
 
@@ -0,0 +1,675 @@
+#include "Simulation.h"
+#include "InteractionKernel.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <utility>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/partitioner.h>
+
+Simulation::Simulation(SimulationEngine engine, const std::string& name, const std::vector<Particle>& particles, size_t universe_size_x,
+	size_t universe_size_y, float time_step, float start_time, BoundaryCondition boundary_condition) : engine_(engine), name_(name),
+	universe_size_x_(universe_size_x), universe_size_y_(universe_size_y), time_step_(time_step), time_(start_time),
+	boundary_condition_(boundary_condition), kernel_precision_(DEFAULT_KERNEL_PRECISION), softening_law_(DEFAULT_SOFTENING_LAW),
+	accumulate_potential_(DEFAULT_ACCUMULATE_POTENTIAL), reduction_mode_(REDUCTION_FAST), position_format_(POSITION_FLOAT),
+	merged_pair_count_(0), save_halo_catalogs_(false), halo_catalog_seed_(0), direct_sum_step_(nullptr), tree_walk_(nullptr),
+	output_pipeline_(nullptr), checkpoint_writer_(nullptr), snapshot_writer_(nullptr), png_step_counter_(0), checkpoint_step_counter_(0),
+	snapshot_step_counter_(0), halo_catalog_step_counter_(0) {
+
+	particles_.assign(particles.begin(), particles.end());
+
+	if (engine_ == ENGINE_SERIAL_BARNES_HUT || engine_ == ENGINE_PARALLEL_BARNES_HUT || engine_ == ENGINE_TREE_PM)
+		tree_particles_.resize(particles.size());
+	if (boundary_condition_ == BOUNDARY_PERIODIC)
+		periodic_box_.reset(new PeriodicBox(static_cast<float>(universe_size_x), static_cast<float>(universe_size_y)));
+	if (engine_ == ENGINE_PARTICLE_MESH)
+		particle_mesh_.reset(new ParticleMesh(PM_GRID_SIZE, universe_size_x, universe_size_y, nullptr, boundary_condition_));
+
+	// The split scale follows the mesh cells, the mesh only resolves the force beyond a few of them
+	if (engine_ == ENGINE_TREE_PM) {
+		float cell_size = static_cast<float>(std::max(universe_size_x, universe_size_y)) / PM_GRID_SIZE;
+		float split_scale = TREE_PM_SPLIT_SCALE_CELLS * cell_size;
+		force_split_.reset(new ForceSplit(split_scale, TREE_PM_CUTOFF_SCALES * split_scale));
+		particle_mesh_.reset(new ParticleMesh(PM_GRID_SIZE, universe_size_x, universe_size_y, force_split_.get(), boundary_condition_));
+	}
+
+	set_reduction_mode(DEFAULT_REDUCTION_MODE);
+	set_position_format(DEFAULT_POSITION_FORMAT);
+	set_collision_merging(DEFAULT_MERGE_COLLISIONS);
+}
+
+void Simulation::set_output_pipeline(OutputPipeline* output_pipeline) {
+	output_pipeline_ = output_pipeline;
+}
+
+void Simulation::set_checkpoint_writer(CheckpointWriter* checkpoint_writer) {
+	checkpoint_writer_ = checkpoint_writer;
+}
+
+void Simulation::set_snapshot_writer(CompressedSnapshotWriter* snapshot_writer) {
+	snapshot_writer_ = snapshot_writer;
+}
+
+void Simulation::set_halo_catalogs(bool save_halo_catalogs, uint64_t seed) {
+	save_halo_catalogs_ = save_halo_catalogs;
+	halo_catalog_seed_ = seed;
+}
+
+bool Simulation::set_interaction_kernel(KernelPrecision precision, SofteningLaw softening_law, bool accumulate_potential) {
+	bool is_default_kernel = precision == PRECISION_FLOAT && softening_law == SOFTENING_CLAMP && !accumulate_potential;
+	if (periodic_box_ != nullptr && !is_default_kernel)
+		return false; // The Ewald corrected kernel only exists in float with the clamped law
+
+	kernel_precision_ = precision;
+	softening_law_ = softening_law;
+	accumulate_potential_ = accumulate_potential;
+	select_kernel_steps();
+	return true;
+}
+
+void Simulation::set_reduction_mode(ReductionMode reduction_mode) {
+	reduction_mode_ = reduction_mode;
+	if (particle_mesh_ != nullptr)
+		particle_mesh_->set_deterministic(reduction_mode_ == REDUCTION_DETERMINISTIC);
+	select_kernel_steps();
+}
+
+bool Simulation::set_position_format(PositionFormat position_format) {
+	if (periodic_box_ != nullptr && position_format == POSITION_FIXED_POINT)
+		return false; // The nearest images and the Ewald corrections work on the float positions
+
+	position_format_ = position_format;
+	if (position_format_ == POSITION_FIXED_POINT && fixed_point_box_ == nullptr) {
+		fixed_point_box_.reset(new FixedPointBox(static_cast<float>(universe_size_x_), static_cast<float>(universe_size_y_)));
+		move_to_fixed_point_grid(false);
+	} else if (position_format_ == POSITION_FLOAT) {
+		fixed_point_box_.reset();
+		fixed_positions_.clear();
+	}
+	select_kernel_steps();
+	return true;
+}
+
+void Simulation::set_collision_merging(bool merge_collisions) {
+	if (!merge_collisions)
+		collision_merger_.reset();
+	else if (collision_merger_ == nullptr)
+		collision_merger_.reset(new CollisionMerger(COLLISION_DISTANCE_SQUARE, periodic_box_.get()));
+}
+
+template <typename Kernel>
+void Simulation::select_kernel_steps(bool fixed_point) {
+	direct_sum_step_ = fixed_point ? &Simulation::step_direct_sum<Kernel, true> : &Simulation::step_direct_sum<Kernel, false>;
+	tree_walk_ = &Simulation::walk_tree<Kernel>;
+}
+
+template <typename Scalar, typename Softening, typename Accumulator>
+void Simulation::select_kernel_steps(bool accumulate_potential, bool fixed_point) {
+	if (accumulate_potential)
+		select_kernel_steps<InteractionKernel<Scalar, Softening, true, Accumulator>>(fixed_point);
+	else
+		select_kernel_steps<InteractionKernel<Scalar, Softening, false, Accumulator>>(fixed_point);
+}
+
+template <typename Softening>
+void Simulation::select_kernel_steps(KernelPrecision precision, bool accumulate_potential, bool fixed_point) {
+	switch (precision) {
+	case PRECISION_DOUBLE:
+		select_kernel_steps<double, Softening, double>(accumulate_potential, fixed_point);
+		break;
+	case PRECISION_MIXED:
+		select_kernel_steps<float, Softening, double>(accumulate_potential, fixed_point);
+		break;
+	case PRECISION_COMPENSATED:
+		select_kernel_steps<float, Softening, CompensatedFloat>(accumulate_potential, fixed_point);
+		break;
+	default:
+		select_kernel_steps<float, Softening, float>(accumulate_potential, fixed_point);
+		break;
+	}
+}
+
+// Pick the specialized direct sum step and tree walk once, the steps of the run call them without looking at the kernel
+// settings again. The original float clamp kernel keeps the pairwise steps, unless the reductions are deterministic, and
+// the walk of the particle methods. The kernel steps gather every particle on its own, their sums never depend on the
+// threads. Fixed point positions always take the kernel direct sums, which read the exact displacements of the
+// coordinates
+void Simulation::select_kernel_steps() {
+	potentials_.assign(accumulate_potential_ ? particles_.size() : 0, 0.0);
+	bool fixed_point = position_format_ == POSITION_FIXED_POINT;
+
+	if (softening_law_ == SOFTENING_PLUMMER)
+		select_kernel_steps<PlummerSoftening>(kernel_precision_, accumulate_potential_, fixed_point);
+	else if (softening_law_ == SOFTENING_SPLINE)
+		select_kernel_steps<SplineSoftening>(kernel_precision_, accumulate_potential_, fixed_point);
+	else
+		select_kernel_steps<ClampSoftening>(kernel_precision_, accumulate_potential_, fixed_point);
+
+	if (kernel_precision_ == PRECISION_FLOAT && softening_law_ == SOFTENING_CLAMP && !accumulate_potential_) {
+		tree_walk_ = &Simulation::walk_tree;
+		if (fixed_point)
+			return;
+		if (engine_ == ENGINE_SERIAL)
+			direct_sum_step_ = &Simulation::step_serial;
+		else
+			direct_sum_step_ = reduction_mode_ == REDUCTION_DETERMINISTIC ? &Simulation::step_tbb_deterministic : &Simulation::step_tbb;
+	}
+}
+
+// Build a new quad tree over the tree particles, which must already hold the particles of this step. Fixed point trees
+// take their quadrants from the bits of the coordinates and the particles are inserted along the Morton curve, so the
+// tree is the same whatever the order of the particles
+QuadParticleTree* Simulation::build_quad_tree() {
+	if (fixed_point_box_ == nullptr) {
+		QuadParticleTree* quad_tree = new QuadParticleTree(Particle(0.0f, 0.0f, 0.0f), //Crate a new quad tree with limits from zero, up to grid size x and y
+			Particle(static_cast<float>(universe_size_x_) * 2, static_cast<float>(universe_size_y_) * 2, 0.0f)); // x2 due to an issue on the tree min/max bounds
+
+		// Must be performed serially. Parallel version requires lots of safe regions anyway
+		for (TreeParticle& tree_particle : tree_particles_)
+			quad_tree->insert(&tree_particle);
+
+		return quad_tree;
+	}
+
+	size_t particle_count = tree_particles_.size();
+	morton_order_.resize(particle_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			tree_particles_[index].set_fixed_position(fixed_positions_[index]);
+			morton_order_[index] = std::make_pair(fixed_positions_[index].get_morton_key(), static_cast<uint32_t>(index));
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+	tbb::parallel_sort(morton_order_.begin(), morton_order_.end());
+
+	// The root covers the universe exactly, the node at depth k splits at bit 31 - k of the coordinates
+	Particle half_size(static_cast<float>(universe_size_x_) / 2, static_cast<float>(universe_size_y_) / 2, 0.0f);
+	QuadParticleTree* quad_tree = new QuadParticleTree(half_size, half_size, true);
+	for (const std::pair<uint64_t, uint32_t>& entry : morton_order_)
+		quad_tree->insert(&tree_particles_[entry.second]);
+
+	return quad_tree;
+}
+
+const FixedPosition* Simulation::get_fixed_position(size_t index) const {
+	return fixed_point_box_ != nullptr ? &fixed_positions_[index] : nullptr;
+}
+
+// Round the particles to the nearest fixed point positions, their float positions follow. Only the particles that left
+// their fixed point positions are rounded again when the positions are kept, the float positions lose bits of the others
+void Simulation::move_to_fixed_point_grid(bool keep_positions) {
+	size_t particle_count = particles_.size();
+	fixed_positions_.resize(particle_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			Particle& particle = particles_[index];
+			if (keep_positions) {
+				Particle grid_particle = particle;
+				fixed_point_box_->to_float(fixed_positions_[index], grid_particle);
+				if (grid_particle.x_ == particle.x_ && grid_particle.y_ == particle.y_)
+					continue;
+			}
+			fixed_positions_[index] = fixed_point_box_->to_fixed(particle);
+			fixed_point_box_->to_float(fixed_positions_[index], particle);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+}
+
+// Move a particle in time, it bounces off the walls of the universe or wraps around them
+void Simulation::advance_particle(size_t index) {
+	Particle& particle = particles_[index];
+	if (fixed_point_box_ != nullptr)
+		fixed_point_box_->advance(particle, fixed_positions_[index], time_step_);
+	else if (periodic_box_ != nullptr)
+		particle.advance_periodic(time_step_, periodic_box_->get_size_x(), periodic_box_->get_size_y());
+	else
+		particle.advance(time_step_, static_cast<float>(universe_size_x_), static_cast<float>(universe_size_y_));
+}
+
+// Merge the close pairs before the forces of the step, the buffers that follow the particles shrink with them
+void Simulation::merge_collisions() {
+	size_t merged_pair_count = collision_merger_->merge(particles_);
+	if (merged_pair_count == 0)
+		return;
+	merged_pair_count_ += merged_pair_count;
+	if (fixed_point_box_ != nullptr) {
+		collision_merger_->compact(fixed_positions_);
+		fixed_positions_.resize(particles_.size());
+		move_to_fixed_point_grid(true);
+	}
+	if (!tree_particles_.empty())
+		tree_particles_.resize(particles_.size());
+	if (accumulate_potential_)
+		potentials_.resize(particles_.size());
+}
+
+// Walk of the particle methods, nearest images and Ewald corrections when periodic
+void Simulation::walk_tree(const QuadParticleTree& quad_tree, size_t index) {
+	quad_tree.apply_acceleration(particles_[index], periodic_box_.get(), get_fixed_position(index));
+}
+
+// Walk with the interaction kernel of the run, summed in its accumulator and rounded once to the particle
+template <typename Kernel>
+void Simulation::walk_tree(const QuadParticleTree& quad_tree, size_t index) {
+	typedef typename Kernel::AccumulatorType Accumulator;
+	Accumulator acceleration[2] = { Accumulator(0), Accumulator(0) };
+	Accumulator potential = Accumulator(0);
+	quad_tree.apply_acceleration<Kernel>(particles_[index], acceleration, potential, get_fixed_position(index));
+
+	particles_[index].acceleration_x_ += static_cast<float>(acceleration[0]);
+	particles_[index].acceleration_y_ += static_cast<float>(acceleration[1]);
+	if (accumulate_potential_)
+		potentials_[index] = static_cast<double>(potential);
+}
+
+// Advance one step with the direct sum, serially
+void Simulation::step_serial() {
+	size_t particle_count = particles_.size();
+
+	// Calculate all the applied forces as acceleration on every particle
+	for (size_t i = 0; i < particle_count; ++i) {
+		for (size_t j = 0; j < particle_count; ++j) {
+			if (j == i)
+				continue;
+			if (periodic_box_ != nullptr)
+				periodic_box_->add_acceleration(particles_[i], particles_[j]); // Nearest image and Ewald correction
+			else
+				particles_[i].add_acceleration(particles_[j]); // Gather and apply force for every point combination
+		}
+	}
+
+	for (size_t index = 0; index < particle_count; ++index)
+		advance_particle(index); // Advance the particle posiitions in time
+}
+
+// Advance one step with the Barnes-Hut approximation, serially
+void Simulation::step_serial_barnes_hut() {
+	for (size_t index = 0; index < particles_.size(); ++index)
+		tree_particles_[index].set_particle(particles_[index]);
+	QuadParticleTree* quad_tree = build_quad_tree();
+
+	// Apply acceleration force to all the particles of the vector
+	for (size_t index = 0; index < particles_.size(); ++index)
+		(this->*tree_walk_)(*quad_tree, index);
+
+	// Advance the particles in time
+	for (size_t index = 0; index < particles_.size(); ++index)
+		advance_particle(index); // Advance the particle positions in time
+
+	// Recursively de-allocate the tree
+	delete quad_tree;
+}
+
+// Advance one step with the Barnes-Hut approximation, the tree is walked in parallel
+void Simulation::step_parallel_barnes_hut() {
+	size_t particle_count = particles_.size();
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			tree_particles_[index].set_particle(particles_[index]);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+	QuadParticleTree* quad_tree = build_quad_tree();
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			(this->*tree_walk_)(*quad_tree, index);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+
+	// Now that all the new accelerations were calculated, advance the particles in time
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			advance_particle(index);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+
+	// Recursively de-allocate the tree
+	delete quad_tree;
+}
+
+// Advance one step with the direct sum, using Thread Bulding Blocks parallelization. Every pair is computed once, the
+// reaction on the interacting particle goes to the acceleration buffer of the thread, so the threads never write to the
+// same memory. The buffers are summed before the particles advance
+void Simulation::step_tbb() {
+	size_t particle_count = particles_.size();
+	const Particle* particles = particles_.data(); // Contiguous, the inner loop is a plain strided walk
+
+	const PeriodicBox* periodic_box = periodic_box_.get();
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get the range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		std::vector<float>& local_accelerations = local_accelerations_.local(); // x and y of every particle
+		if (local_accelerations.size() != 2 * particle_count)
+			local_accelerations.assign(2 * particle_count, 0.0f);
+
+		for (size_t i = r.begin(); i != r.end(); ++i) {
+			const Particle& current_particle = particles[i];
+			float acceleration[2] = { local_accelerations[2 * i], local_accelerations[2 * i + 1] }; // Thread local variable
+			for (size_t j = i + 1; j < particle_count; ++j) { // Calculate pairs of accelerations
+				const Particle& interacting_particle = particles[j];
+				float interacting_acceleration[2] = { local_accelerations[2 * j], local_accelerations[2 * j + 1] };
+				if (periodic_box != nullptr) { // Nearest images and Ewald corrections
+					Particle particle(current_particle.x_, current_particle.y_, 0.0f, 0.0f, current_particle.mass_, acceleration[0], acceleration[1]);
+					Particle reacting_particle(interacting_particle.x_, interacting_particle.y_, 0.0f, 0.0f, interacting_particle.mass_,
+						interacting_acceleration[0], interacting_acceleration[1]);
+					periodic_box->add_acceleration_pairwise(particle, reacting_particle);
+					acceleration[0] = particle.acceleration_x_;
+					acceleration[1] = particle.acceleration_y_;
+					interacting_acceleration[0] = reacting_particle.acceleration_x_;
+					interacting_acceleration[1] = reacting_particle.acceleration_y_;
+				} else {
+					const float displacement[2] = { interacting_particle.x_ - current_particle.x_, interacting_particle.y_ - current_particle.y_ };
+					float potential = 0.0f, interacting_potential = 0.0f; // Not accumulated by the default kernel
+					DefaultKernel::add_acceleration_pairwise(displacement, current_particle.mass_, interacting_particle.mass_, acceleration,
+						interacting_acceleration, potential, interacting_potential);
+				}
+				local_accelerations[2 * j] = interacting_acceleration[0];
+				local_accelerations[2 * j + 1] = interacting_acceleration[1];
+			}
+			local_accelerations[2 * i] = acceleration[0];
+			local_accelerations[2 * i + 1] = acceleration[1];
+		}
+	}); // Implicit barrier for all the points of the simulation
+
+	// Now that all the new accelerations were calculated, sum them and advance the particles in time. The buffers are
+	// cleared for the next step, the ones of a larger particle count before merging are left alone
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			Particle& current_particle = particles_[index];
+			for (std::vector<float>& local_accelerations : local_accelerations_) {
+				if (local_accelerations.size() != 2 * particle_count)
+					continue;
+				current_particle.acceleration_x_ += local_accelerations[2 * index];
+				current_particle.acceleration_y_ += local_accelerations[2 * index + 1];
+				local_accelerations[2 * index] = 0.0f;
+				local_accelerations[2 * index + 1] = 0.0f;
+			}
+			advance_particle(index);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier, same partitioning as the first touch of the particles
+}
+
+// Advance one step with the direct sum in parallel, without the pairwise updates of step_tbb whose sums depend on the
+// ranges of the threads. Every particle gathers the pull of the others in the order of step_serial, so the particles are
+// the ones of the serial engine whatever the number of threads
+void Simulation::step_tbb_deterministic() {
+	size_t particle_count = particles_.size();
+	Particle* particles = particles_.data();
+
+	const PeriodicBox* periodic_box = periodic_box_.get();
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get the range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t i = r.begin(); i != r.end(); ++i) {
+			Particle current_particle = particles[i]; // Thread local variable
+			for (size_t j = 0; j < particle_count; ++j) {
+				if (j == i)
+					continue;
+				if (periodic_box != nullptr)
+					periodic_box->add_acceleration(current_particle, particles[j]); // Nearest image and Ewald correction
+				else
+					current_particle.add_acceleration(particles[j]);
+			}
+
+			// Only the accelerations are stored back, the other threads keep reading the positions
+			particles[i].acceleration_x_ = current_particle.acceleration_x_;
+			particles[i].acceleration_y_ = current_particle.acceleration_y_;
+		}
+	}, tbb::static_partitioner()); // Implicit barrier for all the points of the simulation
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			advance_particle(index);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+}
+
+// Advance one step with the direct sum and the interaction kernel of the run. Every particle gathers the pull of all the
+// others in the precision of the kernel, serially or in parallel, so the threads never write to the same particle
+template <typename Kernel, bool FIXED_POINT>
+void Simulation::step_direct_sum() {
+	typedef typename Kernel::ScalarType Scalar;
+	typedef typename Kernel::AccumulatorType Accumulator;
+	size_t particle_count = particles_.size();
+	Particle* particles = particles_.data();
+	const FixedPosition* fixed_positions = fixed_positions_.data();
+	const FixedPointBox* fixed_point_box = fixed_point_box_.get();
+	double* potentials = accumulate_potential_ ? potentials_.data() : nullptr;
+
+	auto gather_accelerations = [&](size_t begin, size_t end) {
+		for (size_t i = begin; i != end; ++i) {
+			const Scalar x = particles[i].x_;
+			const Scalar y = particles[i].y_;
+			Accumulator acceleration[2] = { Accumulator(0), Accumulator(0) };
+			Accumulator potential = Accumulator(0);
+
+			// Split around the particle itself, no branch in the inner loops
+			auto add_range = [&](size_t first, size_t last) {
+				for (size_t j = first; j < last; ++j) {
+					Scalar displacement[2];
+					if (FIXED_POINT) { // Exact differences of the coordinates, rounded once
+						fixed_point_box->get_displacement(fixed_positions[i], fixed_positions[j], displacement);
+					} else {
+						displacement[0] = static_cast<Scalar>(particles[j].x_) - x;
+						displacement[1] = static_cast<Scalar>(particles[j].y_) - y;
+					}
+					Kernel::add_acceleration(displacement, static_cast<Scalar>(particles[j].mass_), acceleration, potential);
+				}
+			};
+			add_range(0, i);
+			add_range(i + 1, particle_count);
+
+			// Only the accelerations are stored back, the other threads keep reading the positions
+			particles[i].acceleration_x_ += static_cast<float>(acceleration[0]);
+			particles[i].acceleration_y_ += static_cast<float>(acceleration[1]);
+			if (potentials != nullptr)
+				potentials[i] = static_cast<double>(potential);
+		}
+	};
+
+	if (engine_ == ENGINE_SERIAL) {
+		gather_accelerations(0, particle_count);
+	} else {
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get the range for this thread
+			[&](const tbb::blocked_range<size_t>& r) {
+			gather_accelerations(r.begin(), r.end());
+		}, tbb::static_partitioner()); // Implicit barrier for all the points of the simulation
+	}
+
+	if (engine_ == ENGINE_SERIAL) {
+		for (size_t index = 0; index < particle_count; ++index)
+			advance_particle(index);
+		return;
+	}
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			advance_particle(index);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+}
+
+// Advance one step with the particle-mesh approximation of the field, O(N + G log G) for a grid of G cells
+void Simulation::step_particle_mesh() {
+	size_t particle_count = particles_.size();
+	particle_mesh_->apply_acceleration(particles_.data(), particle_count);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			advance_particle(index);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+}
+
+// Advance one step with the TreePM split, the long range force from the mesh and the short range force from a tree
+// walk that stops at the cutoff
+void Simulation::step_tree_pm() {
+	size_t particle_count = particles_.size();
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			tree_particles_[index].set_particle(particles_[index]);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+	QuadParticleTree* quad_tree = build_quad_tree();
+	quad_tree->compute_mass_distribution();
+
+	particle_mesh_->apply_acceleration(particles_.data(), particle_count);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			quad_tree->apply_short_range_acceleration(particles_[index], &tree_particles_[index], *force_split_, periodic_box_.get());
+		}
+	}); // Implicit barrier, the walks differ in length so the range is balanced dynamically
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count), // Get range for this thread
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			advance_particle(index);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+
+	// Recursively de-allocate the tree
+	delete quad_tree;
+}
+
+// Hand the state after a step to the outputs that are due
+void Simulation::save_outputs(float step_start_time) {
+	size_t particle_count = particles_.size();
+
+	++png_step_counter_;
+	if (output_pipeline_ != nullptr && SAVE_INTERMEDIATE_PNG_STEPS && SAVE_PNG && png_step_counter_ >= SAVE_PNG_EVERY) { // Save the intermediate step
+		png_step_counter_ = 0;
+		output_pipeline_->submit_step(particles_, particle_count, universe_size_x_, universe_size_y_, "universe_" + name_, step_start_time);
+	}
+
+	++checkpoint_step_counter_;
+	if (checkpoint_writer_ != nullptr && checkpoint_step_counter_ >= SAVE_CHECKPOINT_EVERY) { // Save a restartable snapshot
+		checkpoint_step_counter_ = 0;
+		if (!checkpoint_writer_->save(particles_, particle_count, time_))
+			std::cerr << "Could not write the previous checkpoint of " << name_ << std::endl;
+	}
+
+	++snapshot_step_counter_;
+	if (snapshot_writer_ != nullptr && snapshot_step_counter_ >= SAVE_COMPRESSED_SNAPSHOT_EVERY) { // Save a compressed analysis snapshot
+		snapshot_step_counter_ = 0;
+		std::string file_name = "snapshot_" + name_ + "_timestep_" + std::to_string(time_) + ".csnap";
+		if (!snapshot_writer_->save(file_name, particles_, particle_count, time_))
+			std::cerr << "Could not write " << file_name << std::endl;
+	}
+
+	++halo_catalog_step_counter_;
+	if (save_halo_catalogs_ && halo_catalog_step_counter_ >= SAVE_HALO_CATALOG_EVERY) { // Save the groups instead of the particles
+		halo_catalog_step_counter_ = 0;
+		find_halos();
+		std::string file_name = "halos_" + name_ + "_timestep_" + std::to_string(time_) + ".txt";
+		if (!halo_finder_->save_catalog(file_name, time_, halo_catalog_seed_))
+			std::cerr << "Could not write " << file_name << std::endl;
+	}
+}
+
+const std::vector<HaloGroup>& Simulation::find_halos() {
+	if (halo_finder_ == nullptr)
+		halo_finder_.reset(new HaloFinder(periodic_box_.get()));
+	size_t particle_count = particles_.size();
+	float mean_distance = std::sqrt(static_cast<float>(universe_size_x_) * static_cast<float>(universe_size_y_) /
+		static_cast<float>(std::max<size_t>(particle_count, 1)));
+	return halo_finder_->find_groups(particles_.data(), particle_count, FOF_LINKING_FRACTION * mean_distance);
+}
+
+void Simulation::step() {
+	if (collision_merger_ != nullptr)
+		merge_collisions();
+
+	switch (engine_) {
+	case ENGINE_SERIAL:
+	case ENGINE_TBB:
+		(this->*direct_sum_step_)();
+		break;
+	case ENGINE_SERIAL_BARNES_HUT:
+		step_serial_barnes_hut();
+		break;
+	case ENGINE_PARALLEL_BARNES_HUT:
+		step_parallel_barnes_hut();
+		break;
+	case ENGINE_PARTICLE_MESH:
+		step_particle_mesh();
+		break;
+	case ENGINE_TREE_PM:
+		step_tree_pm();
+		break;
+	}
+
+	float step_start_time = time_;
+	time_ += time_step_;
+	save_outputs(step_start_time);
+}
+
+void Simulation::run(float end_time) {
+	while (time_ < end_time)
+		step();
+}
+
+SimulationEngine Simulation::get_engine() const {
+	return engine_;
+}
+
+BoundaryCondition Simulation::get_boundary_condition() const {
+	return boundary_condition_;
+}
+
+KernelPrecision Simulation::get_kernel_precision() const {
+	return kernel_precision_;
+}
+
+SofteningLaw Simulation::get_softening_law() const {
+	return softening_law_;
+}
+
+ReductionMode Simulation::get_reduction_mode() const {
+	return reduction_mode_;
+}
+
+PositionFormat Simulation::get_position_format() const {
+	return position_format_;
+}
+
+size_t Simulation::get_merged_pair_count() const {
+	return merged_pair_count_;
+}
+
+// Half the sum of the potentials weighted by the masses, every pair is counted from both of its particles
+double Simulation::get_potential_energy() const {
+	double potential_energy = 0.0;
+	for (size_t index = 0; index < potentials_.size(); ++index)
+		potential_energy += 0.5 * particles_[index].mass_ * potentials_[index];
+	return potential_energy;
+}
+
+float Simulation::get_time() const {
+	return time_;
+}
+
+size_t Simulation::get_particle_count() const {
+	return particles_.size();
+}
+
+// Copy of the current particles
+std::vector<Particle> Simulation::get_particles() const {
+	return std::vector<Particle>(particles_.begin(), particles_.end());
+}
+
+const Particle* Simulation::get_particle_data() const {
+	return particles_.data();
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "Particle.h"
+#include "TreeParticle.h"
+#include "QuadParticleTree.h"
+#include "Settings.h"
+#include "OutputPipeline.h"
+#include "Snapshot.h"
+#include "CompressedSnapshot.h"
+#include "FirstTouchAllocator.h"
+#include "ParticleMesh.h"
+#include "PeriodicBox.h"
+#include "CollisionMerger.h"
+#include "HaloFinder.h"
+#include "FixedPoint.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <tbb/enumerable_thread_specific.h>
+
+// Methods that calculate the accelerations and advance the particles
+enum SimulationEngine { ENGINE_SERIAL, ENGINE_SERIAL_BARNES_HUT, ENGINE_PARALLEL_BARNES_HUT, ENGINE_TBB, ENGINE_PARTICLE_MESH, ENGINE_TREE_PM };
+
+// One simulated universe. Owns the particles and the buffers that are reused by every step, the outputs are optional.
+// Construct it inside the arena of the run, the buffers are first touched by the threads of that arena
+class Simulation {
+	SimulationEngine engine_;
+	std::string name_; // Names the intermediate frames and snapshots
+	size_t universe_size_x_;
+	size_t universe_size_y_;
+	float time_step_;
+	float time_;
+	BoundaryCondition boundary_condition_;
+	KernelPrecision kernel_precision_;
+	SofteningLaw softening_law_;
+	bool accumulate_potential_;
+	ReductionMode reduction_mode_;
+	PositionFormat position_format_;
+
+	ParticleVector particles_; // Contiguous and page aligned, the inner loops index it directly
+	TreeParticleVector tree_particles_; // Leaves of the Barnes-Hut trees
+	std::unique_ptr<PeriodicBox> periodic_box_; // Nearest images and Ewald corrections of a periodic universe
+	std::unique_ptr<ForceSplit> force_split_; // Short and long range parts of the force of the TreePM engine
+	std::unique_ptr<ParticleMesh> particle_mesh_; // Grid and transforms of the particle-mesh and TreePM engines
+	tbb::enumerable_thread_specific<std::vector<float>> local_accelerations_; // Reactions of the pairwise direct sum, per thread
+	std::vector<double> potentials_; // Potential per unit mass at the start of the last direct sum or Barnes-Hut step, when accumulated
+	std::unique_ptr<FixedPointBox> fixed_point_box_; // Only with fixed point positions
+	std::vector<FixedPosition> fixed_positions_; // The positions of the particles, their float positions follow them
+	std::vector<std::pair<uint64_t, uint32_t>> morton_order_; // Morton key and particle index, fixed point trees only
+	std::unique_ptr<CollisionMerger> collision_merger_; // Only when the collisions are merged
+	size_t merged_pair_count_;
+	std::unique_ptr<HaloFinder> halo_finder_; // Created on the first search
+	bool save_halo_catalogs_;
+	uint64_t halo_catalog_seed_;
+
+	typedef void (Simulation::*DirectSumStep)();
+	DirectSumStep direct_sum_step_; // Step of the direct sum engines, specialized on the interaction kernel of the run
+	typedef void (Simulation::*TreeWalk)(const QuadParticleTree& quad_tree, size_t index);
+	TreeWalk tree_walk_; // Walk of the Barnes-Hut engines for one particle, specialized on the same kernel
+
+	OutputPipeline* output_pipeline_;
+	CheckpointWriter* checkpoint_writer_;
+	CompressedSnapshotWriter* snapshot_writer_;
+	int png_step_counter_;
+	int checkpoint_step_counter_;
+	int snapshot_step_counter_;
+	int halo_catalog_step_counter_;
+
+	const FixedPosition* get_fixed_position(size_t index) const; // nullptr with float positions
+	void move_to_fixed_point_grid(bool keep_positions);
+	void advance_particle(size_t index);
+	QuadParticleTree* build_quad_tree();
+	void merge_collisions();
+	void step_serial();
+	void step_serial_barnes_hut();
+	void step_parallel_barnes_hut();
+	void step_tbb();
+	void step_tbb_deterministic();
+	template <typename Kernel, bool FIXED_POINT>
+	void step_direct_sum();
+	void walk_tree(const QuadParticleTree& quad_tree, size_t index);
+	template <typename Kernel>
+	void walk_tree(const QuadParticleTree& quad_tree, size_t index);
+	template <typename Kernel>
+	void select_kernel_steps(bool fixed_point);
+	template <typename Scalar, typename Softening, typename Accumulator>
+	void select_kernel_steps(bool accumulate_potential, bool fixed_point);
+	template <typename Softening>
+	void select_kernel_steps(KernelPrecision precision, bool accumulate_potential, bool fixed_point);
+	void select_kernel_steps();
+	void step_particle_mesh();
+	void step_tree_pm();
+	void save_outputs(float step_start_time);
+public:
+	Simulation(SimulationEngine engine, const std::string& name, const std::vector<Particle>& particles, size_t universe_size_x,
+		size_t universe_size_y, float time_step, float start_time = 0.0f, BoundaryCondition boundary_condition = DEFAULT_BOUNDARY_CONDITION);
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	void set_output_pipeline(OutputPipeline* output_pipeline); // Intermediate frames, every SAVE_PNG_EVERY steps
+	void set_checkpoint_writer(CheckpointWriter* checkpoint_writer); // Restartable snapshots, every SAVE_CHECKPOINT_EVERY steps
+	void set_snapshot_writer(CompressedSnapshotWriter* snapshot_writer); // Analysis snapshots, every SAVE_COMPRESSED_SNAPSHOT_EVERY steps
+	// Friends-of-friends catalogs, every SAVE_HALO_CATALOG_EVERY steps. The seed of the run goes in their header
+	void set_halo_catalogs(bool save_halo_catalogs, uint64_t seed);
+	// Arithmetic, softening and potential of the direct sum and Barnes-Hut engines. Periodic universes only have the float
+	// clamped kernel of PeriodicBox, any other kernel is refused and the current one is kept
+	bool set_interaction_kernel(KernelPrecision precision, SofteningLaw softening_law, bool accumulate_potential);
+	// Deterministic reductions sum every force in a fixed order, the particles are the same for any number of threads
+	void set_reduction_mode(ReductionMode reduction_mode);
+	// Positions on a grid of 32 bits per axis over the universe box. The trees read their quadrants from the bits of the
+	// coordinates and insert the particles along the Morton curve, so the trajectories are the same for any number of
+	// threads and any order of the particles. Periodic universes keep the float positions, the grid is refused
+	bool set_position_format(PositionFormat position_format);
+	// Particles closer than COLLISION_DISTANCE_SQUARE merge at the start of every step, the particle count goes down
+	void set_collision_merging(bool merge_collisions);
+
+	void step(); // Advance one time step
+	void run(float end_time); // Advance until the end time
+	SimulationEngine get_engine() const;
+	BoundaryCondition get_boundary_condition() const;
+	KernelPrecision get_kernel_precision() const;
+	SofteningLaw get_softening_law() const;
+	ReductionMode get_reduction_mode() const;
+	PositionFormat get_position_format() const;
+	size_t get_merged_pair_count() const; // Since the start of the run
+	// Friends-of-friends groups of the current particles, linked at FOF_LINKING_FRACTION of their mean distance
+	const std::vector<HaloGroup>& find_halos();
+	double get_potential_energy() const; // At the start of the last step, zero unless the potential is accumulated
+	float get_time() const;
+	size_t get_particle_count() const;
+	std::vector<Particle> get_particles() const;
+	const Particle* get_particle_data() const; // Live particles, valid until the next step changes their count
+};
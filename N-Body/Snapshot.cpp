@@ -0,0 +1,220 @@
+#include "Snapshot.h"
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char SNAPSHOT_MAGIC[8] = { 'N', 'B', 'O', 'D', 'Y', 'S', 'N', 'P' };
+
+// Round a byte offset up to the next aligned offset
+static size_t align_offset(size_t offset) {
+	return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+// Map the whole snapshot file in memory
+SnapshotFile::SnapshotFile(const char* filename) : data_(nullptr), size_(0) {
+#ifdef _WIN32
+	mapping_handle_ = nullptr;
+	file_handle_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle_ == INVALID_HANDLE_VALUE) {
+		file_handle_ = nullptr;
+		return;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle_, &file_size) || file_size.QuadPart == 0) {
+		close();
+		return;
+	}
+
+	mapping_handle_ = CreateFileMappingA(file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle_ == nullptr) {
+		close();
+		return;
+	}
+
+	data_ = static_cast<const char*>(MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+	if (data_ == nullptr) {
+		close();
+		return;
+	}
+	size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+	file_descriptor_ = open(filename, O_RDONLY);
+	if (file_descriptor_ < 0)
+		return;
+
+	struct stat file_status;
+	if (fstat(file_descriptor_, &file_status) != 0 || file_status.st_size == 0) {
+		close();
+		return;
+	}
+
+	void* mapping = mmap(nullptr, static_cast<size_t>(file_status.st_size), PROT_READ, MAP_PRIVATE, file_descriptor_, 0);
+	if (mapping == MAP_FAILED) {
+		close();
+		return;
+	}
+	data_ = static_cast<const char*>(mapping);
+	size_ = static_cast<size_t>(file_status.st_size);
+#endif
+}
+
+SnapshotFile::~SnapshotFile() {
+	close();
+}
+
+// Unmap the file and release the handles
+void SnapshotFile::close() {
+#ifdef _WIN32
+	if (data_ != nullptr)
+		UnmapViewOfFile(data_);
+	if (mapping_handle_ != nullptr)
+		CloseHandle(mapping_handle_);
+	if (file_handle_ != nullptr)
+		CloseHandle(file_handle_);
+	mapping_handle_ = nullptr;
+	file_handle_ = nullptr;
+#else
+	if (data_ != nullptr)
+		munmap(const_cast<char*>(data_), size_);
+	if (file_descriptor_ >= 0)
+		::close(file_descriptor_);
+	file_descriptor_ = -1;
+#endif
+	data_ = nullptr;
+	size_ = 0;
+}
+
+// Check that the mapped file is a complete snapshot of a supported version
+bool SnapshotFile::is_valid() const {
+	if (data_ == nullptr || size_ < sizeof(SnapshotHeader))
+		return false;
+
+	const SnapshotHeader& header = get_header();
+	if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.version != SNAPSHOT_VERSION ||
+		header.byte_order != SNAPSHOT_BYTE_ORDER || header.column_count != SNAPSHOT_COLUMN_COUNT)
+		return false;
+
+	for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+		if (header.column_offset[column] % sizeof(float) != 0 ||
+			header.column_offset[column] + header.particle_count * sizeof(float) > size_)
+			return false;
+	}
+	return true;
+}
+
+const SnapshotHeader& SnapshotFile::get_header() const {
+	return *reinterpret_cast<const SnapshotHeader*>(data_);
+}
+
+const float* SnapshotFile::get_column(SnapshotColumn column) const {
+	return reinterpret_cast<const float*>(data_ + get_header().column_offset[column]);
+}
+
+// Gather the snapshot columns into a particle collection
+void SnapshotFile::to_particles(std::vector<Particle>& particles) const {
+	size_t particle_count = static_cast<size_t>(get_header().particle_count);
+	const float* x = get_column(SNAPSHOT_X);
+	const float* y = get_column(SNAPSHOT_Y);
+	const float* velocity_x = get_column(SNAPSHOT_VELOCITY_X);
+	const float* velocity_y = get_column(SNAPSHOT_VELOCITY_Y);
+	const float* mass = get_column(SNAPSHOT_MASS);
+
+	particles.resize(particle_count);
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			particles[index] = Particle(x[index], y[index], velocity_x[index], velocity_y[index], mass[index], 0.0f, 0.0f);
+		}
+	}); // Implicit barrier
+}
+
+CheckpointWriter::CheckpointWriter(const std::string& filename, uint64_t seed, float time_step, size_t universe_size_x,
+	size_t universe_size_y) : filename_(filename), back_buffer_(0), flush_failed_(false),
+	any_flush_failed_(false) {
+	memset(&header_, 0, sizeof(header_));
+	memcpy(header_.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header_.version = SNAPSHOT_VERSION;
+	header_.byte_order = SNAPSHOT_BYTE_ORDER;
+	header_.seed = seed;
+	header_.time_step = time_step;
+	header_.universe_size_x = static_cast<uint32_t>(universe_size_x);
+	header_.universe_size_y = static_cast<uint32_t>(universe_size_y);
+	header_.column_count = SNAPSHOT_COLUMN_COUNT;
+}
+
+// Make sure the last snapshot reaches the disk
+CheckpointWriter::~CheckpointWriter() {
+	wait();
+}
+
+// Lay out the header and the aligned columns in the buffer that is not being flushed
+char* CheckpointWriter::prepare_back_buffer(size_t particle_count, double time) {
+	header_.particle_count = particle_count;
+	header_.time = time;
+
+	size_t column_size = particle_count * sizeof(float);
+	size_t offset = align_offset(sizeof(SnapshotHeader));
+	for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+		header_.column_offset[column] = offset;
+		offset = align_offset(offset + column_size);
+	}
+
+	std::vector<char>& buffer = buffers_[back_buffer_];
+	buffer.resize(offset);
+
+	// Keep the padding zeroed, so that identical states give identical files
+	memset(buffer.data(), 0, header_.column_offset[0]);
+	for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+		size_t column_end = static_cast<size_t>(header_.column_offset[column]) + column_size;
+		size_t next_column = column + 1 < SNAPSHOT_COLUMN_COUNT ? static_cast<size_t>(header_.column_offset[column + 1]) : offset;
+		memset(buffer.data() + column_end, 0, next_column - column_end);
+	}
+	memcpy(buffer.data(), &header_, sizeof(header_));
+
+	return buffer.data();
+}
+
+// Wait for the previous snapshot, then write the back buffer on a background thread
+bool CheckpointWriter::flush_back_buffer() {
+	bool previous_written = join_flush();
+
+	const std::vector<char>* buffer = &buffers_[back_buffer_];
+	back_buffer_ ^= 1;
+
+	flush_thread_ = std::thread([this, buffer]() {
+		// Write a temporary file first, so a crash during the write keeps the previous snapshot intact
+		std::string temporary_filename = filename_ + ".tmp";
+		FILE* file = fopen(temporary_filename.c_str(), "wb");
+		bool written = file != nullptr && fwrite(buffer->data(), 1, buffer->size(), file) == buffer->size();
+		if (file != nullptr)
+			written = fclose(file) == 0 && written;
+#ifdef _WIN32
+		if (written)
+			remove(filename_.c_str()); // Windows does not replace existing files on rename
+#endif
+		flush_failed_ = !written || rename(temporary_filename.c_str(), filename_.c_str()) != 0;
+	});
+	return previous_written;
+}
+
+bool CheckpointWriter::join_flush() {
+	if (!flush_thread_.joinable())
+		return true;
+	flush_thread_.join();
+	any_flush_failed_ = any_flush_failed_ || flush_failed_;
+	return !flush_failed_;
+}
+
+bool CheckpointWriter::wait() {
+	join_flush();
+	return !any_flush_failed_;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "Particle.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+#include <tbb/parallel_for.h>
+
+// Columns stored in a snapshot, one aligned block of floats per column
+enum SnapshotColumn { SNAPSHOT_X, SNAPSHOT_Y, SNAPSHOT_VELOCITY_X, SNAPSHOT_VELOCITY_Y, SNAPSHOT_MASS, SNAPSHOT_COLUMN_COUNT };
+
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304; // Detects files written on a machine of different endianness
+static const size_t SNAPSHOT_ALIGNMENT = 4096; // Header and columns start on page boundaries, so they can be mapped directly
+
+// Fixed size header at the start of every snapshot file
+struct SnapshotHeader {
+	char magic[8]; // "NBODYSNP"
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t particle_count;
+	uint64_t seed; // Seed of the initial conditions
+	double time; // Simulation time of the snapshot
+	float time_step;
+	uint32_t universe_size_x;
+	uint32_t universe_size_y;
+	uint32_t column_count;
+	uint64_t column_offset[SNAPSHOT_COLUMN_COUNT]; // Byte offset of every column from the start of the file
+};
+
+// Read-only memory mapped snapshot. Columns are paged in on first access instead of being parsed
+class SnapshotFile {
+	const char* data_;
+	size_t size_;
+#ifdef _WIN32
+	void* file_handle_;
+	void* mapping_handle_;
+#else
+	int file_descriptor_;
+#endif
+	void close();
+public:
+	SnapshotFile(const char* filename);
+	~SnapshotFile();
+	SnapshotFile(const SnapshotFile&) = delete;
+	SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+	bool is_valid() const; // The file was mapped and has a supported header
+	const SnapshotHeader& get_header() const;
+	const float* get_column(SnapshotColumn column) const;
+	void to_particles(std::vector<Particle>& particles) const;
+};
+
+// Writes snapshots in the background. While one buffer is flushed to disk the next one is filled,
+// so the simulation only waits for the copy of the particle state
+class CheckpointWriter {
+	std::string filename_;
+	SnapshotHeader header_;
+	std::vector<char> buffers_[2]; // Complete file images
+	int back_buffer_;
+	std::thread flush_thread_;
+	bool flush_failed_; // Last flush
+	bool any_flush_failed_; // Since the writer was created, a later success does not clear it
+
+	char* prepare_back_buffer(size_t particle_count, double time);
+	bool join_flush(); // False if the last flush could not be written
+	bool flush_back_buffer();
+public:
+	CheckpointWriter(const std::string& filename, uint64_t seed, float time_step, size_t universe_size_x, size_t universe_size_y);
+	~CheckpointWriter();
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+	// Copy the particle state and start writing it, any indexable particle container can be saved. False if the
+	// previous snapshot, whose flush it waits for, could not be written
+	template <typename Container>
+	bool save(const Container& particles, size_t particle_count, double time) {
+		char* image = prepare_back_buffer(particle_count, time);
+		const SnapshotHeader& header = *reinterpret_cast<const SnapshotHeader*>(image);
+
+		float* columns[SNAPSHOT_COLUMN_COUNT];
+		for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column)
+			columns[column] = reinterpret_cast<float*>(image + header.column_offset[column]);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+			[&](const tbb::blocked_range<size_t>& r) {
+			for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+				const Particle& current_particle = particles[index];
+				columns[SNAPSHOT_X][index] = current_particle.x_;
+				columns[SNAPSHOT_Y][index] = current_particle.y_;
+				columns[SNAPSHOT_VELOCITY_X][index] = current_particle.velocity_x_;
+				columns[SNAPSHOT_VELOCITY_Y][index] = current_particle.velocity_y_;
+				columns[SNAPSHOT_MASS][index] = current_particle.mass_;
+			}
+		}); // Implicit barrier
+
+		return flush_back_buffer();
+	}
+
+	bool wait(); // Block until the last snapshot is on disk, false if any snapshot could not be written
+};
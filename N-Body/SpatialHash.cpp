@@ -0,0 +1,126 @@
+#include "SpatialHash.h"
+#include <algorithm>
+#include <cmath>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+
+static const double MAX_CELL = 1099511627776.0; // 2^40, cells of far away positions are clamped
+
+uint32_t parallel_exclusive_scan(uint32_t* values, size_t count, std::vector<uint32_t>& block_sums) {
+	size_t block_count = (count + PREFIX_SUM_GRAIN - 1) / PREFIX_SUM_GRAIN;
+	block_sums.resize(block_count);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, block_count, 1),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t block = r.begin(); block != r.end(); ++block) {
+			size_t end = std::min(count, (block + 1) * PREFIX_SUM_GRAIN);
+			uint32_t sum = 0;
+			for (size_t index = block * PREFIX_SUM_GRAIN; index != end; ++index)
+				sum += values[index];
+			block_sums[block] = sum;
+		}
+	}); // Implicit barrier
+
+	uint32_t total = 0;
+	for (uint32_t& block_sum : block_sums) {
+		uint32_t sum = block_sum;
+		block_sum = total;
+		total += sum;
+	}
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, block_count, 1),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t block = r.begin(); block != r.end(); ++block) {
+			size_t end = std::min(count, (block + 1) * PREFIX_SUM_GRAIN);
+			uint32_t sum = block_sums[block];
+			for (size_t index = block * PREFIX_SUM_GRAIN; index != end; ++index) {
+				uint32_t value = values[index];
+				values[index] = sum;
+				sum += value;
+			}
+		}
+	}); // Implicit barrier
+	return total;
+}
+
+SpatialHash::SpatialHash(const PeriodicBox* periodic_box) : periodic_box_(periodic_box), cell_size_x_(1.0f), cell_size_y_(1.0f),
+	cell_count_x_(0), cell_count_y_(0), bucket_count_(0) {
+}
+
+// Cell of a particle. Invalid and far away positions are clamped, the positions of a periodic universe stay in its cells
+void SpatialHash::get_cell(const Particle& particle, int64_t& cell_x, int64_t& cell_y) const {
+	double u = std::floor(static_cast<double>(particle.x_) / cell_size_x_);
+	double v = std::floor(static_cast<double>(particle.y_) / cell_size_y_);
+	if (!(u == u)) // NaN positions
+		u = 0.0;
+	if (!(v == v))
+		v = 0.0;
+	cell_x = static_cast<int64_t>(std::min(std::max(u, -MAX_CELL), MAX_CELL));
+	cell_y = static_cast<int64_t>(std::min(std::max(v, -MAX_CELL), MAX_CELL));
+	if (periodic_box_ != nullptr) {
+		cell_x = std::min(std::max<int64_t>(cell_x, 0), cell_count_x_ - 1);
+		cell_y = std::min(std::max<int64_t>(cell_y, 0), cell_count_y_ - 1);
+	}
+}
+
+void SpatialHash::build(const Particle* particles, size_t particle_count, float cell_size) {
+	if (!(cell_size > 0.0f))
+		cell_size = 1.0f; // Only pairs at distance zero are looked for, any cell finds them
+	cell_size_x_ = cell_size;
+	cell_size_y_ = cell_size;
+	if (periodic_box_ != nullptr) { // Whole cells per period, no narrower than the requested size
+		cell_count_x_ = std::max<int64_t>(1, static_cast<int64_t>(periodic_box_->get_size_x() / cell_size));
+		cell_count_y_ = std::max<int64_t>(1, static_cast<int64_t>(periodic_box_->get_size_y() / cell_size));
+		cell_size_x_ = periodic_box_->get_size_x() / cell_count_x_;
+		cell_size_y_ = periodic_box_->get_size_y() / cell_count_y_;
+	}
+
+	size_t bucket_count = 64;
+	while (bucket_count < 2 * particle_count)
+		bucket_count <<= 1;
+	if (bucket_count != bucket_count_) {
+		bucket_count_ = bucket_count;
+		bucket_cursors_.reset(new std::atomic<uint32_t>[bucket_count_]);
+		bucket_starts_.resize(bucket_count_ + 1);
+	}
+	particle_buckets_.resize(particle_count);
+	sorted_particles_.resize(particle_count);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, bucket_count_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t bucket = r.begin(); bucket != r.end(); ++bucket)
+			bucket_cursors_[bucket].store(0, std::memory_order_relaxed);
+	}); // Implicit barrier
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			int64_t cell_x, cell_y;
+			get_cell(particles[index], cell_x, cell_y);
+			size_t bucket = get_bucket(cell_x, cell_y);
+			particle_buckets_[index] = static_cast<uint32_t>(bucket);
+			bucket_cursors_[bucket].fetch_add(1, std::memory_order_relaxed);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, bucket_count_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t bucket = r.begin(); bucket != r.end(); ++bucket)
+			bucket_starts_[bucket] = bucket_cursors_[bucket].load(std::memory_order_relaxed);
+	}); // Implicit barrier
+	bucket_starts_[bucket_count_] = parallel_exclusive_scan(bucket_starts_.data(), bucket_count_, block_sums_);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, bucket_count_),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t bucket = r.begin(); bucket != r.end(); ++bucket)
+			bucket_cursors_[bucket].store(bucket_starts_[bucket], std::memory_order_relaxed);
+	}); // Implicit barrier
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t index = r.begin(); index != r.end(); ++index) { // Using index range
+			uint32_t slot = bucket_cursors_[particle_buckets_[index]].fetch_add(1, std::memory_order_relaxed);
+			sorted_particles_[slot] = static_cast<uint32_t>(index);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Particle.h"
+#include "PeriodicBox.h"
+#include "Settings.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Exclusive prefix sum in place, in two parallel passes over blocks of PREFIX_SUM_GRAIN values. Returns the total
+uint32_t parallel_exclusive_scan(uint32_t* values, size_t count, std::vector<uint32_t>& block_sums);
+
+// Uniform grid of cells over the particles, stored as a hash so that it covers any position with about two buckets per
+// particle. The particles are binned with a parallel counting sort: counted per bucket, laid out with a prefix sum and
+// scattered to their slots. A periodic universe is cut into whole cells that wrap around it
+class SpatialHash {
+	const PeriodicBox* periodic_box_;
+	float cell_size_x_;
+	float cell_size_y_;
+	int64_t cell_count_x_; // Cells per side of a periodic universe
+	int64_t cell_count_y_;
+
+	size_t bucket_count_; // Power of two
+	std::unique_ptr<std::atomic<uint32_t>[]> bucket_cursors_; // Particles per bucket, then the insertion slots of the sort
+	std::vector<uint32_t> bucket_starts_; // First sorted particle of every bucket, and the end of the last one
+	std::vector<uint32_t> particle_buckets_;
+	std::vector<uint32_t> sorted_particles_; // Particle indices grouped by bucket, in any order inside a bucket
+	std::vector<uint32_t> block_sums_;
+
+	void get_cell(const Particle& particle, int64_t& cell_x, int64_t& cell_y) const;
+
+	// Spatial hash of Teschner et al. (2003)
+	size_t get_bucket(int64_t cell_x, int64_t cell_y) const {
+		uint64_t hash = (static_cast<uint64_t>(cell_x) * 73856093ULL) ^ (static_cast<uint64_t>(cell_y) * 19349663ULL);
+		return static_cast<size_t>(hash & (bucket_count_ - 1));
+	}
+public:
+	explicit SpatialHash(const PeriodicBox* periodic_box = nullptr);
+	SpatialHash(const SpatialHash&) = delete;
+	SpatialHash& operator=(const SpatialHash&) = delete;
+
+	void build(const Particle* particles, size_t particle_count, float cell_size); // Cells at least cell_size wide
+
+	// Calls visit with the index of every particle of the 3 x 3 cells around the particle, itself included. Hash
+	// collisions add far away particles and small periodic universes repeat cells, the caller checks the distances
+	template <typename Visitor>
+	void for_each_neighbour(const Particle& particle, Visitor&& visit) const {
+		int64_t cell_x, cell_y;
+		get_cell(particle, cell_x, cell_y);
+		for (int64_t offset_y = -1; offset_y <= 1; ++offset_y) {
+			for (int64_t offset_x = -1; offset_x <= 1; ++offset_x) {
+				int64_t neighbour_x = cell_x + offset_x;
+				int64_t neighbour_y = cell_y + offset_y;
+				if (periodic_box_ != nullptr) { // The neighbours wrap around the universe
+					neighbour_x = (neighbour_x + cell_count_x_) % cell_count_x_;
+					neighbour_y = (neighbour_y + cell_count_y_) % cell_count_y_;
+				}
+
+				size_t bucket = get_bucket(neighbour_x, neighbour_y);
+				for (uint32_t slot = bucket_starts_[bucket]; slot != bucket_starts_[bucket + 1]; ++slot)
+					visit(sorted_particles_[slot]);
+			}
+		}
+	}
+
+	// Displacement between two particles, to the nearest image in a periodic universe. Symmetric, so both particles of
+	// a pair see the same distance
+	void get_displacement(const Particle& from, const Particle& to, float& dx, float& dy) const {
+		dx = to.x_ - from.x_;
+		dy = to.y_ - from.y_;
+		if (periodic_box_ != nullptr)
+			periodic_box_->get_minimum_image(dx, dy);
+	}
+};
@@ -0,0 +1,673 @@
+#include "CollisionMerger.h"
+#include "CompressedSnapshot.h"
+#include "FixedPoint.h"
+#include "FrameSink.h"
+#include "HaloFinder.h"
+#include "InteractionKernel.h"
+#include "NBodyApi.h"
+#include "ParallelDeflate.h"
+#include "ParticleHandler.h"
+#include "PeriodicBox.h"
+#include "QuadParticleTree.h"
+#include "Settings.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "ThreadArena.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Behaviour tests of the library, run by ctest one name at a time: nbody_tests [test name]. Without a name every test runs
+
+static const size_t TEST_PARTICLE_COUNT = 2000;
+static const size_t TEST_UNIVERSE_SIZE = 300;
+static const uint64_t TEST_SEED = 11;
+static const int TEST_THREAD_COUNT = 4;
+
+template <typename T>
+static bool are_identical(const std::vector<T>& first, const std::vector<T>& second) {
+	return first.size() == second.size() && memcmp(first.data(), second.data(), first.size() * sizeof(T)) == 0;
+}
+
+static bool report(bool passed, const std::string& message) {
+	if (!passed)
+		std::cerr << message << std::endl;
+	return passed;
+}
+
+// Pair interaction of the engines before the templated kernel, the clamped float law written out
+static void add_reference_acceleration(Particle& particle, float mass, float x, float y) {
+	float dx = x - particle.x_;
+	float dy = y - particle.y_;
+	float distance_square = dx * dx + dy * dy;
+	if (distance_square < MIN_DISTANCE)
+		distance_square = MIN_DISTANCE;
+	float distance = std::sqrt(distance_square);
+	float acceleration_factor = (GRAVITATIONAL_CONSTANT / distance_square) * mass;
+	particle.acceleration_x_ += acceleration_factor * (dx / distance);
+	particle.acceleration_y_ += acceleration_factor * (dy / distance);
+}
+
+// The particle methods through DefaultKernel give the bits of the original float clamp law, close pairs included
+static bool test_kernel_bit_identity() {
+	std::mt19937 generator(static_cast<unsigned>(TEST_SEED));
+	std::uniform_real_distribution<float> position(0.0f, 10.0f); // Many pairs fall under the MIN_DISTANCE floor
+	std::uniform_real_distribution<float> mass(1.0f, 1000.0f);
+
+	for (int pair = 0; pair < 100000; ++pair) {
+		Particle particle(position(generator), position(generator), mass(generator));
+		Particle interacting_particle(position(generator), position(generator), mass(generator));
+
+		Particle single = particle, center_of_mass = particle, pairwise = particle, interacting_pairwise = interacting_particle;
+		single.add_acceleration(interacting_particle);
+		center_of_mass.add_acceleration(interacting_particle.mass_, interacting_particle.x_, interacting_particle.y_);
+		pairwise.add_acceleration_pairwise(interacting_pairwise);
+
+		Particle reference = particle, interacting_reference = interacting_particle;
+		add_reference_acceleration(reference, interacting_particle.mass_, interacting_particle.x_, interacting_particle.y_);
+		add_reference_acceleration(interacting_reference, particle.mass_, particle.x_, particle.y_);
+
+		if (memcmp(&single, &reference, sizeof(Particle)) != 0 || memcmp(&center_of_mass, &reference, sizeof(Particle)) != 0 ||
+			memcmp(&pairwise, &reference, sizeof(Particle)) != 0 || memcmp(&interacting_pairwise, &interacting_reference, sizeof(Particle)) != 0)
+			return report(false, "kernel differs from the original law at pair " + std::to_string(pair));
+	}
+	return true;
+}
+
+// The Barnes-Hut walk through DefaultKernel gives the bits of the walk of the particle methods
+static bool test_tree_walk_kernel() {
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(PLUMMER_SPHERE, TEST_PARTICLE_COUNT, particles, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE, TEST_SEED);
+	std::vector<TreeParticle> tree_particles(particles.begin(), particles.end());
+	QuadParticleTree quad_tree(Particle(0.0f, 0.0f, 0.0f), Particle(TEST_UNIVERSE_SIZE * 2.0f, TEST_UNIVERSE_SIZE * 2.0f, 0.0f));
+	for (TreeParticle& tree_particle : tree_particles)
+		quad_tree.insert(&tree_particle);
+
+	for (size_t index = 0; index < particles.size(); ++index) {
+		Particle reference = particles[index];
+		quad_tree.apply_acceleration(reference);
+		float acceleration[2] = { 0.0f, 0.0f };
+		float potential = 0.0f;
+		quad_tree.apply_acceleration<DefaultKernel>(particles[index], acceleration, potential);
+		if (memcmp(acceleration, &reference.acceleration_x_, sizeof(float)) != 0 || memcmp(acceleration + 1, &reference.acceleration_y_, sizeof(float)) != 0)
+			return report(false, "kernel walk differs from the walk of the particle methods at particle " + std::to_string(index));
+	}
+	return true;
+}
+
+static std::vector<Particle> run_fixed_point(SimulationEngine engine, int thread_count, const std::vector<Particle>& particles,
+	bool merge_collisions) {
+	ThreadArena arena(thread_count);
+	std::vector<Particle> result;
+	arena.execute([&]() {
+		Simulation simulation(engine, "test", particles, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE, TIME_STEP);
+		simulation.set_position_format(POSITION_FIXED_POINT);
+		simulation.set_collision_merging(merge_collisions);
+		for (int step = 0; step < 10; ++step)
+			simulation.step();
+		result = simulation.get_particles();
+	});
+	return result;
+}
+
+// Fixed point trajectories are the same for any thread count, and the trees for any particle order. The direct sums
+// gather every particle in the same order, so the serial and the tbb engines agree too
+static bool test_fixed_point_determinism() {
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(PLUMMER_SPHERE, TEST_PARTICLE_COUNT, particles, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE, TEST_SEED);
+
+	for (SimulationEngine engine : { ENGINE_SERIAL_BARNES_HUT, ENGINE_PARALLEL_BARNES_HUT, ENGINE_TBB }) {
+		for (bool merge_collisions : { false, true }) {
+			std::vector<Particle> single_thread = run_fixed_point(engine, 1, particles, merge_collisions);
+			if (!are_identical(single_thread, run_fixed_point(engine, TEST_THREAD_COUNT, particles, merge_collisions)))
+				return report(false, "fixed point trajectories depend on the thread count, engine " + std::to_string(engine));
+		}
+	}
+	if (!are_identical(run_fixed_point(ENGINE_SERIAL, 1, particles, false), run_fixed_point(ENGINE_TBB, TEST_THREAD_COUNT, particles, false)))
+		return report(false, "fixed point tbb differs from serial");
+
+	std::vector<Particle> reversed_particles(particles.rbegin(), particles.rend());
+	for (SimulationEngine engine : { ENGINE_SERIAL_BARNES_HUT, ENGINE_PARALLEL_BARNES_HUT }) {
+		std::vector<Particle> forward = run_fixed_point(engine, TEST_THREAD_COUNT, particles, false);
+		std::vector<Particle> reversed = run_fixed_point(engine, TEST_THREAD_COUNT, reversed_particles, false);
+		std::reverse(reversed.begin(), reversed.end());
+		if (!are_identical(forward, reversed))
+			return report(false, "fixed point trajectories depend on the particle order, engine " + std::to_string(engine));
+	}
+
+	Simulation periodic(ENGINE_TBB, "test", particles, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE, TIME_STEP, 0.0f, BOUNDARY_PERIODIC);
+	return report(!periodic.set_position_format(POSITION_FIXED_POINT) && periodic.get_position_format() == POSITION_FLOAT,
+		"periodic universes accepted fixed point positions");
+}
+
+// Morton keys against a bit by bit interleave of the coordinates, x in the high bit of every pair
+static bool test_morton_keys() {
+	std::mt19937 generator(static_cast<unsigned>(TEST_SEED));
+	for (int sample = 0; sample < 100000; ++sample) {
+		FixedPosition position;
+		position.x_ = sample < 2 ? (sample == 0 ? 0u : ~0u) : static_cast<uint32_t>(generator());
+		position.y_ = sample < 2 ? (sample == 0 ? 0u : ~0u) : static_cast<uint32_t>(generator());
+
+		uint64_t key = 0;
+		for (int bit = FIXED_POINT_BITS - 1; bit >= 0; --bit)
+			key = (key << 2) | (((position.x_ >> bit) & 1) << 1) | ((position.y_ >> bit) & 1);
+		if (position.get_morton_key() != key)
+			return report(false, "morton key differs from the naive interleave at sample " + std::to_string(sample));
+	}
+	return true;
+}
+
+static bool is_close(float value, float expected, float tolerance) {
+	return std::fabs(value - expected) <= tolerance;
+}
+
+// Corrections at the symmetric points of the lattice, where all the images together pull with zero force, so the
+// correction cancels the nearest image alone
+static bool test_ewald_table() {
+	const float size = 1000.0f;
+	PeriodicBox periodic_box(size, size);
+	const float scale = 1.0f / (size * size); // Corrections per unit G m are of order 1 / L^2
+	const float tolerance = 1e-4f * scale;
+	float correction_x, correction_y;
+
+	periodic_box.get_correction(0.0f, 0.0f, correction_x, correction_y);
+	if (!is_close(correction_x, 0.0f, tolerance) || !is_close(correction_y, 0.0f, tolerance))
+		return report(false, "ewald correction is not zero at the origin");
+
+	periodic_box.get_correction(0.5f * size, 0.0f, correction_x, correction_y);
+	if (!is_close(correction_x, -4.0f * scale, tolerance) || !is_close(correction_y, 0.0f, tolerance))
+		return report(false, "ewald correction at (L/2, 0) is " + std::to_string(correction_x / scale) + " / L^2, expected -4");
+
+	periodic_box.get_correction(0.0f, -0.5f * size, correction_x, correction_y);
+	if (!is_close(correction_x, 0.0f, tolerance) || !is_close(correction_y, 4.0f * scale, tolerance))
+		return report(false, "ewald correction at (0, -L/2) is not odd along its axis");
+
+	periodic_box.get_correction(0.5f * size, 0.5f * size, correction_x, correction_y);
+	const float diagonal = -std::sqrt(2.0f) * scale;
+	if (!is_close(correction_x, diagonal, tolerance) || !is_close(correction_y, diagonal, tolerance))
+		return report(false, "ewald correction at (L/2, L/2) is " + std::to_string(correction_x / scale) + " / L^2, expected -sqrt(2)");
+	return true;
+}
+
+// Friends-of-friends labels against a serial brute force union-find, with both boundary conditions and any thread count
+static bool test_halo_labels() {
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(SONEIRA_PEEBLES_CLUSTERS, TEST_PARTICLE_COUNT, particles, TEST_UNIVERSE_SIZE,
+		TEST_UNIVERSE_SIZE, TEST_SEED);
+	const size_t particle_count = particles.size();
+	const float linking_length = FOF_LINKING_FRACTION * std::sqrt(static_cast<float>(TEST_UNIVERSE_SIZE * TEST_UNIVERSE_SIZE) / particle_count);
+	PeriodicBox box(TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE);
+
+	for (const PeriodicBox* periodic_box : { static_cast<const PeriodicBox*>(nullptr), static_cast<const PeriodicBox*>(&box) }) {
+		std::vector<size_t> parents(particle_count);
+		for (size_t index = 0; index < particle_count; ++index)
+			parents[index] = index;
+		auto find_root = [&](size_t index) {
+			while (parents[index] != index)
+				index = parents[index];
+			return index;
+		};
+		for (size_t i = 0; i < particle_count; ++i) {
+			for (size_t j = 0; j < i; ++j) {
+				float dx = particles[j].x_ - particles[i].x_, dy = particles[j].y_ - particles[i].y_;
+				if (periodic_box != nullptr)
+					periodic_box->get_minimum_image(dx, dy);
+				if (dx * dx + dy * dy > linking_length * linking_length)
+					continue;
+				size_t first_root = find_root(i), second_root = find_root(j);
+				if (first_root != second_root)
+					parents[std::max(first_root, second_root)] = std::min(first_root, second_root); // Labelled by the lowest particle
+			}
+		}
+		std::vector<uint32_t> sizes(particle_count, 0);
+		for (size_t index = 0; index < particle_count; ++index)
+			++sizes[find_root(index)];
+
+		std::vector<HaloGroup> single_thread_groups;
+		for (int thread_count : { 1, TEST_THREAD_COUNT }) {
+			ThreadArena arena(thread_count);
+			std::vector<HaloGroup> groups;
+			arena.execute([&]() {
+				HaloFinder halo_finder(periodic_box);
+				groups = halo_finder.find_groups(particles.data(), particle_count, linking_length);
+			});
+
+			size_t group = 0;
+			for (size_t label = 0; label < particle_count; ++label) {
+				if (sizes[label] < FOF_MIN_GROUP_SIZE)
+					continue;
+				if (group == groups.size() || groups[group].first_particle != label || groups[group].particle_count != sizes[label])
+					return report(false, "halo group of particle " + std::to_string(label) + " differs from the brute force labels");
+				++group;
+			}
+			if (group != groups.size() || group == 0)
+				return report(false, "halo catalog has " + std::to_string(groups.size()) + " groups, brute force " + std::to_string(group));
+			if (thread_count == 1)
+				single_thread_groups = groups;
+			else if (!are_identical(single_thread_groups, groups))
+				return report(false, "halo catalog depends on the thread count");
+		}
+	}
+	return true;
+}
+
+// Merging conserves the mass and the momentum, and removes one particle per merged pair
+static bool test_merge_conservation() {
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(PLUMMER_SPHERE, 20000, particles, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE, TEST_SEED);
+	PeriodicBox box(TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE);
+
+	for (const PeriodicBox* periodic_box : { static_cast<const PeriodicBox*>(nullptr), static_cast<const PeriodicBox*>(&box) }) {
+		ThreadArena arena(TEST_THREAD_COUNT);
+		ParticleVector merged_particles(particles.begin(), particles.end());
+		size_t merged_pair_count = 0;
+		arena.execute([&]() {
+			CollisionMerger collision_merger(COLLISION_DISTANCE_SQUARE, periodic_box);
+			merged_pair_count = collision_merger.merge(merged_particles);
+		});
+		if (merged_pair_count == 0 || merged_particles.size() + merged_pair_count != particles.size())
+			return report(false, "merging removed " + std::to_string(particles.size() - merged_particles.size()) + " particles for " +
+				std::to_string(merged_pair_count) + " pairs");
+
+		double mass[2] = { 0.0, 0.0 }, momentum_x[2] = { 0.0, 0.0 }, momentum_y[2] = { 0.0, 0.0 };
+		for (const Particle& particle : particles) {
+			mass[0] += particle.mass_;
+			momentum_x[0] += static_cast<double>(particle.mass_) * particle.velocity_x_;
+			momentum_y[0] += static_cast<double>(particle.mass_) * particle.velocity_y_;
+		}
+		for (const Particle& particle : merged_particles) {
+			mass[1] += particle.mass_;
+			momentum_x[1] += static_cast<double>(particle.mass_) * particle.velocity_x_;
+			momentum_y[1] += static_cast<double>(particle.mass_) * particle.velocity_y_;
+		}
+		double momentum_scale = std::fabs(momentum_x[0]) + std::fabs(momentum_y[0]) + mass[0] * 1e-3;
+		if (std::fabs(mass[1] - mass[0]) > 1e-6 * mass[0] || std::fabs(momentum_x[1] - momentum_x[0]) > 1e-5 * momentum_scale ||
+			std::fabs(momentum_y[1] - momentum_y[0]) > 1e-5 * momentum_scale)
+			return report(false, "merging changed the mass or the momentum");
+	}
+	return true;
+}
+
+static std::vector<Particle> run_direct_sum(SimulationEngine engine, ReductionMode reduction_mode, BoundaryCondition boundary_condition,
+	int thread_count, const std::vector<Particle>& particles) {
+	ThreadArena arena(thread_count);
+	std::vector<Particle> result;
+	arena.execute([&]() {
+		Simulation simulation(engine, "test", particles, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE, TIME_STEP, 0.0f, boundary_condition);
+		simulation.set_reduction_mode(reduction_mode);
+		for (int step = 0; step < 4; ++step)
+			simulation.step();
+		result = simulation.get_particles();
+	});
+	return result;
+}
+
+// The deterministic TBB direct sum reproduces the serial engine bit for bit, the fast one within its tolerance
+static bool test_deterministic_reduction() {
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(PLUMMER_SPHERE, TEST_PARTICLE_COUNT, particles, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE, TEST_SEED);
+
+	for (BoundaryCondition boundary_condition : { BOUNDARY_REFLECTIVE, BOUNDARY_PERIODIC }) {
+		std::vector<Particle> serial = run_direct_sum(ENGINE_SERIAL, REDUCTION_FAST, boundary_condition, 1, particles);
+		for (int thread_count : { 1, TEST_THREAD_COUNT }) {
+			if (!are_identical(serial, run_direct_sum(ENGINE_TBB, REDUCTION_DETERMINISTIC, boundary_condition, thread_count, particles)))
+				return report(false, "deterministic tbb differs from serial on " + std::to_string(thread_count) + " threads");
+		}
+		if (!ParticleHandler::are_close(serial, run_direct_sum(ENGINE_TBB, REDUCTION_FAST, boundary_condition, TEST_THREAD_COUNT, particles),
+			FAST_REDUCTION_TOLERANCE))
+			return report(false, "fast tbb is not within FAST_REDUCTION_TOLERANCE of serial");
+	}
+	return true;
+}
+
+static bool have_same_state(const std::vector<Particle>& particles, const std::vector<Particle>& expected) {
+	if (particles.size() != expected.size())
+		return false;
+	for (size_t index = 0; index < particles.size(); ++index) {
+		const Particle& particle = particles[index];
+		const Particle& expected_particle = expected[index];
+		if (particle.x_ != expected_particle.x_ || particle.y_ != expected_particle.y_ || particle.velocity_x_ != expected_particle.velocity_x_ ||
+			particle.velocity_y_ != expected_particle.velocity_y_ || particle.mass_ != expected_particle.mass_)
+			return false;
+	}
+	return true;
+}
+
+// A checkpoint maps back to the particles and the header it was saved with, the second save replaces the first
+static bool test_checkpoint_round_trip() {
+	const char* filename = "test_checkpoint.snap";
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(PLUMMER_SPHERE, TEST_PARTICLE_COUNT, particles, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE, TEST_SEED);
+
+	bool passed = true;
+	{
+		CheckpointWriter writer(filename, TEST_SEED, TIME_STEP, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE);
+		for (size_t particle_count : { TEST_PARTICLE_COUNT, TEST_PARTICLE_COUNT / 2 }) { // Merging lowers the count between saves
+			double time = static_cast<double>(particle_count) * TIME_STEP;
+			if (!writer.save(particles, particle_count, time) || !writer.wait()) {
+				passed = report(false, "checkpoint of " + std::to_string(particle_count) + " particles was not written");
+				break;
+			}
+
+			SnapshotFile file(filename);
+			if (!file.is_valid()) {
+				passed = report(false, "checkpoint of " + std::to_string(particle_count) + " particles is not valid");
+				break;
+			}
+			const SnapshotHeader& header = file.get_header();
+			if (header.particle_count != particle_count || header.seed != TEST_SEED || header.time != time || header.time_step != TIME_STEP ||
+				header.universe_size_x != TEST_UNIVERSE_SIZE || header.universe_size_y != TEST_UNIVERSE_SIZE) {
+				passed = report(false, "checkpoint header differs from the saved state");
+				break;
+			}
+
+			std::vector<Particle> saved_particles;
+			file.to_particles(saved_particles);
+			if (!have_same_state(saved_particles, std::vector<Particle>(particles.begin(), particles.begin() + particle_count)) ||
+				file.get_column(SNAPSHOT_MASS)[particle_count - 1] != particles[particle_count - 1].mass_) {
+				passed = report(false, "checkpoint of " + std::to_string(particle_count) + " particles differs from the saved particles");
+				break;
+			}
+		}
+	}
+	std::remove(filename);
+	return passed;
+}
+
+// Several chunks deflated concurrently concatenate into one zlib stream, checksum included, that lodepng inflates
+static bool test_parallel_deflate() {
+	std::mt19937 generator(static_cast<unsigned>(TEST_SEED));
+	std::vector<unsigned char> data(3 * PARALLEL_DEFLATE_CHUNK_SIZE + 12345);
+	for (size_t index = 0; index < data.size(); ++index) // Runs and repeats for the matcher, noise for the literals
+		data[index] = generator() % 4 == 0 ? static_cast<unsigned char>(generator()) : static_cast<unsigned char>(index / 64 % 7);
+
+	LodePNGCompressSettings settings = lodepng_default_compress_settings;
+	unsigned char* compressed = nullptr;
+	size_t compressed_size = 0;
+	unsigned error = parallel_zlib_compress(&compressed, &compressed_size, data.data(), data.size(), &settings);
+	if (error != 0) {
+		free(compressed);
+		return report(false, "parallel deflate failed with error " + std::to_string(error));
+	}
+
+	unsigned char* decompressed = nullptr;
+	size_t decompressed_size = 0;
+	error = lodepng_zlib_decompress(&decompressed, &decompressed_size, compressed, compressed_size, &lodepng_default_decompress_settings);
+	bool passed = error == 0 && decompressed_size == data.size() && memcmp(decompressed, data.data(), data.size()) == 0;
+	free(compressed);
+	free(decompressed);
+	return report(passed, "parallel deflate does not inflate back to its input, error " + std::to_string(error));
+}
+
+// A delta stream reads back frame by frame across the key frames that restart it
+static bool test_frame_stream_delta() {
+	const char* filename = "test_frames.nbf";
+	const size_t width = 64, height = 48;
+	const size_t frame_count = FRAME_STREAM_KEYFRAME_EVERY + 5;
+	std::mt19937 generator(static_cast<unsigned>(TEST_SEED));
+
+	std::vector<std::vector<uint8_t>> frames(frame_count, std::vector<uint8_t>(width * height, 0));
+	for (size_t frame = 0; frame < frame_count; ++frame) {
+		if (frame > 0)
+			frames[frame] = frames[frame - 1];
+		for (int change = 0; change < 40; ++change) // Few pixels change per frame, as in a slowly evolving universe
+			frames[frame][generator() % frames[frame].size()] = static_cast<uint8_t>(generator());
+	}
+
+	bool passed = true;
+	{
+		FrameSink sink(filename, FRAME_STREAM_DELTA, width, height, TEST_SEED);
+		for (size_t frame = 0; frame < frame_count && passed; ++frame)
+			passed = sink.is_open() && sink.write_frame(frames[frame], static_cast<double>(frame) * TIME_STEP);
+	}
+	if (!passed) {
+		std::remove(filename);
+		return report(false, "frame stream was not written");
+	}
+
+	{
+		FrameStreamReader reader(filename);
+		if (!reader.is_valid() || reader.get_width() != width || reader.get_height() != height || reader.get_seed() != TEST_SEED)
+			passed = report(false, "frame stream header differs from the sink");
+		std::vector<uint8_t> levels(width * height, 0);
+		for (size_t frame = 0; frame < frame_count && passed; ++frame) {
+			double time = -1.0;
+			if (!reader.read_frame(levels, time) || levels != frames[frame] || time != static_cast<double>(frame) * TIME_STEP)
+				passed = report(false, "frame " + std::to_string(frame) + " differs from the written one");
+		}
+		double time;
+		if (passed && reader.read_frame(levels, time))
+			passed = report(false, "frame stream reads past its last frame");
+	}
+	std::remove(filename);
+	return passed;
+}
+
+// Level of a value on the quantization grid of a compressed snapshot column
+static uint32_t get_quantized_level(float value, const CompressedColumn& column, uint32_t bits) {
+	double levels = static_cast<double>((static_cast<uint64_t>(1) << bits) - 1);
+	double level = (static_cast<double>(value) - column.minimum) / (static_cast<double>(column.maximum) - column.minimum) * levels + 0.5;
+	return level <= 0.0 ? 0 : static_cast<uint32_t>(std::min(level, levels));
+}
+
+// A Morton ordered compressed snapshot stores the particles along the Z curve of their quantized positions, and gives
+// them back in the original order within the quantization step. An empty snapshot is still a valid file
+static bool test_compressed_snapshot_morton() {
+	const char* filename = "test_snapshot.csnap";
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(UNIFORM_RANDOM, 2 * COMPRESSED_SNAPSHOT_CHUNK_SIZE + 1000, particles, TEST_UNIVERSE_SIZE,
+		TEST_UNIVERSE_SIZE, TEST_SEED);
+
+	CompressedSnapshotWriter writer(TEST_SEED, TIME_STEP, TEST_UNIVERSE_SIZE, TEST_UNIVERSE_SIZE);
+	bool passed = true;
+	for (size_t particle_count : { particles.size(), static_cast<size_t>(0) }) {
+		std::string count = std::to_string(particle_count);
+		if (!writer.save(filename, particles, particle_count, 1.0)) {
+			passed = report(false, "compressed snapshot of " + count + " particles was not written");
+			break;
+		}
+		CompressedSnapshotFile file(filename);
+		std::vector<Particle> saved_particles;
+		if (!file.is_valid() || file.get_header().particle_count != particle_count || file.get_header().seed != TEST_SEED ||
+			!file.to_particles(saved_particles) || saved_particles.size() != particle_count) {
+			passed = report(false, "compressed snapshot of " + count + " particles does not read back");
+			break;
+		}
+		if (MORTON_ORDER_SNAPSHOTS && file.get_header().order != SNAPSHOT_ORDER_MORTON) {
+			passed = report(false, "compressed snapshot of " + count + " particles is not in Morton order");
+			break;
+		}
+
+		// Within half a level of the quantized columns, with a margin for the float rounding. Masses are exact
+		const CompressedSnapshotHeader& header = file.get_header();
+		float tolerance[SNAPSHOT_COLUMN_COUNT];
+		for (int column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+			const CompressedColumn& current_column = header.columns[column];
+			tolerance[column] = current_column.quantization_bits == 0 ? 0.0f : 0.6f * (current_column.maximum - current_column.minimum) /
+				static_cast<float>((static_cast<uint64_t>(1) << current_column.quantization_bits) - 1);
+		}
+		for (size_t index = 0; index < particle_count && passed; ++index) {
+			const Particle& particle = particles[index];
+			const Particle& saved_particle = saved_particles[index];
+			if (!is_close(saved_particle.x_, particle.x_, tolerance[SNAPSHOT_X]) || !is_close(saved_particle.y_, particle.y_, tolerance[SNAPSHOT_Y]) ||
+				!is_close(saved_particle.velocity_x_, particle.velocity_x_, tolerance[SNAPSHOT_VELOCITY_X]) ||
+				!is_close(saved_particle.velocity_y_, particle.velocity_y_, tolerance[SNAPSHOT_VELOCITY_Y]) || saved_particle.mass_ != particle.mass_)
+				passed = report(false, "particle " + std::to_string(index) + " of the compressed snapshot is off by more than its quantization");
+		}
+		if (!passed || !MORTON_ORDER_SNAPSHOTS)
+			continue;
+
+		// The order of the snapshot is the sort of the keys of the 16 bit positions, ties in the original order
+		std::vector<std::pair<uint64_t, uint32_t>> expected_order(particle_count);
+		for (size_t index = 0; index < particle_count; ++index) {
+			uint64_t x = get_quantized_level(particles[index].x_, header.columns[SNAPSHOT_X], 16);
+			uint64_t y = get_quantized_level(particles[index].y_, header.columns[SNAPSHOT_Y], 16);
+			expected_order[index] = std::make_pair(FixedPosition::spread_bits(static_cast<uint32_t>(x)) |
+				(FixedPosition::spread_bits(static_cast<uint32_t>(y)) << 1), static_cast<uint32_t>(index));
+		}
+		std::sort(expected_order.begin(), expected_order.end());
+		std::vector<uint32_t> original_indices;
+		if (!file.read_original_indices(original_indices) || original_indices.size() != particle_count) {
+			passed = report(false, "original indices of the compressed snapshot do not read back");
+			break;
+		}
+		for (size_t index = 0; index < particle_count && passed; ++index) {
+			if (original_indices[index] != expected_order[index].second)
+				passed = report(false, "particle " + std::to_string(index) + " of the compressed snapshot is out of Morton order");
+		}
+	}
+	std::remove(filename);
+	return passed;
+}
+
+// Consistent copy of the shared columns under the seqlock
+struct SharedState {
+	uint64_t sequence;
+	uint64_t particle_count;
+	double time;
+	std::vector<float> columns[NBODY_COLUMN_COUNT];
+};
+
+static void read_shared_state(const nbody_shared_header* header, SharedState& state) {
+	do {
+		state.sequence = nbody_read_begin(header);
+		state.particle_count = std::min(header->particle_count, header->particle_capacity);
+		state.time = header->time;
+		for (int column = 0; column < NBODY_COLUMN_COUNT; ++column) {
+			const float* values = nbody_get_shared_column(header, column);
+			state.columns[column].assign(values, values + state.particle_count);
+		}
+	} while (nbody_read_retry(header, state.sequence));
+}
+
+// A reader attached to the shared memory of a running simulation only copies whole published steps, the last one equal
+// to the columns of the simulation
+static bool test_shared_memory_api() {
+	std::string shared_memory_name = "/nbody_tests_" + std::to_string(std::random_device()());
+	nbody_config config;
+	nbody_default_config(&config);
+	config.particle_count = TEST_PARTICLE_COUNT;
+	config.universe_size_x = TEST_UNIVERSE_SIZE;
+	config.universe_size_y = TEST_UNIVERSE_SIZE;
+	config.seed = TEST_SEED;
+	config.shared_memory_name = shared_memory_name.c_str();
+
+	nbody_config periodic_config = config;
+	periodic_config.boundary_condition = BOUNDARY_PERIODIC;
+	periodic_config.kernel_precision = PRECISION_MIXED;
+	if (nbody_create(&periodic_config) != nullptr)
+		return report(false, "a periodic simulation was created with a mixed precision kernel");
+
+	nbody_simulation* simulation = nbody_create(&config);
+	if (simulation == nullptr)
+		return report(false, "simulation with the shared memory " + shared_memory_name + " was not created");
+	const nbody_shared_header* header = nbody_attach_shared(shared_memory_name.c_str());
+	if (header == nullptr) {
+		nbody_destroy(simulation);
+		return report(false, "shared memory " + shared_memory_name + " could not be attached");
+	}
+
+	// Every publication the reader may see, the sequence counter is 2 * (publication + 1) after it
+	const unsigned step_count = 10;
+	std::vector<std::vector<float>> published(step_count + 1);
+	std::vector<double> published_time(step_count + 1);
+	std::vector<SharedState> reads;
+	std::atomic<bool> done(false);
+	std::thread reader([&]() {
+		uint64_t last_sequence = 0;
+		while (!done.load()) {
+			SharedState state;
+			read_shared_state(header, state);
+			if (state.sequence != last_sequence) {
+				last_sequence = state.sequence;
+				reads.push_back(std::move(state));
+			}
+		}
+	});
+
+	bool passed = true;
+	for (unsigned step = 0; step <= step_count; ++step) {
+		if (step > 0 && nbody_step(simulation, 1) != NBODY_OK)
+			passed = report(false, "step " + std::to_string(step) + " failed");
+		for (int column = 0; column < NBODY_COLUMN_COUNT; ++column) {
+			const float* values = nbody_get_column(simulation, column);
+			published[step].insert(published[step].end(), values, values + nbody_get_particle_count(simulation));
+		}
+		published_time[step] = nbody_get_time(simulation);
+	}
+	done.store(true);
+	reader.join();
+
+	SharedState last_state;
+	read_shared_state(header, last_state);
+	reads.push_back(std::move(last_state));
+	for (size_t read = 0; read < reads.size() && passed; ++read) {
+		const SharedState& state = reads[read];
+		size_t publication = static_cast<size_t>(state.sequence / 2) - 1; // Creating the simulation publishes the first one
+		if (state.sequence == 0 || state.sequence % 2 != 0 || publication > step_count) {
+			passed = report(false, "reader saw the sequence " + std::to_string(state.sequence));
+			break;
+		}
+
+		std::vector<float> columns;
+		for (int column = 0; column < NBODY_COLUMN_COUNT; ++column)
+			columns.insert(columns.end(), state.columns[column].begin(), state.columns[column].end());
+		if (state.particle_count != TEST_PARTICLE_COUNT || state.time != published_time[publication] || !are_identical(columns, published[publication]))
+			passed = report(false, "reader copy of the sequence " + std::to_string(state.sequence) + " mixes steps");
+	}
+	if (passed && reads.back().sequence != 2 * (step_count + 1))
+		passed = report(false, "reader did not see the last step");
+
+	nbody_detach_shared(header);
+	nbody_destroy(simulation);
+	return passed;
+}
+
+struct TestCase {
+	const char* name;
+	bool (*run)();
+};
+
+static const TestCase TEST_CASES[] = {
+	{ "kernel_bit_identity", test_kernel_bit_identity },
+	{ "tree_walk_kernel", test_tree_walk_kernel },
+	{ "fixed_point_determinism", test_fixed_point_determinism },
+	{ "morton_keys", test_morton_keys },
+	{ "ewald_table", test_ewald_table },
+	{ "halo_labels", test_halo_labels },
+	{ "merge_conservation", test_merge_conservation },
+	{ "deterministic_reduction", test_deterministic_reduction },
+	{ "checkpoint_round_trip", test_checkpoint_round_trip },
+	{ "parallel_deflate", test_parallel_deflate },
+	{ "frame_stream_delta", test_frame_stream_delta },
+	{ "compressed_snapshot_morton", test_compressed_snapshot_morton },
+	{ "shared_memory_api", test_shared_memory_api },
+};
+
+int main(int argc, char* argv[]) {
+	int exit_code = 0;
+	bool found = argc < 2;
+	for (const TestCase& test_case : TEST_CASES) {
+		if (argc >= 2 && std::string(argv[1]) != test_case.name)
+			continue;
+		found = true;
+		bool passed = test_case.run();
+		std::cout << test_case.name << ": " << (passed ? "passed" : "FAILED") << std::endl;
+		if (!passed)
+			exit_code = 1;
+	}
+	if (!found) {
+		std::cerr << "Unknown test " << argv[1] << std::endl;
+		exit_code = 1;
+	}
+	return exit_code;
+}
@@ -0,0 +1,192 @@
+#include "ThreadArena.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef _WIN32
+static thread_local DWORD_PTR previous_affinity = 0; // Restored when the thread leaves the arena
+#else
+static thread_local cpu_set_t previous_affinity;
+static thread_local bool has_previous_affinity = false;
+#endif
+
+// Cpus this process may run on
+static std::vector<int> get_allowed_cpus() {
+	std::vector<int> cpus;
+#ifdef _WIN32
+	DWORD_PTR process_mask, system_mask;
+	if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+		for (int cpu = 0; cpu < static_cast<int>(sizeof(DWORD_PTR) * 8); ++cpu) {
+			if (process_mask & (static_cast<DWORD_PTR>(1) << cpu))
+				cpus.push_back(cpu);
+		}
+	}
+#else
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &mask))
+				cpus.push_back(cpu);
+		}
+	}
+#endif
+	return cpus;
+}
+
+// Allowed cpus of every NUMA node, empty on machines without NUMA information
+static std::vector<std::vector<int>> get_numa_node_cpus() {
+	std::vector<int> allowed_cpus = get_allowed_cpus();
+	std::vector<bool> allowed(allowed_cpus.empty() ? 0 : allowed_cpus.back() + 1, false);
+	for (int cpu : allowed_cpus)
+		allowed[cpu] = true;
+
+	std::vector<std::vector<int>> nodes;
+#ifdef _WIN32
+	ULONG highest_node;
+	if (!GetNumaHighestNodeNumber(&highest_node))
+		return nodes;
+	for (ULONG node = 0; node <= highest_node; ++node) {
+		ULONGLONG node_mask;
+		if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &node_mask))
+			continue;
+		std::vector<int> cpus;
+		for (int cpu = 0; cpu < static_cast<int>(allowed.size()) && cpu < 64; ++cpu) {
+			if (allowed[cpu] && (node_mask & (1ull << cpu)))
+				cpus.push_back(cpu);
+		}
+		if (!cpus.empty())
+			nodes.push_back(cpus);
+	}
+#else
+	// Every node directory lists its cpus as ranges, e.g. "0-7,16-23"
+	DIR* node_directory = opendir("/sys/devices/system/node");
+	if (node_directory == nullptr)
+		return nodes;
+
+	std::vector<int> node_ids;
+	while (dirent* entry = readdir(node_directory)) {
+		int node;
+		if (sscanf(entry->d_name, "node%d", &node) == 1)
+			node_ids.push_back(node);
+	}
+	closedir(node_directory);
+	std::sort(node_ids.begin(), node_ids.end());
+
+	for (int node : node_ids) {
+		std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+		FILE* file = fopen(path.c_str(), "r");
+		if (file == nullptr)
+			continue;
+
+		std::vector<int> cpus;
+		int first, last;
+		while (fscanf(file, "%d", &first) == 1) {
+			last = first;
+			if (fscanf(file, "-%d", &last) != 1)
+				last = first;
+			for (int cpu = first; cpu <= last; ++cpu) {
+				if (cpu < static_cast<int>(allowed.size()) && allowed[cpu])
+					cpus.push_back(cpu);
+			}
+			if (fgetc(file) != ',')
+				break;
+		}
+		fclose(file);
+
+		if (!cpus.empty())
+			nodes.push_back(cpus);
+	}
+#endif
+	return nodes;
+}
+
+PinningObserver::PinningObserver(tbb::task_arena& arena, ThreadPinning pinning) : tbb::task_scheduler_observer(arena) {
+	if (pinning == PIN_NUMA_NODES)
+		cpu_sets_ = get_numa_node_cpus();
+
+	// One core per slot, also the fallback when there is no NUMA information
+	if (cpu_sets_.empty() && pinning != PIN_NONE) {
+		for (int cpu : get_allowed_cpus())
+			cpu_sets_.push_back(std::vector<int>(1, cpu));
+	}
+
+	if (!cpu_sets_.empty())
+		observe(true);
+}
+
+PinningObserver::~PinningObserver() {
+	observe(false);
+}
+
+size_t PinningObserver::get_cpu_set_count() const {
+	return cpu_sets_.size();
+}
+
+// Pin the entering thread to the cpus of its slot in the arena
+void PinningObserver::on_scheduler_entry(bool) {
+	int slot = tbb::this_task_arena::current_thread_index();
+	if (slot < 0)
+		return;
+	const std::vector<int>& cpus = cpu_sets_[static_cast<size_t>(slot) % cpu_sets_.size()];
+
+#ifdef _WIN32
+	DWORD_PTR mask = 0;
+	for (int cpu : cpus) {
+		if (cpu < static_cast<int>(sizeof(DWORD_PTR) * 8))
+			mask |= static_cast<DWORD_PTR>(1) << cpu;
+	}
+	if (mask != 0)
+		previous_affinity = SetThreadAffinityMask(GetCurrentThread(), mask);
+#else
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	for (int cpu : cpus)
+		CPU_SET(cpu, &mask);
+	has_previous_affinity = pthread_getaffinity_np(pthread_self(), sizeof(previous_affinity), &previous_affinity) == 0;
+	pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+#endif
+}
+
+// Give the thread its previous cpus back, it may join other arenas
+void PinningObserver::on_scheduler_exit(bool) {
+#ifdef _WIN32
+	if (previous_affinity != 0)
+		SetThreadAffinityMask(GetCurrentThread(), previous_affinity);
+	previous_affinity = 0;
+#else
+	if (has_previous_affinity)
+		pthread_setaffinity_np(pthread_self(), sizeof(previous_affinity), &previous_affinity);
+	has_previous_affinity = false;
+#endif
+}
+
+ThreadArena::ThreadArena(int thread_count, ThreadPinning pinning) :
+	thread_limit_(tbb::global_control::max_allowed_parallelism, static_cast<size_t>(thread_count)), arena_(thread_count) {
+	if (pinning != PIN_NONE) {
+		arena_.initialize();
+		observer_.reset(new PinningObserver(arena_, pinning));
+		if (observer_->get_cpu_set_count() == 0)
+			observer_.reset();
+	}
+}
+
+bool ThreadArena::is_pinned() const {
+	return observer_ != nullptr;
+}
+
+int ThreadArena::get_thread_count() const {
+	return arena_.max_concurrency();
+}
+
+size_t ThreadArena::get_placement_count() const {
+	return observer_ != nullptr ? observer_->get_cpu_set_count() : 1;
+}
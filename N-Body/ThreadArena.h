@@ -0,0 +1,40 @@
+#pragma once
+#include "Settings.h"
+#include <memory>
+#include <vector>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+
+// Pins every thread that joins an arena to a core, or to the cores of a NUMA node
+class PinningObserver : public tbb::task_scheduler_observer {
+	std::vector<std::vector<int>> cpu_sets_; // Cpus a thread slot may run on, slots are assigned round robin
+public:
+	PinningObserver(tbb::task_arena& arena, ThreadPinning pinning);
+	~PinningObserver();
+
+	size_t get_cpu_set_count() const;
+	void on_scheduler_entry(bool is_worker) override;
+	void on_scheduler_exit(bool is_worker) override;
+};
+
+// Threads of a simulation run. Limits the process to the thread count and runs the simulations in an arena
+// of that size, optionally with pinned threads
+class ThreadArena {
+	tbb::global_control thread_limit_;
+	tbb::task_arena arena_;
+	std::unique_ptr<PinningObserver> observer_;
+public:
+	ThreadArena(int thread_count, ThreadPinning pinning = DEFAULT_THREAD_PINNING);
+	ThreadArena(const ThreadArena&) = delete;
+	ThreadArena& operator=(const ThreadArena&) = delete;
+
+	bool is_pinned() const; // False when pinning was not requested or is not supported
+	int get_thread_count() const;
+	size_t get_placement_count() const; // Cores or NUMA nodes the slots are spread over, the slot of a thread modulo this count
+
+	template <typename Function>
+	void execute(const Function& function) {
+		arena_.execute(function);
+	}
+};
@@ -0,0 +1,106 @@
+#include "../FirstTouchAllocator.h"
+#include "../ThreadArena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+#include <tbb/tick_count.h>
+
+// Seconds and bytes of the last pass of every arena slot, only the thread of a slot writes to it
+struct SlotTiming {
+	double seconds;
+	size_t bytes;
+};
+
+// Stream over the particles with the partitioning of the simulation loops, the time of every slot is kept
+template <typename Container>
+static void stream_particles(Container& particles, int pass_count, std::vector<SlotTiming>& timings) {
+	std::fill(timings.begin(), timings.end(), SlotTiming{ 0.0, 0 });
+	for (int pass = 0; pass < pass_count; ++pass) {
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, particles.size()),
+			[&](const tbb::blocked_range<size_t>& r) {
+			tbb::tick_count before = tbb::tick_count::now();
+			for (size_t index = r.begin(); index != r.end(); ++index)
+				particles[index].advance(TIME_STEP, UNIVERSE_SIZE_X, UNIVERSE_SIZE_Y);
+			tbb::tick_count after = tbb::tick_count::now();
+
+			SlotTiming& timing = timings[static_cast<size_t>(tbb::this_task_arena::current_thread_index()) % timings.size()];
+			timing.seconds += (after - before).seconds();
+			timing.bytes += 2 * r.size() * sizeof(Particle); // Every particle is read and written back
+		}, tbb::static_partitioner()); // Implicit barrier
+	}
+}
+
+// Bandwidth of every placement, the slowest slot of a placement bounds its bandwidth
+static void print_bandwidth(const char* description, const std::vector<SlotTiming>& timings, size_t placement_count) {
+	std::cout << description << std::endl;
+	double total_bytes = 0.0, slowest_seconds = 0.0;
+	for (size_t placement = 0; placement < placement_count; ++placement) {
+		double bytes = 0.0, seconds = 0.0;
+		for (size_t slot = placement; slot < timings.size(); slot += placement_count) {
+			bytes += static_cast<double>(timings[slot].bytes);
+			seconds = std::max(seconds, timings[slot].seconds);
+		}
+		if (bytes == 0.0)
+			continue;
+		std::cout << "  placement " << placement << ": " << bytes / seconds / 1e9 << " GB/s" << std::endl;
+		total_bytes += bytes;
+		slowest_seconds = std::max(slowest_seconds, seconds);
+	}
+	std::cout << "  total: " << total_bytes / slowest_seconds / 1e9 << " GB/s" << std::endl;
+}
+
+// Memory bandwidth of the particle loops, with the particles touched first by the main thread or by their own threads.
+// Pin the threads to NUMA nodes to get the bandwidth of every socket
+int main(int argc, char* argv[])
+{
+	size_t particle_count = 10000000;
+	int pass_count = 10;
+	int thread_count = DEFAULT_NUMBER_OF_THREADS;
+	ThreadPinning pinning = PIN_NUMA_NODES;
+
+	if (argc > 1)
+		particle_count = strtoul(argv[1], nullptr, 10);
+	if (argc > 2)
+		pass_count = atoi(argv[2]);
+	if (argc > 3)
+		thread_count = atoi(argv[3]);
+	if (argc > 4)
+		pinning = static_cast<ThreadPinning>(atoi(argv[4]));
+
+	if (particle_count == 0 || pass_count <= 0 || thread_count <= 0 || pinning < PIN_NONE || pinning > PIN_NUMA_NODES) {
+		std::cerr << "Usage: " << argv[0] << " [particle_count] [pass_count] [thread_count] [pinning]" << std::endl;
+		std::cerr << "Pinning: 0 none, 1 cores, 2 NUMA nodes" << std::endl;
+		return 1;
+	}
+
+	ThreadArena thread_arena(thread_count, pinning);
+	size_t placement_count = thread_arena.get_placement_count();
+	std::vector<SlotTiming> timings(static_cast<size_t>(thread_arena.get_thread_count()));
+
+	std::cout << "Particles: " << particle_count << " (" << particle_count * sizeof(Particle) / (1 << 20) << " MiB), passes: " << pass_count <<
+		", threads: " << thread_count << (thread_arena.is_pinned() ? " (pinned)" : "") << ", placements: " << placement_count << std::endl;
+
+	{
+		std::vector<Particle> particles(particle_count, Particle(1.0f, 1.0f, 1.0f)); // Every page is placed by the main thread
+		thread_arena.execute([&]() {
+			stream_particles(particles, 1, timings); // Warm up the thread pool
+			stream_particles(particles, pass_count, timings);
+		});
+		print_bandwidth("Touched by the main thread:", timings, placement_count);
+	}
+
+	{
+		ParticleVector particles;
+		thread_arena.execute([&]() {
+			particles.resize(particle_count, Particle(1.0f, 1.0f, 1.0f)); // Every page is placed by the thread that streams it
+			stream_particles(particles, 1, timings);
+			stream_particles(particles, pass_count, timings);
+		});
+		print_bandwidth("First touched by the arena threads:", timings, placement_count);
+	}
+	return 0;
+}
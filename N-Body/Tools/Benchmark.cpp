@@ -0,0 +1,217 @@
+#include "../Simulation.h"
+#include "../ParticleHandler.h"
+#include "../ThreadArena.h"
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <tbb/tick_count.h>
+
+// Time per step of every engine on the same initial universe, without any output
+int main(int argc, char* argv[])
+{
+	size_t particle_count = 2000;
+	int step_count = 10;
+	size_t universe_size = 1000;
+	int thread_count = DEFAULT_NUMBER_OF_THREADS;
+	ThreadPinning pinning = DEFAULT_THREAD_PINNING;
+	BoundaryCondition boundary_condition = DEFAULT_BOUNDARY_CONDITION;
+	InitialCondition initial_condition = DEFAULT_INITIAL_CONDITION;
+
+	if (argc > 1)
+		particle_count = strtoul(argv[1], nullptr, 10);
+	if (argc > 2)
+		step_count = atoi(argv[2]);
+	if (argc > 3)
+		universe_size = strtoul(argv[3], nullptr, 10);
+	if (argc > 4)
+		thread_count = atoi(argv[4]);
+	if (argc > 5)
+		pinning = static_cast<ThreadPinning>(atoi(argv[5]));
+	if (argc > 6)
+		boundary_condition = static_cast<BoundaryCondition>(atoi(argv[6]));
+	if (argc > 7)
+		initial_condition = static_cast<InitialCondition>(atoi(argv[7]));
+
+	if (particle_count == 0 || step_count <= 0 || universe_size == 0 || thread_count <= 0 || pinning < PIN_NONE || pinning > PIN_NUMA_NODES ||
+		boundary_condition < BOUNDARY_REFLECTIVE || boundary_condition > BOUNDARY_PERIODIC || initial_condition < UNIFORM_RANDOM ||
+		initial_condition > SONEIRA_PEEBLES_CLUSTERS) {
+		std::cerr << "Usage: " << argv[0] << " [particle_count] [step_count] [universe_size] [thread_count] [pinning] [boundaries]"
+			" [initial_condition]" << std::endl;
+		std::cerr << "Pinning: 0 none, 1 cores, 2 NUMA nodes" << std::endl;
+		std::cerr << "Boundaries: 0 reflective, 1 periodic" << std::endl;
+		std::cerr << "Initial condition: 0 uniform, 1 Plummer sphere, 2 exponential disk, 3 Soneira-Peebles clusters" << std::endl;
+		return 1;
+	}
+
+	ThreadArena thread_arena(thread_count, pinning);
+
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(initial_condition, particle_count, particles, universe_size, universe_size, DEFAULT_RANDOM_SEED);
+
+	std::cout << "Particles: " << particle_count << ", initial condition: " << initial_condition << ", steps: " << step_count <<
+		", threads: " << thread_count <<
+		(thread_arena.is_pinned() ? " (pinned)" : "") << std::endl;
+
+	const SimulationEngine engines[] = { ENGINE_SERIAL, ENGINE_SERIAL_BARNES_HUT, ENGINE_PARALLEL_BARNES_HUT, ENGINE_TBB, ENGINE_PARTICLE_MESH, ENGINE_TREE_PM };
+	const char* engine_names[] = { "serial", "serial_barnes_hut", "parallel_barnes_hut", "tbb", "particle_mesh", "tree_pm" };
+	for (int engine = 0; engine < 6; ++engine) {
+		std::unique_ptr<Simulation> simulation_pointer;
+		thread_arena.execute([&]() { // First touch of the particles by the arena threads
+			simulation_pointer.reset(new Simulation(engines[engine], engine_names[engine], particles, universe_size, universe_size, TIME_STEP, 0.0f,
+				boundary_condition));
+		});
+		Simulation& simulation = *simulation_pointer;
+		thread_arena.execute([&]() { simulation.step(); }); // Warm up the caches and the thread pool
+
+		tbb::tick_count before, after;
+		thread_arena.execute([&]() {
+			before = tbb::tick_count::now();
+			for (int step = 0; step < step_count; ++step)
+				simulation.step();
+			after = tbb::tick_count::now();
+		});
+
+		std::cout << engine_names[engine] << ": " << 1000 * (after - before).seconds() / step_count << " ms per step" << std::endl;
+	}
+
+	// The parallel direct sum and tree walk with the other interaction kernels
+	struct KernelVariant {
+		const char* name;
+		SimulationEngine engine;
+		KernelPrecision precision;
+		SofteningLaw softening_law;
+		bool accumulate_potential;
+	};
+	const KernelVariant kernel_variants[] = { { "tbb_double", ENGINE_TBB, PRECISION_DOUBLE, SOFTENING_CLAMP, false },
+		{ "tbb_mixed", ENGINE_TBB, PRECISION_MIXED, SOFTENING_CLAMP, false },
+		{ "tbb_compensated", ENGINE_TBB, PRECISION_COMPENSATED, SOFTENING_CLAMP, false },
+		{ "tbb_plummer", ENGINE_TBB, PRECISION_FLOAT, SOFTENING_PLUMMER, false },
+		{ "tbb_spline", ENGINE_TBB, PRECISION_FLOAT, SOFTENING_SPLINE, false },
+		{ "tbb_double_spline_potential", ENGINE_TBB, PRECISION_DOUBLE, SOFTENING_SPLINE, true },
+		{ "parallel_barnes_hut_double", ENGINE_PARALLEL_BARNES_HUT, PRECISION_DOUBLE, SOFTENING_CLAMP, false },
+		{ "parallel_barnes_hut_mixed", ENGINE_PARALLEL_BARNES_HUT, PRECISION_MIXED, SOFTENING_CLAMP, false },
+		{ "parallel_barnes_hut_compensated", ENGINE_PARALLEL_BARNES_HUT, PRECISION_COMPENSATED, SOFTENING_CLAMP, false } };
+	for (const KernelVariant& variant : kernel_variants) {
+		std::unique_ptr<Simulation> simulation_pointer;
+		thread_arena.execute([&]() {
+			simulation_pointer.reset(new Simulation(variant.engine, variant.name, particles, universe_size, universe_size, TIME_STEP, 0.0f,
+				boundary_condition));
+		});
+		Simulation& simulation = *simulation_pointer;
+		if (!simulation.set_interaction_kernel(variant.precision, variant.softening_law, variant.accumulate_potential)) {
+			std::cout << variant.name << ": skipped, periodic universes only have the float clamped kernel" << std::endl;
+			continue;
+		}
+		thread_arena.execute([&]() { simulation.step(); });
+
+		tbb::tick_count before, after;
+		thread_arena.execute([&]() {
+			before = tbb::tick_count::now();
+			for (int step = 0; step < step_count; ++step)
+				simulation.step();
+			after = tbb::tick_count::now();
+		});
+
+		std::cout << variant.name << ": " << 1000 * (after - before).seconds() / step_count << " ms per step" << std::endl;
+	}
+
+	// The engines whose fast reductions depend on the threads, with deterministic reductions
+	const SimulationEngine deterministic_engines[] = { ENGINE_TBB, ENGINE_PARTICLE_MESH, ENGINE_TREE_PM };
+	const char* deterministic_engine_names[] = { "tbb_deterministic", "particle_mesh_deterministic", "tree_pm_deterministic" };
+	for (int engine = 0; engine < 3; ++engine) {
+		std::unique_ptr<Simulation> simulation_pointer;
+		thread_arena.execute([&]() {
+			simulation_pointer.reset(new Simulation(deterministic_engines[engine], deterministic_engine_names[engine], particles, universe_size,
+				universe_size, TIME_STEP, 0.0f, boundary_condition));
+		});
+		Simulation& simulation = *simulation_pointer;
+		simulation.set_reduction_mode(REDUCTION_DETERMINISTIC);
+		thread_arena.execute([&]() { simulation.step(); });
+
+		tbb::tick_count before, after;
+		thread_arena.execute([&]() {
+			before = tbb::tick_count::now();
+			for (int step = 0; step < step_count; ++step)
+				simulation.step();
+			after = tbb::tick_count::now();
+		});
+
+		std::cout << deterministic_engine_names[engine] << ": " << 1000 * (after - before).seconds() / step_count << " ms per step" << std::endl;
+	}
+
+	// The engines whose trees and direct sums read the fixed point positions
+	const SimulationEngine fixed_point_engines[] = { ENGINE_SERIAL_BARNES_HUT, ENGINE_PARALLEL_BARNES_HUT, ENGINE_TBB, ENGINE_TREE_PM };
+	const char* fixed_point_engine_names[] = { "serial_barnes_hut_fixed_point", "parallel_barnes_hut_fixed_point", "tbb_fixed_point",
+		"tree_pm_fixed_point" };
+	for (int engine = 0; engine < 4; ++engine) {
+		std::unique_ptr<Simulation> simulation_pointer;
+		thread_arena.execute([&]() {
+			simulation_pointer.reset(new Simulation(fixed_point_engines[engine], fixed_point_engine_names[engine], particles, universe_size,
+				universe_size, TIME_STEP, 0.0f, boundary_condition));
+		});
+		Simulation& simulation = *simulation_pointer;
+		if (!simulation.set_position_format(POSITION_FIXED_POINT)) {
+			std::cout << fixed_point_engine_names[engine] << ": skipped, periodic universes only have float positions" << std::endl;
+			continue;
+		}
+		thread_arena.execute([&]() { simulation.step(); });
+
+		tbb::tick_count before, after;
+		thread_arena.execute([&]() {
+			before = tbb::tick_count::now();
+			for (int step = 0; step < step_count; ++step)
+				simulation.step();
+			after = tbb::tick_count::now();
+		});
+
+		std::cout << fixed_point_engine_names[engine] << ": " << 1000 * (after - before).seconds() / step_count << " ms per step" << std::endl;
+	}
+
+	// The Barnes-Hut engine with the collision merging, the particle count goes down along the run
+	{
+		std::unique_ptr<Simulation> simulation_pointer;
+		thread_arena.execute([&]() {
+			simulation_pointer.reset(new Simulation(ENGINE_PARALLEL_BARNES_HUT, "parallel_barnes_hut_merging", particles, universe_size, universe_size,
+				TIME_STEP, 0.0f, boundary_condition));
+		});
+		Simulation& simulation = *simulation_pointer;
+		simulation.set_collision_merging(true);
+		thread_arena.execute([&]() { simulation.step(); });
+
+		tbb::tick_count before, after;
+		thread_arena.execute([&]() {
+			before = tbb::tick_count::now();
+			for (int step = 0; step < step_count; ++step)
+				simulation.step();
+			after = tbb::tick_count::now();
+		});
+
+		std::cout << "parallel_barnes_hut_merging: " << 1000 * (after - before).seconds() / step_count << " ms per step, " <<
+			simulation.get_particle_count() << " particles left" << std::endl;
+	}
+
+	// The friends-of-friends catalog of the initial universe
+	{
+		std::unique_ptr<Simulation> simulation_pointer;
+		thread_arena.execute([&]() {
+			simulation_pointer.reset(new Simulation(ENGINE_PARALLEL_BARNES_HUT, "fof_halos", particles, universe_size, universe_size, TIME_STEP, 0.0f,
+				boundary_condition));
+		});
+		Simulation& simulation = *simulation_pointer;
+		size_t group_count = 0;
+		thread_arena.execute([&]() { simulation.find_halos(); });
+
+		tbb::tick_count before, after;
+		thread_arena.execute([&]() {
+			before = tbb::tick_count::now();
+			for (int step = 0; step < step_count; ++step)
+				group_count = simulation.find_halos().size();
+			after = tbb::tick_count::now();
+		});
+
+		std::cout << "fof_halos: " << 1000 * (after - before).seconds() / step_count << " ms per catalog, " << group_count << " groups" << std::endl;
+	}
+
+	return 0;
+}
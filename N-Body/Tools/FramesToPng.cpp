@@ -0,0 +1,45 @@
+#include "../FrameSink.h"
+#include "../ParticleHandler.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Offline converter of a frame stream to one png per frame
+int main(int argc, char* argv[])
+{
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <input.frames> <output_prefix> [preset]" << std::endl;
+		std::cerr << "Presets: 0 default, 1 fast palette, 2 fast greyscale" << std::endl;
+		return 1;
+	}
+
+	PngEncoderPreset preset = DEFAULT_PNG_PRESET;
+	if (argc > 3) {
+		int preset_index = atoi(argv[3]);
+		if (preset_index < PNG_PRESET_DEFAULT || preset_index > PNG_PRESET_FAST_GREYSCALE) {
+			std::cerr << "Unknown preset " << argv[3] << std::endl;
+			return 1;
+		}
+		preset = static_cast<PngEncoderPreset>(preset_index);
+	}
+
+	FrameStreamReader reader(argv[1]);
+	if (!reader.is_valid()) {
+		std::cerr << "Could not read the frame stream " << argv[1] << std::endl;
+		return 1;
+	}
+
+	// Frames are stored with the universe rows along the height
+	std::vector<uint8_t> levels;
+	double time;
+	size_t frame_count = 0;
+	while (reader.read_frame(levels, time)) {
+		std::string file_name = std::string(argv[2]) + "_timestep_" + std::to_string(time) + ".png";
+		ParticleHandler::levels_to_png(levels, reader.get_height(), reader.get_width(), file_name.c_str(), preset);
+		++frame_count;
+	}
+
+	std::cout << "Converted " << frame_count << " frames (seed " << reader.get_seed() << ")" << std::endl;
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include "../InteractionKernel.h"
+#include "../ParticleHandler.h"
+#include "../ThreadArena.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <tbb/tick_count.h>
+
+// Direct sum accelerations of every particle with one kernel, the accumulators are read without rounding them to float.
+// Returns the seconds of the sum
+template <typename Kernel>
+static double gather_accelerations(const std::vector<Particle>& particles, std::vector<double>& accelerations) {
+	typedef typename Kernel::ScalarType Scalar;
+	typedef typename Kernel::AccumulatorType Accumulator;
+	size_t particle_count = particles.size();
+	accelerations.assign(2 * particle_count, 0.0);
+
+	tbb::tick_count before = tbb::tick_count::now();
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t i = r.begin(); i != r.end(); ++i) {
+			const Scalar x = particles[i].x_;
+			const Scalar y = particles[i].y_;
+			Accumulator acceleration[2] = { Accumulator(0), Accumulator(0) };
+			Accumulator potential = Accumulator(0);
+			for (size_t j = 0; j < particle_count; ++j) {
+				if (j == i)
+					continue;
+				const Scalar displacement[2] = { static_cast<Scalar>(particles[j].x_) - x, static_cast<Scalar>(particles[j].y_) - y };
+				Kernel::add_acceleration(displacement, static_cast<Scalar>(particles[j].mass_), acceleration, potential);
+			}
+			accelerations[2 * i] = static_cast<double>(acceleration[0]);
+			accelerations[2 * i + 1] = static_cast<double>(acceleration[1]);
+		}
+	}, tbb::static_partitioner()); // Implicit barrier
+	tbb::tick_count after = tbb::tick_count::now();
+	return (after - before).seconds();
+}
+
+// Long double direct sum with the clamped law, the reference of the error
+static void gather_reference_accelerations(const std::vector<Particle>& particles, std::vector<double>& accelerations) {
+	size_t particle_count = particles.size();
+	accelerations.assign(2 * particle_count, 0.0);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, particle_count),
+		[&](const tbb::blocked_range<size_t>& r) {
+		for (size_t i = r.begin(); i != r.end(); ++i) {
+			long double acceleration_x = 0.0L, acceleration_y = 0.0L;
+			for (size_t j = 0; j < particle_count; ++j) {
+				if (j == i)
+					continue;
+				long double dx = static_cast<long double>(particles[j].x_) - particles[i].x_;
+				long double dy = static_cast<long double>(particles[j].y_) - particles[i].y_;
+				long double distance_square = std::max(dx * dx + dy * dy, static_cast<long double>(MIN_DISTANCE));
+				long double factor = static_cast<long double>(GRAVITATIONAL_CONSTANT) * particles[j].mass_ / (distance_square * std::sqrt(distance_square));
+				acceleration_x += factor * dx;
+				acceleration_y += factor * dy;
+			}
+			accelerations[2 * i] = static_cast<double>(acceleration_x);
+			accelerations[2 * i + 1] = static_cast<double>(acceleration_y);
+		}
+	}); // Implicit barrier
+}
+
+// Time and error of one accumulation precision. The error is relative to the RMS acceleration, and per particle for the
+// largest one
+template <typename Kernel>
+static void print_precision(const char* description, const std::vector<Particle>& particles, const std::vector<double>& reference) {
+	std::vector<double> accelerations;
+	gather_accelerations<Kernel>(particles, accelerations); // Warm up the caches and the thread pool
+	double seconds = gather_accelerations<Kernel>(particles, accelerations);
+
+	double error_square = 0.0, reference_square = 0.0, max_relative_error = 0.0;
+	for (size_t i = 0; i < particles.size(); ++i) {
+		double error_x = accelerations[2 * i] - reference[2 * i];
+		double error_y = accelerations[2 * i + 1] - reference[2 * i + 1];
+		double magnitude_square = reference[2 * i] * reference[2 * i] + reference[2 * i + 1] * reference[2 * i + 1];
+		error_square += error_x * error_x + error_y * error_y;
+		reference_square += magnitude_square;
+		if (magnitude_square > 0.0)
+			max_relative_error = std::max(max_relative_error, std::sqrt((error_x * error_x + error_y * error_y) / magnitude_square));
+	}
+
+	double interactions = static_cast<double>(particles.size()) * static_cast<double>(particles.size() - 1);
+	std::cout << description << ": " << 1000 * seconds << " ms, " << interactions / seconds / 1e9 << " G interactions/s, RMS error " <<
+		std::sqrt(error_square / reference_square) << ", max error " << max_relative_error << std::endl;
+}
+
+// Error and throughput of the direct sum with float, mixed, compensated and double accumulation, against a long double
+// sum of the same clamped law
+int main(int argc, char* argv[])
+{
+	size_t particle_count = 10000;
+	size_t universe_size = 1000;
+	int thread_count = DEFAULT_NUMBER_OF_THREADS;
+	InitialCondition initial_condition = PLUMMER_SPHERE; // Dense center, the pulls span many orders of magnitude
+
+	if (argc > 1)
+		particle_count = strtoul(argv[1], nullptr, 10);
+	if (argc > 2)
+		universe_size = strtoul(argv[2], nullptr, 10);
+	if (argc > 3)
+		thread_count = atoi(argv[3]);
+	if (argc > 4)
+		initial_condition = static_cast<InitialCondition>(atoi(argv[4]));
+
+	if (particle_count < 2 || universe_size == 0 || thread_count <= 0 || initial_condition < UNIFORM_RANDOM ||
+		initial_condition > SONEIRA_PEEBLES_CLUSTERS) {
+		std::cerr << "Usage: " << argv[0] << " [particle_count] [universe_size] [thread_count] [initial_condition]" << std::endl;
+		std::cerr << "Initial conditions: 0 uniform, 1 Plummer sphere, 2 exponential disk, 3 clusters" << std::endl;
+		return 1;
+	}
+
+	ThreadArena thread_arena(thread_count);
+
+	std::vector<Particle> particles;
+	ParticleHandler::allocate_particles(initial_condition, particle_count, particles, universe_size, universe_size, DEFAULT_RANDOM_SEED);
+	std::cout << "Particles: " << particle_count << ", threads: " << thread_count << std::endl;
+
+	thread_arena.execute([&]() {
+		std::vector<double> reference;
+		gather_reference_accelerations(particles, reference);
+
+		print_precision<InteractionKernel<float, ClampSoftening, false, float>>("float", particles, reference);
+		print_precision<InteractionKernel<float, ClampSoftening, false, CompensatedFloat>>("compensated", particles, reference);
+		print_precision<InteractionKernel<float, ClampSoftening, false, double>>("mixed", particles, reference);
+		print_precision<InteractionKernel<double, ClampSoftening, false, double>>("double", particles, reference);
+	});
+	return 0;
+}
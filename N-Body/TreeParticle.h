@@ -1,9 +1,11 @@
 #pragma once
 #include "Particle.h"
+#include "FixedPoint.h"
 
 // A class wrapper of typical particles for a Quad tree particle collection
 class TreeParticle {
 	Particle particle_;
+	FixedPosition fixed_position_; // Only set by the fixed point trees
 public:
 	TreeParticle() { }
 	TreeParticle(const Particle& input_particle) : particle_(input_particle) { }
@@ -16,6 +18,14 @@ public:
 		particle_ = input_particle;
 	}
 
+	const FixedPosition& get_fixed_position() const {
+		return fixed_position_;
+	}
+
+	void set_fixed_position(const FixedPosition& fixed_position) {
+		fixed_position_ = fixed_position;
+	}
+
 	float get_mass() const {
 		return particle_.mass_;
 	}
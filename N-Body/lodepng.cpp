@@ -32,6 +32,7 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef LODEPNG_COMPILE_CPP
 #include <fstream>
@@ -1631,7 +1632,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize)
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize, unsigned final)
 {
 	/*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
 	2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
@@ -1643,7 +1644,7 @@ static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, s
 		unsigned BFINAL, BTYPE, LEN, NLEN;
 		unsigned char firstbyte;
 
-		BFINAL = (i == numdeflateblocks - 1);
+		BFINAL = final && (i == numdeflateblocks - 1);
 		BTYPE = 0;
 
 		firstbyte = (unsigned char)(BFINAL + ((BTYPE & 1) << 1) + ((BTYPE & 2) << 1));
@@ -1995,8 +1996,12 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
 	return error;
 }
 
+/*
+final: if 0, the last block does not end the stream, and the output is followed by an empty stored block
+(a zlib sync flush) so that it ends on a byte boundary and further deflate data can be appended to it.
+*/
 static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-	const LodePNGCompressSettings* settings)
+	const LodePNGCompressSettings* settings, unsigned final)
 {
 	unsigned error = 0;
 	size_t i, blocksize, numdeflateblocks;
@@ -2004,7 +2009,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
 	Hash hash;
 
 	if (settings->btype > 2) return 61;
-	else if (settings->btype == 0) return deflateNoCompression(out, in, insize);
+	else if (settings->btype == 0) return deflateNoCompression(out, in, insize, final);
 	else if (settings->btype == 1) blocksize = insize;
 	else /*if(settings->btype == 2)*/
 	{
@@ -2022,13 +2027,23 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
 
 	for (i = 0; i != numdeflateblocks && !error; ++i)
 	{
-		unsigned final = (i == numdeflateblocks - 1);
+		unsigned lastblock = (i == numdeflateblocks - 1);
 		size_t start = i * blocksize;
 		size_t end = start + blocksize;
 		if (end > insize) end = insize;
 
-		if (settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
-		else if (settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+		if (settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final && lastblock);
+		else if (settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final && lastblock);
+	}
+
+	if (!error && !final)
+	{
+		/*empty non-final stored block: 3 header bits, skip to the byte boundary, LEN 0 and NLEN 65535*/
+		addBitsToStream(&bp, out, 0, 3);
+		ucvector_push_back(out, 0);
+		ucvector_push_back(out, 0);
+		ucvector_push_back(out, 255);
+		ucvector_push_back(out, 255);
 	}
 
 	hash_cleanup(&hash);
@@ -2043,7 +2058,20 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
 	unsigned error;
 	ucvector v;
 	ucvector_init_buffer(&v, *out, *outsize);
-	error = lodepng_deflatev(&v, in, insize, settings);
+	error = lodepng_deflatev(&v, in, insize, settings, 1);
+	*out = v.data;
+	*outsize = v.size;
+	return error;
+}
+
+unsigned lodepng_deflate_partial(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize,
+	const LodePNGCompressSettings* settings, unsigned final)
+{
+	unsigned error;
+	ucvector v;
+	ucvector_init_buffer(&v, *out, *outsize);
+	error = lodepng_deflatev(&v, in, insize, settings, final);
 	*out = v.data;
 	*outsize = v.size;
 	return error;
@@ -2098,6 +2126,11 @@ static unsigned adler32(const unsigned char* data, unsigned len)
 	return update_adler32(1L, data, len);
 }
 
+unsigned lodepng_update_adler32(unsigned adler, const unsigned char* data, unsigned len)
+{
+	return update_adler32(adler, data, len);
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -26,8 +26,11 @@ distribution.
 #ifndef LODEPNG_H
 #define LODEPNG_H
 
+#include <stddef.h> /*for size_t*/
+
 #ifdef __cplusplus
 #include <vector>
+#include <string>
 #endif /*__cplusplus*/
 
 extern const char* LODEPNG_VERSION_STRING;
@@ -784,6 +787,18 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
 	const unsigned char* in, size_t insize,
 	const LodePNGCompressSettings* settings);
 
+/*
+Same as lodepng_deflate, but if final is 0 the stream is left open: the output ends with an empty
+stored block (a sync flush) on a byte boundary, so independently compressed pieces can be concatenated.
+Only the last piece of a stream must be compressed with final set to 1.
+*/
+unsigned lodepng_deflate_partial(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize,
+	const LodePNGCompressSettings* settings, unsigned final);
+
+/*Continue an adler32 checksum (start with 1) over the bytes data[0..len-1]*/
+unsigned lodepng_update_adler32(unsigned adler, const unsigned char* data, unsigned len);
+
 #endif /*LODEPNG_COMPILE_ENCODER*/
 #endif /*LODEPNG_COMPILE_ZLIB*/
 